@@ -1,6 +1,7 @@
 #pragma once
 #include <cstdint>
 #include <sstream>
+#include <string_view>
 
 namespace pgvoxel {
 
@@ -21,8 +22,8 @@ std::ostringstream &operator<<(std::ostringstream &oss, const T &p) {
 }
 
 template <typename T>
-requires requires(std::istringstream &iss, T &p, uint32_t size) { p.deserialize(iss, size); }
-std::istringstream &operator>>(std::istringstream &iss, T &p) {
+requires requires(std::istream &iss, T &p, uint32_t size) { p.deserialize(iss, size); }
+std::istream &operator>>(std::istream &iss, T &p) {
 	uint32_t size;
 	iss.read(reinterpret_cast<char *>(&size), sizeof(uint32_t));
 	p.deserialize(iss, size);
@@ -30,6 +31,46 @@ std::istringstream &operator>>(std::istringstream &iss, T &p) {
 	return iss;
 }
 
+// 直接从 data 所指的内存中读取的流，不复制数据，data 需要在流的生命周期内保持有效
+// 用于反序列化数据库中的值，避免先复制到 std::string 再复制进 istringstream
+class ViewStreamBuf : public std::streambuf {
+public:
+	explicit ViewStreamBuf(const std::string_view data) {
+		char *begin = const_cast<char *>(data.data());
+		setg(begin, begin, begin + data.size());
+	}
+
+	// 取出接下来的 size 个字节而不复制，剩余数据不足时返回 false
+	bool take(const size_t size, std::string_view &result) {
+		if (static_cast<size_t>(egptr() - gptr()) < size) [[unlikely]] {
+			return false;
+		}
+		result = std::string_view(gptr(), size);
+		setg(eback(), gptr() + size, egptr());
+		return true;
+	}
+
+protected:
+	pos_type seekoff(const off_type off, const std::ios_base::seekdir dir, const std::ios_base::openmode which) override {
+		char *base = dir == std::ios_base::beg ? eback() : dir == std::ios_base::cur ? gptr() : egptr();
+		if (!(which & std::ios_base::in) || off < eback() - base || off > egptr() - base) [[unlikely]] {
+			return pos_type(off_type(-1));
+		}
+		setg(eback(), base + off, egptr());
+		return pos_type(gptr() - eback());
+	}
+
+	pos_type seekpos(const pos_type pos, const std::ios_base::openmode which) override {
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+};
+
+class ViewStream : private ViewStreamBuf, public std::istream {
+public:
+	explicit ViewStream(const std::string_view data) :
+			ViewStreamBuf(data), std::istream(static_cast<ViewStreamBuf *>(this)) {}
+};
+
 #define SERIALIZE_WRITE(oss, data) oss.write(reinterpret_cast<const char *>(&data), sizeof(data))
 #define DESERIALIZE_READ(iss, data) iss.read(reinterpret_cast<char *>(&data), sizeof(data))
 
@@ -13,7 +13,15 @@ public:
 	STRUCT_WITH_PROPERTIES(Data,
 						   std::string name;
 						   std::int32_t seed;
-						   CoordAxis width;)
+						   CoordAxis width;
+						   CoordAxis height;
+						   std::uint64_t map_size;
+						   std::uint32_t shards;
+						   std::string storage_backend;
+						   bool batch_terrain;
+						   std::uint64_t chunk_cache_size;
+						   std::uint64_t compressed_chunk_cache_size;
+						   std::uint64_t generation_memory_budget;)
 	data;
 
 public:
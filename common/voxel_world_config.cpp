@@ -15,6 +15,8 @@ Variant VoxelWorldConfig::get(String property_name) {
 	    return config.seed;
 	} else if (property_name == "width") {
 	    return config.width;
+	} else if (property_name == "height") {
+	    return config.height;
 	} else {
 		print_error("Invalid world config property name.");
 		return Variant();
@@ -1,4 +1,6 @@
 def can_build(env, platform):
+    # 原生生成器使用 noise 模块中的 Noise
+    env.module_add_dependencies("pgvoxel", ["noise"])
     return True
 
 def configure(env):
@@ -0,0 +1,41 @@
+#include "deferred_edit_queue.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace pgvoxel {
+
+void DeferredEditQueue::push(const uint64_t target, const std::vector<Edit> &edits) {
+	auto &shard = shardOf(target);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	auto &queued = shard.edits[target];
+	queued.insert(queued.end(), edits.begin(), edits.end());
+}
+
+std::vector<DeferredEditQueue::Edit> DeferredEditQueue::take(const uint64_t target) {
+	std::vector<Edit> result;
+	{
+		auto &shard = shardOf(target);
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		auto iter = shard.edits.find(target);
+		if (iter == shard.edits.end()) {
+			return result;
+		}
+		result = std::move(iter->second);
+		shard.edits.erase(iter);
+	}
+	// 各线程提交的顺序不确定，按来源排序使结果与调度无关
+	std::sort(result.begin(), result.end(), [](const Edit &a, const Edit &b) {
+		return std::tie(a.layer, a.x, a.z, a.source, a.sequence) < std::tie(b.layer, b.x, b.z, b.source, b.sequence);
+	});
+	return result;
+}
+
+void DeferredEditQueue::clear() {
+	for (auto &shard : shards_) {
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		shard.edits.clear();
+	}
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,280 @@
+#include "generator_program.h"
+
+#include "voxel_generation_chunk.h"
+
+#include "core/error/error_macros.h"
+#include "core/string/ustring.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace pgvoxel {
+
+namespace {
+
+// 对单个值求值，用于编译时折叠常量，与 execute 中的逐列运算一致
+float evaluate(const GeneratorProgram::Op op, const float a, const float b, const float c, const float low, const float high) {
+	using Op = GeneratorProgram::Op;
+	switch (op) {
+		case Op::kAdd:
+			return a + b;
+		case Op::kSub:
+			return a - b;
+		case Op::kMul:
+			return a * b;
+		case Op::kMin:
+			return std::min(a, b);
+		case Op::kMax:
+			return std::max(a, b);
+		case Op::kClamp:
+			return std::clamp(a, low, high);
+		case Op::kSelect:
+			return a > 0 ? b : c;
+		default:
+			return 0;
+	}
+}
+
+bool foldable(const GeneratorProgram::Op op) {
+	using Op = GeneratorProgram::Op;
+	return op == Op::kAdd || op == Op::kSub || op == Op::kMul || op == Op::kMin || op == Op::kMax || op == Op::kClamp || op == Op::kSelect;
+}
+
+} //namespace
+
+int GeneratorProgram::inputCount(const Op op) {
+	switch (op) {
+		case Op::kConstant:
+		case Op::kX:
+		case Op::kY:
+		case Op::kZ:
+		case Op::kNoise2d:
+		case Op::kNoise3d:
+			return 0;
+		case Op::kClamp:
+		case Op::kSetBlock:
+			return 1;
+		case Op::kSelect:
+			return 3;
+		default:
+			return 2;
+	}
+}
+
+std::shared_ptr<const GeneratorProgram> GeneratorProgram::compile(const std::vector<Node> &nodes, std::vector<Field> fields) {
+	const int count = nodes.size();
+	for (int i = 0; i < count; ++i) {
+		const Node &node = nodes[i];
+		ERR_FAIL_COND_V_MSG(static_cast<int>(node.inputs.size()) != inputCount(node.op), nullptr, vformat("Generator graph node %d has a wrong number of inputs.", i));
+		for (const int input : node.inputs) {
+			ERR_FAIL_COND_V_MSG(input < 0 || input >= i, nullptr, vformat("Generator graph node %d must only use earlier nodes as inputs.", i));
+		}
+		if (node.op == Op::kNoise2d || node.op == Op::kNoise3d) {
+			ERR_FAIL_COND_V_MSG(node.field >= fields.size(), nullptr, vformat("Generator graph node %d has no noise.", i));
+			ERR_FAIL_COND_V_MSG(fields[node.field].three_dimensional != (node.op == Op::kNoise3d), nullptr, vformat("Generator graph node %d uses a noise of the wrong dimension.", i));
+		}
+		if (node.op == Op::kClamp) {
+			ERR_FAIL_COND_V_MSG(node.a > node.b, nullptr, vformat("Generator graph node %d clamps to an empty range.", i));
+		}
+		if (node.op == Op::kSetBlock) {
+			ERR_FAIL_COND_V_MSG(node.layer >= GenerationChunk::kDataChunkNums, nullptr, vformat("Generator graph node %d writes to an invalid layer.", i));
+		}
+	}
+	for (const Field &field : fields) {
+		ERR_FAIL_COND_V_MSG(field.stride == 0 || kGeneratingChunkWidth % field.stride != 0, nullptr, "Noise stride must divide the chunk width.");
+	}
+
+	// 折叠输入都是常量的运算
+	std::vector<Node> folded = nodes;
+	for (Node &node : folded) {
+		if (!foldable(node.op) ||
+				!std::all_of(node.inputs.begin(), node.inputs.end(), [&](const int input) { return folded[input].op == Op::kConstant; })) {
+			continue;
+		}
+		std::array<float, 3> values{};
+		for (size_t k = 0; k < node.inputs.size(); ++k) {
+			values[k] = folded[node.inputs[k]].a;
+		}
+		node.a = evaluate(node.op, values[0], values[1], values[2], node.a, node.b);
+		node.op = Op::kConstant;
+		node.inputs.clear();
+	}
+
+	// 只保留会影响写入的节点。输入总在之前，倒序一遍即可
+	std::vector<bool> live(count, false);
+	std::vector<int> last_use(count, -1);
+	for (int i = count - 1; i >= 0; --i) {
+		if (folded[i].op == Op::kSetBlock) {
+			live[i] = true;
+		}
+		if (!live[i]) {
+			continue;
+		}
+		for (const int input : folded[i].inputs) {
+			live[input] = true;
+			last_use[input] = std::max(last_use[input], i);
+		}
+	}
+
+	auto program = std::make_shared<GeneratorProgram>();
+	// 只保留用到的噪声场
+	std::vector<int> field_index(fields.size(), -1);
+	// 寄存器在值最后一次被使用后即可复用。运算都是逐格的，结果可以写入同一条指令的输入寄存器
+	std::vector<uint8_t> registers(count, 0), released;
+	for (int i = 0; i < count; ++i) {
+		if (!live[i]) {
+			continue;
+		}
+		const Node &node = folded[i];
+		Instruction instruction{ node.op, 0, { 0, 0, 0 }, node.a, node.b, 0, node.block, node.layer };
+		for (size_t k = 0; k < node.inputs.size(); ++k) {
+			instruction.src[k] = registers[node.inputs[k]];
+		}
+		for (size_t k = 0; k < node.inputs.size(); ++k) {
+			const int input = node.inputs[k];
+			// 同一输入出现多次时只释放一次
+			if (last_use[input] == i && std::find(node.inputs.begin(), node.inputs.begin() + k, input) == node.inputs.begin() + k) {
+				released.push_back(registers[input]);
+			}
+		}
+		if (node.op == Op::kNoise2d || node.op == Op::kNoise3d) {
+			if (field_index[node.field] < 0) {
+				field_index[node.field] = program->fields_.size();
+				program->fields_.push_back(fields[node.field]);
+			}
+			instruction.field = field_index[node.field];
+		}
+		if (node.op != Op::kSetBlock) {
+			if (!released.empty()) {
+				registers[i] = released.back();
+				released.pop_back();
+			} else {
+				ERR_FAIL_COND_V_MSG(program->register_count_ >= kMaxRegisters, nullptr, "Generator graph needs too many registers.");
+				registers[i] = program->register_count_++;
+			}
+			instruction.dst = registers[i];
+		}
+		program->instructions_.push_back(instruction);
+	}
+	return program;
+}
+
+void GeneratorProgram::execute(VoxelGenerationChunk &chunk) const {
+	if (instructions_.empty()) {
+		return;
+	}
+	constexpr size_t kWidth = kGeneratingChunkWidth, kHeight = kGeneratingChunkHeight;
+	const double origin_x = static_cast<double>(chunk.getX()) * kWidth, origin_z = static_cast<double>(chunk.getZ()) * kWidth;
+
+	// 噪声场每个区块整体采样一次，二维按 zx 的顺序，三维按 zxy 的顺序
+	// 缓冲区由各线程复用，生成线程在整个生成过程中保持不变
+	thread_local std::vector<std::vector<float>> samples;
+	thread_local std::vector<float> registers;
+	thread_local std::array<std::vector<VoxelData>, GenerationChunk::kDataChunkNums> bars;
+	samples.resize(std::max(samples.size(), fields_.size()));
+	for (size_t f = 0; f < fields_.size(); ++f) {
+		const Field &field = fields_[f];
+		if (field.three_dimensional) {
+			samples[f].resize(kWidth * kHeight * kWidth);
+			field.noise.fillUpsampled3d(origin_x, 0, origin_z, field.stride, kWidth, kHeight, kWidth, samples[f].data());
+		} else {
+			samples[f].resize(kWidth * kWidth);
+			field.noise.fillGrid2d(origin_x, origin_z, 1, kWidth, kWidth, samples[f].data());
+		}
+	}
+	registers.resize(register_count_ * kHeight);
+	const auto reg = [&](const uint8_t index) { return registers.data() + index * kHeight; };
+
+	for (size_t z = 0; z < kWidth; ++z) {
+		for (size_t x = 0; x < kWidth; ++x) {
+			const size_t column = z * kWidth + x;
+			// 每层的竖列在第一次写入前读取，执行完后写回被修改的层
+			std::array<bool, GenerationChunk::kDataChunkNums> loaded{}, changed{};
+			for (const Instruction &instruction : instructions_) {
+				float *dst = reg(instruction.dst);
+				const float *in0 = reg(instruction.src[0]), *in1 = reg(instruction.src[1]), *in2 = reg(instruction.src[2]);
+				switch (instruction.op) {
+					case Op::kConstant:
+						std::fill(dst, dst + kHeight, instruction.a);
+						break;
+					case Op::kX:
+						std::fill(dst, dst + kHeight, static_cast<float>(origin_x + x));
+						break;
+					case Op::kY:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = y;
+						}
+						break;
+					case Op::kZ:
+						std::fill(dst, dst + kHeight, static_cast<float>(origin_z + z));
+						break;
+					case Op::kNoise2d:
+						std::fill(dst, dst + kHeight, samples[instruction.field][column]);
+						break;
+					case Op::kNoise3d: {
+						const float *source = samples[instruction.field].data() + column * kHeight;
+						std::copy(source, source + kHeight, dst);
+						break;
+					}
+					case Op::kAdd:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = in0[y] + in1[y];
+						}
+						break;
+					case Op::kSub:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = in0[y] - in1[y];
+						}
+						break;
+					case Op::kMul:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = in0[y] * in1[y];
+						}
+						break;
+					case Op::kMin:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = std::min(in0[y], in1[y]);
+						}
+						break;
+					case Op::kMax:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = std::max(in0[y], in1[y]);
+						}
+						break;
+					case Op::kClamp:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = std::clamp(in0[y], instruction.a, instruction.b);
+						}
+						break;
+					case Op::kSelect:
+						for (size_t y = 0; y < kHeight; ++y) {
+							dst[y] = in0[y] > 0 ? in1[y] : in2[y];
+						}
+						break;
+					case Op::kSetBlock: {
+						auto &bar = bars[instruction.layer];
+						if (!loaded[instruction.layer]) {
+							bar = chunk.readBar(x, z, 0, kHeight, instruction.layer);
+							loaded[instruction.layer] = true;
+						}
+						for (size_t y = 0; y < kHeight; ++y) {
+							if (in0[y] > 0 && bar[y] != instruction.block) {
+								bar[y] = instruction.block;
+								changed[instruction.layer] = true;
+							}
+						}
+						break;
+					}
+				}
+			}
+			for (uint8_t layer = 0; layer < GenerationChunk::kDataChunkNums; ++layer) {
+				if (changed[layer]) {
+					chunk.writeBar(x, z, 0, bars[layer], layer);
+				}
+			}
+		}
+	}
+}
+
+} //namespace pgvoxel
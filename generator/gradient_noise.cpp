@@ -0,0 +1,217 @@
+#include "gradient_noise.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace pgvoxel {
+
+namespace {
+
+// 将格点坐标散列为梯度的素数
+constexpr uint32_t kPrimeX = 501125321;
+constexpr uint32_t kPrimeY = 1136930381;
+constexpr uint32_t kPrimeZ = 1720413743;
+constexpr uint32_t kHashMultiplier = 0x27d4eb2d;
+
+// 二维取 8 个方向的单位向量，三维取立方体 12 条棱的方向，补足 16 个以便用位运算选取
+constexpr float kDiagonal = 0.70710678f;
+constexpr float kGradient2dX[8] = { 1, -1, 0, 0, kDiagonal, -kDiagonal, kDiagonal, -kDiagonal };
+constexpr float kGradient2dZ[8] = { 0, 0, 1, -1, kDiagonal, kDiagonal, -kDiagonal, -kDiagonal };
+constexpr float kGradient3dX[16] = { 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0, 1, 0, -1, 0 };
+constexpr float kGradient3dY[16] = { 1, 1, -1, -1, 0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1 };
+constexpr float kGradient3dZ[16] = { 0, 0, 0, 0, 1, 1, -1, -1, 1, 1, -1, -1, 0, 1, 0, -1 };
+// 使结果大致落在 [-1, 1] 内
+constexpr float kScale2d = 1.41421356f;
+constexpr float kScale3d = 1.0f;
+
+inline uint32_t gradientIndex(const uint32_t seed, const uint32_t primed_x, const uint32_t primed_y, const uint32_t primed_z) {
+	uint32_t hash = (seed ^ primed_x ^ primed_y ^ primed_z) * kHashMultiplier;
+	return hash ^ (hash >> 15);
+}
+
+inline float gradient2d(const uint32_t seed, const uint32_t primed_x, const uint32_t primed_z, const float dx, const float dz) {
+	const uint32_t index = gradientIndex(seed, primed_x, 0, primed_z) & 7;
+	return kGradient2dX[index] * dx + kGradient2dZ[index] * dz;
+}
+
+inline float gradient3d(const uint32_t seed, const uint32_t primed_x, const uint32_t primed_y, const uint32_t primed_z, const float dx, const float dy, const float dz) {
+	const uint32_t index = gradientIndex(seed, primed_x, primed_y, primed_z) & 15;
+	return kGradient3dX[index] * dx + kGradient3dY[index] * dy + kGradient3dZ[index] * dz;
+}
+
+inline float fade(const float t) {
+	return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+inline float lerp(const float a, const float b, const float t) {
+	return a + (b - a) * t;
+}
+
+// 每次在栈上处理的点数
+constexpr size_t kBlockSize = 64;
+
+// 将坐标拆分为格点和格内的小数部分。格点只参与散列，乘以频率后的坐标不会超出 int32_t 的范围
+// double 的运算在默认的浮点选项下不能向量化，单独放在这里，之后的计算只涉及 float 和整数
+inline void split(const double *position, const double frequency, uint32_t *cell, float *fraction, const size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		const double scaled = position[i] * frequency;
+		const double floored = std::floor(scaled);
+		cell[i] = static_cast<uint32_t>(static_cast<int32_t>(floored));
+		fraction[i] = static_cast<float>(scaled - floored);
+	}
+}
+
+} //namespace
+
+void GradientNoise::octave2d(const double *x, const double *z, const double frequency, const uint32_t seed, const float amplitude, float *out, const size_t count) {
+	uint32_t cell_x[kBlockSize], cell_z[kBlockSize];
+	float fraction_x[kBlockSize], fraction_z[kBlockSize];
+	for (size_t begin = 0; begin < count; begin += kBlockSize) {
+		const size_t size = std::min(kBlockSize, count - begin);
+		split(x + begin, frequency, cell_x, fraction_x, size);
+		split(z + begin, frequency, cell_z, fraction_z, size);
+		float *result = out + begin;
+		for (size_t i = 0; i < size; ++i) {
+			const float fx = fraction_x[i], fz = fraction_z[i];
+			const uint32_t x0 = cell_x[i] * kPrimeX, z0 = cell_z[i] * kPrimeZ;
+			const uint32_t x1 = x0 + kPrimeX, z1 = z0 + kPrimeZ;
+			const float n00 = gradient2d(seed, x0, z0, fx, fz);
+			const float n10 = gradient2d(seed, x1, z0, fx - 1, fz);
+			const float n01 = gradient2d(seed, x0, z1, fx, fz - 1);
+			const float n11 = gradient2d(seed, x1, z1, fx - 1, fz - 1);
+			const float u = fade(fx), v = fade(fz);
+			result[i] += amplitude * lerp(lerp(n00, n10, u), lerp(n01, n11, u), v);
+		}
+	}
+}
+
+void GradientNoise::octave3d(const double *x, const double *y, const double *z, const double frequency, const uint32_t seed, const float amplitude, float *out, const size_t count) {
+	uint32_t cell_x[kBlockSize], cell_y[kBlockSize], cell_z[kBlockSize];
+	float fraction_x[kBlockSize], fraction_y[kBlockSize], fraction_z[kBlockSize];
+	for (size_t begin = 0; begin < count; begin += kBlockSize) {
+		const size_t size = std::min(kBlockSize, count - begin);
+		split(x + begin, frequency, cell_x, fraction_x, size);
+		split(y + begin, frequency, cell_y, fraction_y, size);
+		split(z + begin, frequency, cell_z, fraction_z, size);
+		float *result = out + begin;
+		for (size_t i = 0; i < size; ++i) {
+			const float fx = fraction_x[i], fy = fraction_y[i], fz = fraction_z[i];
+			const uint32_t x0 = cell_x[i] * kPrimeX, y0 = cell_y[i] * kPrimeY, z0 = cell_z[i] * kPrimeZ;
+			const uint32_t x1 = x0 + kPrimeX, y1 = y0 + kPrimeY, z1 = z0 + kPrimeZ;
+			const float n000 = gradient3d(seed, x0, y0, z0, fx, fy, fz);
+			const float n100 = gradient3d(seed, x1, y0, z0, fx - 1, fy, fz);
+			const float n010 = gradient3d(seed, x0, y1, z0, fx, fy - 1, fz);
+			const float n110 = gradient3d(seed, x1, y1, z0, fx - 1, fy - 1, fz);
+			const float n001 = gradient3d(seed, x0, y0, z1, fx, fy, fz - 1);
+			const float n101 = gradient3d(seed, x1, y0, z1, fx - 1, fy, fz - 1);
+			const float n011 = gradient3d(seed, x0, y1, z1, fx, fy - 1, fz - 1);
+			const float n111 = gradient3d(seed, x1, y1, z1, fx - 1, fy - 1, fz - 1);
+			const float u = fade(fx), v = fade(fy), w = fade(fz);
+			const float near = lerp(lerp(n000, n100, u), lerp(n010, n110, u), v);
+			const float far = lerp(lerp(n001, n101, u), lerp(n011, n111, u), v);
+			result[i] += amplitude * lerp(near, far, w);
+		}
+	}
+}
+
+void GradientNoise::sample2d(const double *x, const double *z, float *out, const size_t count) const {
+	std::fill(out, out + count, 0.0f);
+	double frequency = parameters_.frequency;
+	float amplitude = 1, total = 0;
+	for (int octave = 0; octave < std::max(parameters_.octaves, 1); ++octave) {
+		// 每个倍频使用不同的种子，避免原点附近的格点对齐
+		octave2d(x, z, frequency, seed_ + octave, amplitude, out, count);
+		total += amplitude;
+		frequency *= parameters_.lacunarity;
+		amplitude *= parameters_.gain;
+	}
+	const float scale = kScale2d / total;
+	for (size_t i = 0; i < count; ++i) {
+		out[i] *= scale;
+	}
+}
+
+void GradientNoise::sample3d(const double *x, const double *y, const double *z, float *out, const size_t count) const {
+	std::fill(out, out + count, 0.0f);
+	double frequency = parameters_.frequency;
+	float amplitude = 1, total = 0;
+	for (int octave = 0; octave < std::max(parameters_.octaves, 1); ++octave) {
+		octave3d(x, y, z, frequency, seed_ + octave, amplitude, out, count);
+		total += amplitude;
+		frequency *= parameters_.lacunarity;
+		amplitude *= parameters_.gain;
+	}
+	const float scale = kScale3d / total;
+	for (size_t i = 0; i < count; ++i) {
+		out[i] *= scale;
+	}
+}
+
+void GradientNoise::fillGrid2d(const double origin_x, const double origin_z, const double step, const size_t size_x, const size_t size_z, float *out) const {
+	// 逐行采样，行内 z 相同
+	std::vector<double> xs(size_x), zs(size_x);
+	for (size_t x = 0; x < size_x; ++x) {
+		xs[x] = origin_x + x * step;
+	}
+	for (size_t z = 0; z < size_z; ++z) {
+		std::fill(zs.begin(), zs.end(), origin_z + z * step);
+		sample2d(xs.data(), zs.data(), out + z * size_x, size_x);
+	}
+}
+
+void GradientNoise::fillGrid3d(const double origin_x, const double origin_y, const double origin_z, const double step,
+		const size_t size_x, const size_t size_y, const size_t size_z, float *out) const {
+	// 逐个竖列采样，与区块中数据的顺序一致
+	std::vector<double> xs(size_y), ys(size_y), zs(size_y);
+	for (size_t y = 0; y < size_y; ++y) {
+		ys[y] = origin_y + y * step;
+	}
+	for (size_t z = 0; z < size_z; ++z) {
+		std::fill(zs.begin(), zs.end(), origin_z + z * step);
+		for (size_t x = 0; x < size_x; ++x) {
+			std::fill(xs.begin(), xs.end(), origin_x + x * step);
+			sample3d(xs.data(), ys.data(), zs.data(), out + (z * size_x + x) * size_y, size_y);
+		}
+	}
+}
+
+void GradientNoise::fillUpsampled3d(const double origin_x, const double origin_y, const double origin_z, const size_t stride,
+		const size_t size_x, const size_t size_y, const size_t size_z, float *out) const {
+	if (stride == 1) {
+		fillGrid3d(origin_x, origin_y, origin_z, 1, size_x, size_y, size_z, out);
+		return;
+	}
+	// 粗网格包含两端，以便插值到最后一格
+	const size_t coarse_x = size_x / stride + 1, coarse_y = size_y / stride + 1, coarse_z = size_z / stride + 1;
+	thread_local std::vector<float> coarse;
+	coarse.resize(coarse_x * coarse_y * coarse_z);
+	fillGrid3d(origin_x, origin_y, origin_z, stride, coarse_x, coarse_y, coarse_z, coarse.data());
+	upsample3d(coarse.data(), stride, size_x, size_y, size_z, out);
+}
+
+void GradientNoise::upsample3d(const float *coarse, const size_t stride, const size_t size_x, const size_t size_y, const size_t size_z, float *out) {
+	const size_t coarse_x = size_x / stride + 1, coarse_y = size_y / stride + 1;
+	const auto column = [&](const size_t x, const size_t z) { return coarse + (z * coarse_x + x) * coarse_y; };
+	// 先在水平方向上插值出一个粗竖列，再沿竖直方向插值
+	std::vector<float> mixed(coarse_y);
+	for (size_t z = 0; z < size_z; ++z) {
+		const size_t cz = z / stride;
+		const float tz = static_cast<float>(z % stride) / stride;
+		for (size_t x = 0; x < size_x; ++x) {
+			const size_t cx = x / stride;
+			const float tx = static_cast<float>(x % stride) / stride;
+			const float *c00 = column(cx, cz), *c10 = column(cx + 1, cz), *c01 = column(cx, cz + 1), *c11 = column(cx + 1, cz + 1);
+			for (size_t cy = 0; cy < coarse_y; ++cy) {
+				mixed[cy] = lerp(lerp(c00[cy], c10[cy], tx), lerp(c01[cy], c11[cy], tx), tz);
+			}
+			float *result = out + (z * size_x + x) * size_y;
+			for (size_t y = 0; y < size_y; ++y) {
+				const size_t cy = y / stride;
+				result[y] = lerp(mixed[cy], mixed[cy + 1], static_cast<float>(y % stride) / stride);
+			}
+		}
+	}
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "chunk.h"
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace pgvoxel {
+
+// 生成器写到所在区块之外的修改，按目标区块暂存
+// 生成器先在自己的 VoxelGenerationChunk 中收集，保存时一次性提交，生成过程中不需要加锁，也不会与目标区块的生成竞争
+// 目标区块所在图块在本层的结果完成后，由 VoxelGeneratorLayer 取出并统一应用
+class DeferredEditQueue {
+public:
+	// 目标区块中的一段竖列，坐标为目标区块内的局部坐标
+	struct Edit {
+		uint16_t x;
+		uint16_t z;
+		uint16_t buttom;
+		uint16_t top;
+		VoxelData data;
+		uint8_t layer;
+		// 发出修改的区块的 ChunkKey 和它发出的第几个修改，用于确定重叠修改的先后
+		uint64_t source;
+		uint32_t sequence;
+	};
+
+	void push(const uint64_t target, const std::vector<Edit> &edits);
+	// 取出 target 的所有修改，按层、竖列、来源的顺序排列，同一位置后应用的修改生效
+	std::vector<Edit> take(const uint64_t target);
+	void clear();
+
+private:
+	static const size_t kShardCount = 16;
+
+	struct Shard {
+		std::mutex mtx;
+		std::unordered_map<uint64_t, std::vector<Edit>> edits;
+	};
+
+	Shard &shardOf(const uint64_t key) { return shards_[(key * 0x9E3779B97F4A7C15ULL >> 32) % kShardCount]; }
+
+	std::array<Shard, kShardCount> shards_;
+};
+
+} //namespace pgvoxel
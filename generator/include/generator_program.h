@@ -0,0 +1,89 @@
+#pragma once
+
+#include "chunk.h"
+#include "gradient_noise.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace pgvoxel {
+
+class VoxelGenerationChunk;
+
+// 由 VoxelGeneratorGraph 编译得到的生成程序：一组按顺序执行的指令，指令的操作数是寄存器
+// 每个寄存器保存一个竖列中所有格子的值，每条指令一次处理一整列，内层循环便于编译器向量化（编译选项见 SCsub）
+// 程序编译后只读，可以被多个线程同时执行
+class GeneratorProgram {
+public:
+	enum class Op : uint8_t {
+		kConstant,
+		kX,
+		kY,
+		kZ,
+		kNoise2d,
+		kNoise3d,
+		kAdd,
+		kSub,
+		kMul,
+		kMin,
+		kMax,
+		kClamp,
+		kSelect,
+		kSetBlock
+	};
+
+	// 一个噪声场，执行时每个区块采样一次
+	struct Field {
+		GradientNoise noise;
+		bool three_dimensional;
+		// 三维噪声每隔 stride 格采样，其余的格子插值得到
+		uint32_t stride;
+	};
+
+	// 图中的节点，inputs 只能引用之前的节点，因此节点的顺序就是拓扑序
+	struct Node {
+		Op op;
+		std::vector<int> inputs;
+		// kConstant 的值，kClamp 的下界和上界
+		float a = 0, b = 0;
+		// kNoise2d, kNoise3d 使用的噪声场
+		uint32_t field = 0;
+		// kSetBlock 在输入大于 0 处写入 block
+		VoxelData block = 0;
+		uint8_t layer = 0;
+	};
+
+	// 各操作需要的输入数
+	static int inputCount(const Op op);
+
+	// 编译 nodes。只保留会影响 kSetBlock 的节点，折叠输入都是常量的运算，按活跃区间分配寄存器
+	// 图不合法时返回 nullptr
+	static std::shared_ptr<const GeneratorProgram> compile(const std::vector<Node> &nodes, std::vector<Field> fields);
+
+	void execute(VoxelGenerationChunk &chunk) const;
+
+	size_t instructionCount() const { return instructions_.size(); }
+	size_t registerCount() const { return register_count_; }
+
+private:
+	struct Instruction {
+		Op op;
+		uint8_t dst;
+		std::array<uint8_t, 3> src;
+		float a, b;
+		uint32_t field;
+		VoxelData block;
+		uint8_t layer;
+	};
+
+	// 寄存器数受 Instruction 中的编号宽度限制
+	static const size_t kMaxRegisters = 256;
+
+	std::vector<Instruction> instructions_;
+	std::vector<Field> fields_;
+	size_t register_count_ = 0;
+};
+
+} //namespace pgvoxel
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace pgvoxel {
+
+// 基于哈希的梯度噪声（Perlin），不依赖置换表，由种子决定，可以叠加多个倍频
+// 接口都是批量的：一次对一组点采样，内层循环是没有分支的直线代码，便于编译器向量化
+// GCC 在默认的 -O2 下不会向量化这些循环，SCsub 为实现文件单独开启了 -fvect-cost-model=dynamic
+// 坐标以 double 传入，世界坐标很大时仍能保持小数部分的精度。结果大致在 [-1, 1] 之间
+class GradientNoise {
+public:
+	struct Parameters {
+		float frequency = 0.01;
+		int octaves = 1;
+		// 每个倍频的频率和振幅相对于上一个倍频的倍数
+		float lacunarity = 2;
+		float gain = 0.5;
+	};
+
+	GradientNoise(const uint32_t seed, const Parameters &parameters) :
+			seed_(seed), parameters_(parameters) {}
+
+	// 对 count 个点 (x[i], z[i]) 采样，结果写入 out[i]
+	void sample2d(const double *x, const double *z, float *out, const size_t count) const;
+	void sample3d(const double *x, const double *y, const double *z, float *out, const size_t count) const;
+
+	// 从 origin 开始、间隔为 step 的规则网格。二维按 zx 的顺序，三维按 zxy 的顺序，与区块中的数据一致
+	void fillGrid2d(const double origin_x, const double origin_z, const double step, const size_t size_x, const size_t size_z, float *out) const;
+	void fillGrid3d(const double origin_x, const double origin_y, const double origin_z, const double step,
+			const size_t size_x, const size_t size_y, const size_t size_z, float *out) const;
+
+	// 与 fillGrid3d 相同，但只在间隔为 stride 的粗网格上采样，其余的点三线性插值得到。size 需是 stride 的整数倍
+	void fillUpsampled3d(const double origin_x, const double origin_y, const double origin_z, const size_t stride,
+			const size_t size_x, const size_t size_y, const size_t size_z, float *out) const;
+
+	// 将间隔为 stride 的粗网格三线性插值为 size_x x size_y x size_z 的网格，均按 zxy 的顺序
+	// 粗网格每个方向上有 size / stride + 1 个点，包含两端
+	static void upsample3d(const float *coarse, const size_t stride, const size_t size_x, const size_t size_y, const size_t size_z, float *out);
+
+private:
+	// 对 out 累加一个倍频的结果
+	static void octave2d(const double *x, const double *z, const double frequency, const uint32_t seed, const float amplitude, float *out, const size_t count);
+	static void octave3d(const double *x, const double *y, const double *z, const double frequency, const uint32_t seed, const float amplitude, float *out, const size_t count);
+
+	uint32_t seed_;
+	Parameters parameters_;
+};
+
+} //namespace pgvoxel
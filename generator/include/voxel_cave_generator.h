@@ -0,0 +1,43 @@
+#pragma once
+
+#include "voxel_local_generator.h"
+
+#include "modules/noise/noise.h"
+
+#include <cstdint>
+
+namespace pgvoxel {
+
+// 在 [min_height, max_height) 范围内，将三维噪声绝对值小于 threshold 处的方块挖空为 fill
+// 噪声的零值面连成弯曲的管道，threshold 越大洞穴越宽
+class VoxelCaveGenerator : public VoxelLocalGenerator {
+	GDCLASS(VoxelCaveGenerator, VoxelLocalGenerator)
+public:
+	void generate(Ref<VoxelGenerationChunk> chunk) override;
+
+	Ref<Noise> getNoise() const { return noise_; }
+	void setNoise(const Ref<Noise> &noise) { noise_ = noise; }
+	float getThreshold() const { return threshold_; }
+	void setThreshold(const float threshold) { threshold_ = threshold; }
+	int getMinHeight() const { return min_height_; }
+	void setMinHeight(const int min_height) { min_height_ = min_height; }
+	int getMaxHeight() const { return max_height_; }
+	void setMaxHeight(const int max_height) { max_height_ = max_height; }
+
+	uint32_t getFill() const { return fill_; }
+	void setFill(const uint32_t fill) { fill_ = fill; }
+	int getLayer() const { return layer_; }
+	void setLayer(const int layer) { layer_ = layer; }
+
+private:
+	static void _bind_methods();
+
+	Ref<Noise> noise_;
+	float threshold_ = 0.1;
+	int min_height_ = 1;
+	int max_height_ = 128;
+	uint32_t fill_ = 0;
+	int layer_ = 0;
+};
+
+} //namespace pgvoxel
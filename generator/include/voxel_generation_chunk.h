@@ -1,9 +1,13 @@
 #pragma once
 
 #include "core/object/ref_counted.h"
+#include "deferred_edit_queue.h"
 #include "world_db.h"
 #include "chunk.inl"
+#include <cstdint>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace pgvoxel{
 
@@ -13,31 +17,57 @@ class VoxelGenerationChunk : public RefCounted {
 	GDCLASS(VoxelGenerationChunk, RefCounted)
 public:
 	VoxelGenerationChunk() = default;
-	VoxelGenerationChunk(int32_t x, int32_t z, VoxelGeneratorLayer *layer);
+	// 创建后需要先 moveTo 到某个区块才能使用
+	explicit VoxelGenerationChunk(VoxelGeneratorLayer *layer);
 
+	// 转到 (x, z) 处的区块，第一层从空区块开始，其余层读取上一层的结果
+	// 分块生成时同一个对象依次用于图块中的各个区块，复用已分配的内存。调用前需要先 save
+	// 读取上一层的结果失败时返回 false，此时不能在空区块上继续生成
+	bool moveTo(int32_t x, int32_t z);
+
+	// 写入操作超出区块水平范围的部分不会直接写入相邻区块，而是暂存为相邻区块的修改，在 save 时提交到所在层的 DeferredEditQueue
+	// 与读取一样不能超过所在层的 neighbour_radius，超出世界的部分被忽略
 	// 设置一个点的值
 	void setVoxel(const Vector3i pos, const VoxelData data, int layer);
-	// 获取一个点的值
+	// 获取一个点的值。pos 超出区块水平范围时读取相邻区块在上一层的生成结果，不能超过所在层的 neighbour_radius
 	VoxelData getVoxel(const Vector3i pos, int layer) const;
 	// 设置位于(x, z)处，从buttom到top间的长条的值，在修改大量值时效率高于逐个调用setVoxel
 	void setBar(const int32_t x, const int32_t z, const int32_t buttom, const int32_t top, const VoxelData data, int layer);
 	// 设置begin到end两点围成的区域中的值，效果等同于遍历水平面，逐个调用setBar
 	void setBlock(const Vector3i begin, const Vector3i end, const VoxelData data, int layer);
 
+	// 以下两个函数供原生生成器整列读写，不导出到脚本，只能访问本区块内的竖列
+	// 读取竖列 (x, z) 中 [buttom, top) 的值
+	std::vector<VoxelData> readBar(const int32_t x, const int32_t z, const int32_t buttom, const int32_t top, int layer) const;
+	// 将 data 写入竖列 (x, z) 中从 buttom 开始的一段
+	void writeBar(const int32_t x, const int32_t z, const int32_t buttom, const std::vector<VoxelData> &data, int layer);
+
 	// 区块的坐标是只读的
 	int32_t getX() const;
 	int32_t getZ() const;
 
-	void save() {
-		WorldDB::singleton().saveGenerationChunk(data_.get());
-	}
+	// 以所在层的层号为版本保存，并提交暂存的相邻区块的修改
+	// 保存失败，或生成期间读取相邻区块失败时返回 false，此时区块的结果不完整
+	bool save();
 
 private:
 	static void _bind_methods();
 
+	// 局部坐标 (x, z) 所在区块相对于本区块的偏移。超出 neighbour_radius 或世界范围时返回 false
+	bool neighbourOffset(const int32_t x, const int32_t z, int32_t &offset_x, int32_t &offset_z) const;
+	// 将竖列 (x, z) 中 [buttom, top) 的修改暂存为相邻区块的修改
+	void deferBar(const int32_t x, const int32_t z, int32_t buttom, int32_t top, const VoxelData data, const int layer);
+
 	bool initialized_{ false };
 	VoxelGeneratorLayer *layer_{ nullptr };
 	std::unique_ptr<GenerationChunk> data_;
+	// 本区块读取过的相邻区块，避免每次访问都查询所在层的缓存。moveTo 时清空
+	mutable std::unordered_map<uint64_t, std::shared_ptr<const GenerationChunk>> neighbours_;
+	// 读取相邻区块失败过，getVoxel 无法报告错误，在 save 时报告。moveTo 时清除
+	mutable bool neighbour_failed_{ false };
+	// 以目标区块的 ChunkKey 为 key 暂存的修改，以及本区块发出的修改数
+	std::unordered_map<uint64_t, std::vector<DeferredEditQueue::Edit>> deferred_;
+	uint32_t edit_sequence_{ 0 };
 };
 
 } //namespace pgvoxel::generator
@@ -18,6 +18,7 @@ class VoxelGenerator : public Node {
 public:
 	void start();
 
+	// 每个任务生成 batch_size x batch_size 个区块组成的图块，图块沿 Hilbert 曲线的顺序提交
 	size_t getBatchSize() const { return batch_size_; }
 	void setBatchSize(size_t batch_size) { batch_size_ = batch_size; }
 
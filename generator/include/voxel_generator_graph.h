@@ -0,0 +1,43 @@
+#pragma once
+
+#include "generator_program.h"
+
+#include "core/io/resource.h"
+#include "core/variant/array.h"
+#include "core/variant/dictionary.h"
+#include "core/variant/variant.h"
+
+#include <memory>
+
+namespace pgvoxel {
+
+// 以数据描述的生成器：由噪声、运算、钳制、按高度选择和写入方块等节点组成的图
+// 每个节点是一个 Dictionary，{ "op": 操作名, "inputs": 输入节点的序号, 其余为参数 }，输入只能是之前的节点
+// 支持的操作及参数：
+//   constant { value }、x、y、z：常量与格子的世界坐标
+//   noise_2d { noise }、noise_3d { noise, stride }：VoxelNoise 的采样，三维噪声每隔 stride 格采样后插值
+//   add、sub、mul、min、max：两个输入的逐格运算
+//   clamp { min, max }：钳制一个输入
+//   select：第一个输入大于 0 处取第二个输入，否则取第三个
+//   set_block { block, layer }：在输入大于 0 处写入方块
+// VoxelGeneratorLayer 在每次生成开始时将图编译为 GeneratorProgram，之后在原生代码中逐区块执行
+class VoxelGeneratorGraph : public Resource {
+	GDCLASS(VoxelGeneratorGraph, Resource)
+public:
+	// 添加一个节点，返回它的序号
+	int addNode(const String &op, const PackedInt32Array &inputs, const Dictionary &parameters);
+	void clear();
+
+	Array getNodes() const { return nodes_; }
+	void setNodes(const Array &nodes) { nodes_ = nodes; }
+
+	// 编译当前的图，噪声的种子取自已加载的世界配置。图不合法时返回 nullptr
+	std::shared_ptr<const GeneratorProgram> compile() const;
+
+private:
+	static void _bind_methods();
+
+	Array nodes_;
+};
+
+} //namespace pgvoxel
@@ -1,29 +1,79 @@
 #pragma once
 
+#include "chunk_key.h"
+#include "deferred_edit_queue.h"
+#include "generator_program.h"
+#include "lru_cache.h"
+#include "voxel_generator_graph.h"
 #include "voxel_generation_chunk.h"
 
 #include "scene/main/node.h"
 
+#include <cstdint>
 #include <memory>
-#include <unordered_map>
+#include <mutex>
 #include <vector>
 
 namespace pgvoxel{
 
+class VoxelLocalGenerator;
+
 class VoxelGeneratorLayer : public Node {
 	GDCLASS(VoxelGeneratorLayer, Node)
 public:
 	size_t getIndex() const { return index_; }
 	void setIndex(const size_t index) { index_ = index; }
 
+	// 该层的生成器会读取上一层中距离不超过 neighbour_radius 个区块的结果，也会向该层中同样范围内的区块写入
+	// 区块只有在上一层中这些区块都完成后才开始生成，为 0 时只依赖自身
+	int getNeighbourRadius() const { return neighbour_radius_; }
+	void setNeighbourRadius(const int neighbour_radius) { neighbour_radius_ = neighbour_radius; }
+
+	// 将上一层中 (x, z) 处区块的生成结果存入 result，只读，由该层的所有线程共享。第一层时为 nullptr
+	// 每个区块只从数据库读取一次，缓存按预算淘汰。读取失败时返回 false，失败的结果不会被缓存
+	bool getNeighbour(const CoordAxis x, const CoordAxis z, std::shared_ptr<const GenerationChunk> &result);
+	// 上一层中 (x, z) 处的区块不再被该层读取时调用，释放它在缓存中占用的预算
+	void releaseNeighbour(const CoordAxis x, const CoordAxis z) { neighbour_cache_.erase(ChunkKey::encode(x, 0, z)); }
+
+	// 该层区块写入相邻区块的修改，在相邻区块保存后提交
+	DeferredEditQueue &getDeferredEdits() { return deferred_edits_; }
+	// 将发往 (x, z) 处区块的修改按确定的顺序应用到它该层的结果上
+	// 只有在可能写入它的区块都已保存后才能调用。读取或保存失败时返回 false
+	bool applyDeferredEdits(const CoordAxis x, const CoordAxis z);
+
+	// 设置了 graph 时，generate 先执行由它编译得到的程序，再执行子节点中的 VoxelLocalGenerator
+	Ref<VoxelGeneratorGraph> getGraph() const { return graph_; }
+	void setGraph(const Ref<VoxelGeneratorGraph> &graph) { graph_ = graph; }
+
+	// 收集子节点中的 VoxelLocalGenerator 并编译 graph，每层开始生成前调用一次，generate 不再逐个区块遍历子节点
+	// graph 编译失败时返回 false，生成应当中止，否则该层会静默地跳过 graph
+	bool prepare();
+	// 生成结束后释放 prepare 中收集的数据、相邻区块的缓存和未应用的修改
+	void finish();
 	void generate(Ref<VoxelGenerationChunk> chunks);
 	PackedStringArray get_configuration_warnings() const override;
 
 private:
+	// 缓存中的槽位在加载完成前就已插入，同时请求同一区块的线程等待同一次加载
+	struct NeighbourSlot {
+		std::once_flag loaded;
+		std::shared_ptr<const GenerationChunk> chunk;
+	};
+
+	// 相邻区块缓存的预算，以及加载完成前槽位按此估算大小
+	static const size_t kNeighbourCacheSize = 536870912;
+	static const size_t kEstimatedNeighbourSize = 1048576;
+
 	static void _bind_methods();
 
 	size_t index_;
-	std::unordered_map<size_t, std::unique_ptr<GenerationChunk>> cache;
+	int neighbour_radius_ = 0;
+	std::vector<VoxelLocalGenerator *> generators_;
+	Ref<VoxelGeneratorGraph> graph_;
+	std::shared_ptr<const GeneratorProgram> program_;
+	// 以 ChunkKey 的值为 key
+	ShardedLruCache<uint64_t, std::shared_ptr<NeighbourSlot>> neighbour_cache_{ kNeighbourCacheSize };
+	DeferredEditQueue deferred_edits_;
 };
 
 } //namespace pgvoxel::generator
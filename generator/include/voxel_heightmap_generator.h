@@ -0,0 +1,46 @@
+#pragma once
+
+#include "voxel_local_generator.h"
+
+#include "modules/noise/noise.h"
+
+#include <cstdint>
+
+namespace pgvoxel {
+
+// 按二维噪声生成地表高度，在高度以下填充方块，最上面 surface_depth 格使用 surface_block
+// 高度为 base_height + noise(x, z) * height_range，超出区块高度的部分被截断
+class VoxelHeightmapGenerator : public VoxelLocalGenerator {
+	GDCLASS(VoxelHeightmapGenerator, VoxelLocalGenerator)
+public:
+	void generate(Ref<VoxelGenerationChunk> chunk) override;
+
+	Ref<Noise> getNoise() const { return noise_; }
+	void setNoise(const Ref<Noise> &noise) { noise_ = noise; }
+	int getBaseHeight() const { return base_height_; }
+	void setBaseHeight(const int base_height) { base_height_ = base_height; }
+	float getHeightRange() const { return height_range_; }
+	void setHeightRange(const float height_range) { height_range_ = height_range; }
+
+	uint32_t getBlock() const { return block_; }
+	void setBlock(const uint32_t block) { block_ = block; }
+	uint32_t getSurfaceBlock() const { return surface_block_; }
+	void setSurfaceBlock(const uint32_t surface_block) { surface_block_ = surface_block; }
+	int getSurfaceDepth() const { return surface_depth_; }
+	void setSurfaceDepth(const int surface_depth) { surface_depth_ = surface_depth; }
+	int getLayer() const { return layer_; }
+	void setLayer(const int layer) { layer_ = layer; }
+
+private:
+	static void _bind_methods();
+
+	Ref<Noise> noise_;
+	int base_height_ = 64;
+	float height_range_ = 32;
+	uint32_t block_ = 1;
+	uint32_t surface_block_ = 1;
+	int surface_depth_ = 1;
+	int layer_ = 0;
+};
+
+} //namespace pgvoxel
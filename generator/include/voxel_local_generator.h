@@ -9,6 +9,9 @@ namespace pgvoxel{
 class VoxelLocalGenerator : public Node {
 	GDCLASS(VoxelLocalGenerator, Node);
 public:
+	// 生成 chunk 的内容。原生的生成器重写该函数，在 C++ 中直接读写区块，默认调用脚本中的 _generate
+	virtual void generate(Ref<VoxelGenerationChunk> chunk);
+
 	GDVIRTUAL1(_generate, Ref<VoxelGenerationChunk>);
 private:
 	static void _bind_methods();
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "gradient_noise.h"
+
+#include "core/io/resource.h"
+#include "core/variant/variant.h"
+
+#include <cstdint>
+
+namespace pgvoxel {
+
+// 供生成器使用的批量噪声，一次调用填满整个区块的网格，代替逐列调用 FastNoiseLite
+// 种子由世界配置中的 seed 加上 seed_offset 得到，同一世界中不同用途的噪声用 seed_offset 区分
+class VoxelNoise : public Resource {
+	GDCLASS(VoxelNoise, Resource)
+public:
+	// (chunk_x, chunk_z) 处区块的 32 x 32 个竖列，按 zx 的顺序
+	PackedFloat32Array fill2d(const int64_t chunk_x, const int64_t chunk_z) const;
+	// (chunk_x, chunk_z) 处区块中每隔 stride 格的采样，按 zxy 的顺序，stride 需整除区块的宽度
+	// upsample 为 true 时只在粗网格上采样，再三线性插值为 32 x 512 x 32 个格子；否则返回粗网格本身
+	PackedFloat32Array fill3d(const int64_t chunk_x, const int64_t chunk_z, const int stride = 1, const bool upsample = true) const;
+
+	// 原生代码直接使用的噪声，种子已包含世界配置的 seed
+	GradientNoise noise() const;
+
+	int getSeedOffset() const { return seed_offset_; }
+	void setSeedOffset(const int seed_offset) { seed_offset_ = seed_offset; }
+	float getFrequency() const { return parameters_.frequency; }
+	void setFrequency(const float frequency) { parameters_.frequency = frequency; }
+	int getOctaves() const { return parameters_.octaves; }
+	void setOctaves(const int octaves) { parameters_.octaves = octaves; }
+	float getLacunarity() const { return parameters_.lacunarity; }
+	void setLacunarity(const float lacunarity) { parameters_.lacunarity = lacunarity; }
+	float getGain() const { return parameters_.gain; }
+	void setGain(const float gain) { parameters_.gain = gain; }
+
+private:
+	static void _bind_methods();
+
+	int seed_offset_ = 0;
+	GradientNoise::Parameters parameters_;
+};
+
+} //namespace pgvoxel
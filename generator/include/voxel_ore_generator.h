@@ -0,0 +1,46 @@
+#pragma once
+
+#include "voxel_local_generator.h"
+
+#include "modules/noise/noise.h"
+
+#include <cstdint>
+
+namespace pgvoxel {
+
+// 在 [min_height, max_height) 范围内，将三维噪声大于 threshold 处的 replace 方块替换为矿石
+// 矿脉的形状和疏密由 noise 的频率和 threshold 决定
+class VoxelOreGenerator : public VoxelLocalGenerator {
+	GDCLASS(VoxelOreGenerator, VoxelLocalGenerator)
+public:
+	void generate(Ref<VoxelGenerationChunk> chunk) override;
+
+	Ref<Noise> getNoise() const { return noise_; }
+	void setNoise(const Ref<Noise> &noise) { noise_ = noise; }
+	float getThreshold() const { return threshold_; }
+	void setThreshold(const float threshold) { threshold_ = threshold; }
+	int getMinHeight() const { return min_height_; }
+	void setMinHeight(const int min_height) { min_height_ = min_height; }
+	int getMaxHeight() const { return max_height_; }
+	void setMaxHeight(const int max_height) { max_height_ = max_height; }
+
+	uint32_t getBlock() const { return block_; }
+	void setBlock(const uint32_t block) { block_ = block; }
+	uint32_t getReplace() const { return replace_; }
+	void setReplace(const uint32_t replace) { replace_ = replace; }
+	int getLayer() const { return layer_; }
+	void setLayer(const int layer) { layer_ = layer; }
+
+private:
+	static void _bind_methods();
+
+	Ref<Noise> noise_;
+	float threshold_ = 0.6;
+	int min_height_ = 0;
+	int max_height_ = 64;
+	uint32_t block_ = 1;
+	uint32_t replace_ = 1;
+	int layer_ = 0;
+};
+
+} //namespace pgvoxel
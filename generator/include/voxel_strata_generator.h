@@ -0,0 +1,44 @@
+#pragma once
+
+#include "voxel_local_generator.h"
+
+#include "core/variant/variant.h"
+#include "modules/noise/noise.h"
+
+#include <cstdint>
+
+namespace pgvoxel {
+
+// 将区块中的 replace 方块替换为水平的岩层，自下而上每 thickness 格换一种，依次循环使用 blocks 中的方块
+// 设置了 noise 时岩层的高度按 noise(x, z) * warp 起伏
+class VoxelStrataGenerator : public VoxelLocalGenerator {
+	GDCLASS(VoxelStrataGenerator, VoxelLocalGenerator)
+public:
+	void generate(Ref<VoxelGenerationChunk> chunk) override;
+
+	PackedInt32Array getBlocks() const { return blocks_; }
+	void setBlocks(const PackedInt32Array &blocks) { blocks_ = blocks; }
+	int getThickness() const { return thickness_; }
+	void setThickness(const int thickness) { thickness_ = thickness; }
+	uint32_t getReplace() const { return replace_; }
+	void setReplace(const uint32_t replace) { replace_ = replace; }
+
+	Ref<Noise> getNoise() const { return noise_; }
+	void setNoise(const Ref<Noise> &noise) { noise_ = noise; }
+	float getWarp() const { return warp_; }
+	void setWarp(const float warp) { warp_ = warp; }
+	int getLayer() const { return layer_; }
+	void setLayer(const int layer) { layer_ = layer; }
+
+private:
+	static void _bind_methods();
+
+	PackedInt32Array blocks_;
+	int thickness_ = 8;
+	uint32_t replace_ = 1;
+	Ref<Noise> noise_;
+	float warp_ = 8;
+	int layer_ = 0;
+};
+
+} //namespace pgvoxel
@@ -0,0 +1,65 @@
+#include "voxel_cave_generator.h"
+
+#include "chunk.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace pgvoxel {
+
+void VoxelCaveGenerator::generate(Ref<VoxelGenerationChunk> chunk) {
+	ERR_FAIL_INDEX(layer_, GenerationChunk::kDataChunkNums);
+	ERR_FAIL_COND_MSG(noise_.is_null(), "VoxelCaveGenerator has no noise.");
+	constexpr int32_t kWidth = kGeneratingChunkWidth, kHeight = kGeneratingChunkHeight;
+	const int32_t buttom = std::clamp<int32_t>(min_height_, 0, kHeight), top = std::clamp<int32_t>(max_height_, buttom, kHeight);
+	if (buttom == top) {
+		return;
+	}
+	const int64_t origin_x = static_cast<int64_t>(chunk->getX()) * kWidth, origin_z = static_cast<int64_t>(chunk->getZ()) * kWidth;
+	for (int32_t x = 0; x < kWidth; ++x) {
+		for (int32_t z = 0; z < kWidth; ++z) {
+			auto bar = chunk->readBar(x, z, buttom, top, layer_);
+			bool changed = false;
+			for (int32_t y = buttom; y < top; ++y) {
+				// 已经是 fill 的格子，如地表以上的空气，不必计算噪声
+				auto &voxel = bar[y - buttom];
+				if (voxel != fill_ && std::abs(noise_->get_noise_3d(origin_x + x, y, origin_z + z)) < threshold_) {
+					voxel = fill_;
+					changed = true;
+				}
+			}
+			if (changed) {
+				chunk->writeBar(x, z, buttom, bar, layer_);
+			}
+		}
+	}
+}
+
+void VoxelCaveGenerator::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("setNoise", "noise"), &VoxelCaveGenerator::setNoise);
+	ClassDB::bind_method(D_METHOD("getNoise"), &VoxelCaveGenerator::getNoise);
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "noise", PROPERTY_HINT_RESOURCE_TYPE, "Noise"), "setNoise", "getNoise");
+
+	ClassDB::bind_method(D_METHOD("setThreshold", "threshold"), &VoxelCaveGenerator::setThreshold);
+	ClassDB::bind_method(D_METHOD("getThreshold"), &VoxelCaveGenerator::getThreshold);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "threshold", PROPERTY_HINT_RANGE, "0,1,0.01"), "setThreshold", "getThreshold");
+
+	ClassDB::bind_method(D_METHOD("setMinHeight", "min_height"), &VoxelCaveGenerator::setMinHeight);
+	ClassDB::bind_method(D_METHOD("getMinHeight"), &VoxelCaveGenerator::getMinHeight);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "min_height"), "setMinHeight", "getMinHeight");
+
+	ClassDB::bind_method(D_METHOD("setMaxHeight", "max_height"), &VoxelCaveGenerator::setMaxHeight);
+	ClassDB::bind_method(D_METHOD("getMaxHeight"), &VoxelCaveGenerator::getMaxHeight);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "max_height"), "setMaxHeight", "getMaxHeight");
+
+	ClassDB::bind_method(D_METHOD("setFill", "fill"), &VoxelCaveGenerator::setFill);
+	ClassDB::bind_method(D_METHOD("getFill"), &VoxelCaveGenerator::getFill);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "fill"), "setFill", "getFill");
+
+	ClassDB::bind_method(D_METHOD("setLayer", "layer"), &VoxelCaveGenerator::setLayer);
+	ClassDB::bind_method(D_METHOD("getLayer"), &VoxelCaveGenerator::getLayer);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "layer", PROPERTY_HINT_RANGE, "0,7"), "setLayer", "getLayer");
+}
+
+} //namespace pgvoxel
@@ -3,6 +3,7 @@
 #include "core/string/print_string.h"
 #include "core/string/ustring.h"
 #include "core/variant/variant.h"
+#include "chunk_key.h"
 #include "forward.h"
 #include "voxel_generator_layer.h"
 #include "world_config.h"
@@ -11,23 +12,80 @@
 #include "core/object/object.h"
 
 #include <glm/fwd.hpp>
+#include <algorithm>
+#include <cstdlib>
 #include <memory>
 
 namespace pgvoxel {
 
-VoxelGenerationChunk::VoxelGenerationChunk(int32_t x, int32_t z, VoxelGeneratorLayer *layer) :
+VoxelGenerationChunk::VoxelGenerationChunk(VoxelGeneratorLayer *layer) :
 		layer_(layer) {
-	if (layer->getIndex() == 0) {
-		// 第一层创建空区块作为数据
-		data_ = GenerationChunk::create({ x, 0, z });
+	initialized_ = true;
+}
+
+bool VoxelGenerationChunk::moveTo(int32_t x, int32_t z) {
+	neighbours_.clear();
+	neighbour_failed_ = false;
+	deferred_.clear();
+	edit_sequence_ = 0;
+	// 第一层以空区块作为数据
+	if (data_) {
+		data_->reset({ x, 0, z });
 	} else {
-		// 否则从generation db中读取之前缓存的生成结果作为数据
-		data_ = WorldDB::singleton().loadGenerationChunk(x, z);
+		data_ = GenerationChunk::create({ x, 0, z });
 	}
-	initialized_ = true;
+	if (layer_->getIndex() != 0) {
+		// 否则从generation db中读取上一层的生成结果作为数据
+		return WorldDB::singleton().loadGenerationChunk(*data_, layer_->getIndex() - 1);
+	}
+	return true;
+}
+
+bool VoxelGenerationChunk::save() {
+	ERR_FAIL_COND_V_MSG(neighbour_failed_, false, "A neighbour chunk could not be read, the generated chunk is incomplete.");
+	if (!WorldDB::singleton().saveGenerationChunk(data_.get(), layer_->getIndex())) {
+		return false;
+	}
+	for (const auto &[target, edits] : deferred_) {
+		layer_->getDeferredEdits().push(target, edits);
+	}
+	deferred_.clear();
+	return true;
+}
+
+bool VoxelGenerationChunk::neighbourOffset(const int32_t x, const int32_t z, int32_t &offset_x, int32_t &offset_z) const {
+	constexpr int32_t kWidth = kGeneratingChunkWidth;
+	offset_x = x >= 0 ? x / kWidth : (x + 1) / kWidth - 1;
+	offset_z = z >= 0 ? z / kWidth : (z + 1) / kWidth - 1;
+	// 超出 neighbour_radius 的区块在上一层中不一定已经完成，写入的修改也不一定能在它被读取前应用
+	ERR_FAIL_COND_V_MSG(std::abs(offset_x) > layer_->getNeighbourRadius() || std::abs(offset_z) > layer_->getNeighbourRadius(), false, "Neighbour access exceeds the layer's neighbour_radius.");
+	const int64_t neighbour_x = static_cast<int64_t>(getX()) + offset_x, neighbour_z = static_cast<int64_t>(getZ()) + offset_z;
+	GET_WORLD_CONFIG(false, config);
+	return neighbour_x >= 0 && neighbour_z >= 0 && neighbour_x < static_cast<int64_t>(config.width) && neighbour_z < static_cast<int64_t>(config.width);
+}
+
+void VoxelGenerationChunk::deferBar(const int32_t x, const int32_t z, int32_t buttom, int32_t top, const VoxelData data, const int layer) {
+	int32_t offset_x, offset_z;
+	if (!neighbourOffset(x, z, offset_x, offset_z)) {
+		return;
+	}
+	buttom = std::max<int32_t>(buttom, 0);
+	top = std::min<int32_t>(top, kGeneratingChunkHeight);
+	if (buttom >= top) {
+		return;
+	}
+	constexpr int32_t kWidth = kGeneratingChunkWidth;
+	const uint64_t target = ChunkKey::encode(getX() + offset_x, 0, getZ() + offset_z);
+	deferred_[target].push_back({ static_cast<uint16_t>(x - offset_x * kWidth), static_cast<uint16_t>(z - offset_z * kWidth),
+			static_cast<uint16_t>(buttom), static_cast<uint16_t>(top), data, static_cast<uint8_t>(layer),
+			ChunkKey::encode(getX(), 0, getZ()), edit_sequence_++ });
 }
 
 void VoxelGenerationChunk::setVoxel(const Vector3i pos, const VoxelData data, int layer) {
+	if (pos.x < 0 || pos.z < 0 || pos.x >= static_cast<int32_t>(kGeneratingChunkWidth) || pos.z >= static_cast<int32_t>(kGeneratingChunkWidth)) {
+		deferBar(pos.x, pos.z, pos.y, pos.y + 1, data, layer);
+		return;
+	}
 	data_->setVoxel(toCoord(pos), data, layer);
 }
 
@@ -38,24 +96,61 @@ VoxelData VoxelGenerationChunk::getVoxel(const Vector3i pos, int layer) const {
 		// print_line(String("Get {0}").format(varray(pos)));
 		VoxelData result = data_->getVoxel(toCoord(pos), layer);
 		return result;
-	} else {
-		// // 当访问的格子超出了当前区块时，要找到所处的区块，返回所处区块中对应的数据
-		// GET_WORLD_CONFIG(0, config);
-		// int32_t world_x = getX() * config.width + pos.x;
-		// int32_t world_z = getZ() * config.width + pos.z;
-		// // 这里没有范围检查，需要用户自己确保传入的pos不超出世界范围
-		// return layer_->getCachedChunk(world_x / config.width, world_z / config.width)->getVoxel(Coord(world_x % config.width, pos.y, world_z % config.width));
-		print_error("VoxelGenerationChunk::getVoxel pos out of range");
+	}
+	if (pos.y < 0 || pos.y >= static_cast<int32_t>(kGeneratingChunkHeight)) {
+		return 0;
+	}
+
+	// 当访问的格子超出了当前区块时，找到所处的区块，返回其中对应的数据
+	int32_t offset_x, offset_z;
+	if (!neighbourOffset(pos.x, pos.z, offset_x, offset_z)) {
+		return 0;
+	}
+	constexpr int32_t kWidth = kGeneratingChunkWidth;
+	const CoordAxis x = getX() + offset_x, z = getZ() + offset_z;
+	const uint64_t key = ChunkKey::encode(x, 0, z);
+	auto iter = neighbours_.find(key);
+	if (iter == neighbours_.end()) {
+		// 失败时在本区块中记为空，避免每次访问都重新读取
+		iter = neighbours_.emplace(key, nullptr).first;
+		if (!layer_->getNeighbour(x, z, iter->second)) {
+			neighbour_failed_ = true;
+		}
+	}
+	if (!iter->second) {
 		return 0;
 	}
+	return iter->second->getVoxel(Coord(pos.x - offset_x * kWidth, pos.y, pos.z - offset_z * kWidth), layer);
 }
 
 void VoxelGenerationChunk::setBar(const int32_t x, const int32_t z, const int32_t buttom, const int32_t top, const VoxelData data, int layer) {
+	if (x < 0 || z < 0 || x >= static_cast<int32_t>(kGeneratingChunkWidth) || z >= static_cast<int32_t>(kGeneratingChunkWidth)) {
+		deferBar(x, z, buttom, top, data, layer);
+		return;
+	}
 	data_->setBar(x, z, buttom, top, data, layer);
 }
 
 void VoxelGenerationChunk::setBlock(const Vector3i begin, const Vector3i end, const VoxelData data, int layer) {
-	data_->setBlock(toCoord(begin), toCoord(end), data, layer);
+	constexpr int32_t kWidth = kGeneratingChunkWidth;
+	if (begin.x >= 0 && begin.z >= 0 && end.x <= kWidth && end.z <= kWidth) {
+		data_->setBlock(toCoord(begin), toCoord(end), data, layer);
+		return;
+	}
+	// 跨越区块边界时逐列写入，超出的部分暂存为相邻区块的修改
+	for (int32_t x = begin.x; x < end.x; ++x) {
+		for (int32_t z = begin.z; z < end.z; ++z) {
+			setBar(x, z, begin.y, end.y, data, layer);
+		}
+	}
+}
+
+std::vector<VoxelData> VoxelGenerationChunk::readBar(const int32_t x, const int32_t z, const int32_t buttom, const int32_t top, int layer) const {
+	return data_->getBar(x, z, buttom, top, layer);
+}
+
+void VoxelGenerationChunk::writeBar(const int32_t x, const int32_t z, const int32_t buttom, const std::vector<VoxelData> &data, int layer) {
+	data_->setBar(Coord(x, buttom, z), data, layer);
 }
 
 int32_t VoxelGenerationChunk::getX() const {
@@ -12,14 +12,39 @@
 #include "core/variant/dictionary.h"
 #include "core/variant/variant.h"
 
-#include "modules/pgvoxel/thirdparty/thread-pool/include/BS_thread_pool.hpp"
 #include "modules/pgvoxel/thirdparty/thread-pool/include/BS_thread_pool_utils.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <cstddef>
+#include <functional>
 #include <memory>
+#include <utility>
+#include <vector>
 
 namespace pgvoxel {
 
+// 将边长为 n（2 的幂）的网格中 Hilbert 曲线上的第 d 个点转换为坐标
+// 沿曲线相邻的图块在空间上也相邻，依次生成时数据库访问和相邻区块的读取都更集中
+static void hilbertToXZ(const uint64_t n, uint64_t d, uint64_t &x, uint64_t &z) {
+	x = z = 0;
+	for (uint64_t s = 1; s < n; s *= 2) {
+		const uint64_t rx = 1 & (d / 2);
+		const uint64_t rz = 1 & (d ^ rx);
+		if (rz == 0) {
+			if (rx == 1) {
+				x = s - 1 - x;
+				z = s - 1 - z;
+			}
+			std::swap(x, z);
+		}
+		x += s * rx;
+		z += s * rz;
+		d /= 4;
+	}
+}
+
 void VoxelGenerator::start() {
 	generator_thread_ = std::thread([&]() {
 		set_current_thread_safe_for_nodes(true);
@@ -27,30 +52,186 @@ void VoxelGenerator::start() {
 		tmr.start();
 
 		GET_WORLD_CONFIG(, config);
-		// 创建临时生成器数据库
-		WorldDB::singleton().beginGeneration();
 
-		TypedArray<Node> layers = get_children();
-		// 遍历每一层
-		BS::thread_pool pool;
-		for (int i = 0; i < layers.size(); i++) {
-			auto layer = Object::cast_to<VoxelGeneratorLayer>(layers[i]);
+		// 先准备各层，graph 编译失败时不会创建临时生成器数据库
+		TypedArray<Node> children = get_children();
+		std::vector<VoxelGeneratorLayer *> layers;
+		bool prepared = true;
+		for (int i = 0; i < children.size(); i++) {
+			auto layer = Object::cast_to<VoxelGeneratorLayer>(children[i]);
 			print_line(String("Layer {0}").format(varray(layer->get_name())));
 			layer->setIndex(i);
-			// 遍历所有区块
-			for (size_t x = 0; x < config.width; ++x) {
-				for (size_t z = 0; z < config.width; ++z) {
-					(void)pool.submit_task([&, x, z]() {
-						set_current_thread_safe_for_nodes(true);
-						Ref<VoxelGenerationChunk> chunk;
-						chunk.instantiate(x, z, layer);
-						layer->generate(chunk);
-						chunk->save();
-						print_verbose(String("Finished {0}, {1}").format(varray(x, z)));
+			layers.push_back(layer);
+			if (!layer->prepare()) {
+				prepared = false;
+				break;
+			}
+		}
+		if (!prepared) {
+			for (auto layer : layers) {
+				layer->finish();
+			}
+			ERR_PRINT("Generation aborted, a generator graph failed to compile.");
+			emit_signal("generation_failed");
+			return;
+		}
+
+		// 创建临时生成器数据库
+		WorldDB::singleton().beginGeneration();
+
+		// 按图块划分世界，边长向上取整到 2 的幂以便沿 Hilbert 曲线遍历，超出世界的图块直接跳过
+		const size_t batch_size = std::max<size_t>(batch_size_, 1);
+		const size_t tiles = (config.width + batch_size - 1) / batch_size;
+		const uint64_t side = std::bit_ceil<uint64_t>(std::max<size_t>(tiles, 1));
+		std::vector<std::pair<size_t, size_t>> tile_order;
+		tile_order.reserve(tiles * tiles);
+		for (uint64_t d = 0; d < side * side; ++d) {
+			uint64_t tile_x, tile_z;
+			hilbertToXZ(side, d, tile_x, tile_z);
+			if (tile_x < tiles && tile_z < tiles) {
+				tile_order.emplace_back(tile_x, tile_z);
+			}
+		}
+
+		// 各层之间不设屏障，而是按依赖关系调度：第 l 层的图块在上一层中距离不超过 radius[l] 的图块都完成后即可开始
+		// 各层因此像波前一样在世界中推进，前一层最慢的图块不会让所有线程空等
+		// radius[l] 是第 l 层 neighbour_radius 换算为图块后的距离，既是读取上一层的范围，也是写入本层相邻区块的范围
+		// 图块在本层的结果要等范围内的图块都完成、发往它的修改都应用后才算完成，下一层才能读取
+		std::vector<size_t> radius(layers.size(), 0);
+		for (size_t l = 0; l < layers.size(); ++l) {
+			radius[l] = (std::max(layers[l]->getNeighbourRadius(), 0) + batch_size - 1) / batch_size;
+		}
+		// 对距离 tile 不超过 r 的每个图块调用 func
+		const auto forEachNeighbour = [tiles](const size_t tile, const size_t r, const auto &func) {
+			const size_t tile_x = tile / tiles, tile_z = tile % tiles;
+			for (size_t x = tile_x > r ? tile_x - r : 0; x <= std::min(tile_x + r, tiles - 1); ++x) {
+				for (size_t z = tile_z > r ? tile_z - r : 0; z <= std::min(tile_z + r, tiles - 1); ++z) {
+					func(x * tiles + z);
+				}
+			}
+		};
+		// pending[l][t] 是第 l 层图块 t 尚未完成的依赖数，归零时开始生成
+		// unflushed[l][t] 是第 l 层中可能写入图块 t 且尚未生成的图块数，归零时应用发往 t 的修改
+		// users[l][t] 是第 l + 1 层中读取第 l 层图块 t 且尚未完成的图块数，归零时删除该版本
+		std::vector<std::unique_ptr<std::atomic<uint32_t>[]>> pending(layers.size()), unflushed(layers.size()), users(layers.size());
+		for (size_t l = 0; l < layers.size(); ++l) {
+			pending[l] = std::make_unique<std::atomic<uint32_t>[]>(tiles * tiles);
+			unflushed[l] = std::make_unique<std::atomic<uint32_t>[]>(tiles * tiles);
+			users[l] = std::make_unique<std::atomic<uint32_t>[]>(tiles * tiles);
+			for (size_t t = 0; t < tiles * tiles; ++t) {
+				uint32_t count = 0;
+				forEachNeighbour(t, radius[l], [&](size_t) { ++count; });
+				pending[l][t] = l == 0 ? 0 : count;
+				unflushed[l][t] = count;
+				// 依赖关系是对称的，读取 t 的图块数与 t 依赖的图块数相同
+				if (l + 1 < layers.size()) {
+					uint32_t user_count = 0;
+					forEachNeighbour(t, radius[l + 1], [&](size_t) { ++user_count; });
+					users[l][t] = user_count;
+				}
+			}
+		}
+
+		// 任何区块读取或保存失败时整个生成中止，已经提交的任务直接返回，不再释放依赖它们的任务
+		// 否则下一层会在空区块上继续生成，世界中留下空洞
+		std::atomic<bool> failed{ false };
+		// 每个任务生成一个图块，图块内的区块共用同一个 VoxelGenerationChunk
+		const auto generateTile = [&](VoxelGeneratorLayer *layer, const size_t tile) {
+			const size_t tile_x = tile / tiles, tile_z = tile % tiles;
+			Ref<VoxelGenerationChunk> chunk;
+			chunk.instantiate(layer);
+			for (size_t x = tile_x * batch_size; x < std::min<size_t>((tile_x + 1) * batch_size, config.width); ++x) {
+				for (size_t z = tile_z * batch_size; z < std::min<size_t>((tile_z + 1) * batch_size, config.width); ++z) {
+					if (!chunk->moveTo(x, z)) {
+						return false;
+					}
+					layer->generate(chunk);
+					if (!chunk->save()) {
+						return false;
+					}
+				}
+			}
+			print_verbose(String("Finished tile {0}, {1} of layer {2}").format(varray(tile_x, tile_z, layer->get_name())));
+			return true;
+		};
+		const auto flushTile = [&](VoxelGeneratorLayer *layer, const size_t tile) {
+			const size_t tile_x = tile / tiles, tile_z = tile % tiles;
+			for (size_t x = tile_x * batch_size; x < std::min<size_t>((tile_x + 1) * batch_size, config.width); ++x) {
+				for (size_t z = tile_z * batch_size; z < std::min<size_t>((tile_z + 1) * batch_size, config.width); ++z) {
+					if (!layer->applyDeferredEdits(x, z)) {
+						return false;
+					}
+				}
+			}
+			return true;
+		};
+		// 第 l + 1 层不再读取时，同时释放这些区块在它的相邻区块缓存中的预算
+		const auto dropTile = [&](const size_t l, const size_t tile) {
+			const size_t tile_x = tile / tiles, tile_z = tile % tiles;
+			for (size_t x = tile_x * batch_size; x < std::min<size_t>((tile_x + 1) * batch_size, config.width); ++x) {
+				for (size_t z = tile_z * batch_size; z < std::min<size_t>((tile_z + 1) * batch_size, config.width); ++z) {
+					WorldDB::singleton().dropGenerationChunk(x, z, l);
+					layers[l + 1]->releaseNeighbour(x, z);
+				}
+			}
+		};
+
+		// 在 tbb 的 work stealing 调度器上运行，任务完成时释放依赖它的任务
+		tbb::task_group group;
+		std::function<void(size_t, size_t)> run = [&](const size_t l, const size_t tile) {
+			group.run([&, l, tile]() {
+				set_current_thread_safe_for_nodes(true);
+				if (failed || !generateTile(layers[l], tile)) {
+					failed = true;
+					return;
+				}
+				if (l > 0) {
+					forEachNeighbour(tile, radius[l], [&](const size_t neighbour) {
+						if (users[l - 1][neighbour].fetch_sub(1) == 1) {
+							dropTile(l - 1, neighbour);
+						}
 					});
 				}
+				// 可能写入 neighbour 的图块都已生成后，发往它的修改不会再增加，应用后它在本层的结果才算完成
+				forEachNeighbour(tile, radius[l], [&](const size_t neighbour) {
+					if (unflushed[l][neighbour].fetch_sub(1) != 1 || failed) {
+						return;
+					}
+					if (!flushTile(layers[l], neighbour)) {
+						failed = true;
+						return;
+					}
+					if (l + 1 < layers.size()) {
+						forEachNeighbour(neighbour, radius[l + 1], [&](const size_t user) {
+							if (pending[l + 1][user].fetch_sub(1) == 1) {
+								run(l + 1, user);
+							}
+						});
+					}
+				});
+			});
+		};
+		if (!layers.empty()) {
+			for (const auto &[tile_x, tile_z] : tile_order) {
+				run(0, tile_x * tiles + tile_z);
 			}
-			pool.wait();
+		}
+		group.wait();
+		for (auto layer : layers) {
+			layer->finish();
+		}
+
+		if (failed) {
+			WorldDB::singleton().abortGeneration();
+			ERR_PRINT("Generation aborted, the base terrain was not changed.");
+			emit_signal("generation_failed");
+			return;
+		}
+		// 将最后一层的生成结果写入基础地形，并删除临时生成器数据库
+		if (!WorldDB::singleton().endGeneration(layers.empty() ? 0 : layers.size() - 1)) {
+			ERR_PRINT("Generation failed while writing the base terrain.");
+			emit_signal("generation_failed");
+			return;
 		}
 		emit_signal("generation_finished");
 		tmr.stop();
@@ -78,6 +259,7 @@ void VoxelGenerator::_bind_methods() {
 	ADD_PROPERTY(PropertyInfo(Variant::INT, "batch_size"), "setBatchSize", "getBatchSize");
 
 	ADD_SIGNAL(MethodInfo("generation_finished"));
+	ADD_SIGNAL(MethodInfo("generation_failed"));
 }
 
 } //namespace pgvoxel
@@ -0,0 +1,116 @@
+#include "voxel_generator_graph.h"
+
+#include "voxel_noise.h"
+
+#include "core/error/error_macros.h"
+
+#include <map>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace pgvoxel {
+
+namespace {
+
+const std::unordered_map<std::string, GeneratorProgram::Op> kOps{
+	{ "constant", GeneratorProgram::Op::kConstant },
+	{ "x", GeneratorProgram::Op::kX },
+	{ "y", GeneratorProgram::Op::kY },
+	{ "z", GeneratorProgram::Op::kZ },
+	{ "noise_2d", GeneratorProgram::Op::kNoise2d },
+	{ "noise_3d", GeneratorProgram::Op::kNoise3d },
+	{ "add", GeneratorProgram::Op::kAdd },
+	{ "sub", GeneratorProgram::Op::kSub },
+	{ "mul", GeneratorProgram::Op::kMul },
+	{ "min", GeneratorProgram::Op::kMin },
+	{ "max", GeneratorProgram::Op::kMax },
+	{ "clamp", GeneratorProgram::Op::kClamp },
+	{ "select", GeneratorProgram::Op::kSelect },
+	{ "set_block", GeneratorProgram::Op::kSetBlock },
+};
+
+} //namespace
+
+int VoxelGeneratorGraph::addNode(const String &op, const PackedInt32Array &inputs, const Dictionary &parameters) {
+	Dictionary node = parameters.duplicate();
+	node["op"] = op;
+	node["inputs"] = inputs;
+	nodes_.push_back(node);
+	emit_changed();
+	return nodes_.size() - 1;
+}
+
+void VoxelGeneratorGraph::clear() {
+	nodes_.clear();
+	emit_changed();
+}
+
+std::shared_ptr<const GeneratorProgram> VoxelGeneratorGraph::compile() const {
+	std::vector<GeneratorProgram::Node> nodes;
+	std::vector<GeneratorProgram::Field> fields;
+	// 同一个 VoxelNoise 以相同的方式在多个节点中使用时只采样一次
+	std::map<std::tuple<const VoxelNoise *, bool, uint32_t>, uint32_t> field_of;
+	nodes.reserve(nodes_.size());
+	for (int i = 0; i < nodes_.size(); ++i) {
+		const Dictionary description = nodes_[i];
+		const auto op = kOps.find(String(description.get("op", "")).utf8().get_data());
+		ERR_FAIL_COND_V_MSG(op == kOps.end(), nullptr, vformat("Generator graph node %d has an unknown op.", i));
+
+		GeneratorProgram::Node node{ op->second };
+		const PackedInt32Array inputs = description.get("inputs", PackedInt32Array());
+		for (int k = 0; k < inputs.size(); ++k) {
+			node.inputs.push_back(inputs[k]);
+		}
+		switch (node.op) {
+			case GeneratorProgram::Op::kConstant:
+				node.a = description.get("value", 0);
+				break;
+			case GeneratorProgram::Op::kClamp:
+				node.a = description.get("min", 0);
+				node.b = description.get("max", 0);
+				break;
+			case GeneratorProgram::Op::kNoise2d:
+			case GeneratorProgram::Op::kNoise3d: {
+				const Ref<VoxelNoise> noise = description.get("noise", Variant());
+				ERR_FAIL_COND_V_MSG(noise.is_null(), nullptr, vformat("Generator graph node %d has no VoxelNoise.", i));
+				const bool three_dimensional = node.op == GeneratorProgram::Op::kNoise3d;
+				const int64_t stride_value = three_dimensional ? static_cast<int64_t>(description.get("stride", 1)) : 1;
+				ERR_FAIL_COND_V_MSG(stride_value < 1 || stride_value > kGeneratingChunkWidth, nullptr, vformat("Generator graph node %d has an invalid noise stride.", i));
+				const uint32_t stride = static_cast<uint32_t>(stride_value);
+				const auto [iter, inserted] = field_of.try_emplace({ noise.ptr(), three_dimensional, stride }, fields.size());
+				if (inserted) {
+					fields.push_back({ noise->noise(), three_dimensional, stride });
+				}
+				node.field = iter->second;
+				break;
+			}
+			case GeneratorProgram::Op::kSetBlock: {
+				// 先在 int64 范围内检查，再收窄为 VoxelData 和 uint8_t，否则越界的值会被截断成合法的值
+				const int64_t block = description.get("block", 0);
+				const int64_t layer = description.get("layer", 0);
+				ERR_FAIL_COND_V_MSG(block < 0 || block > kMaxVoxelData, nullptr, vformat("Generator graph node %d writes an invalid block.", i));
+				ERR_FAIL_COND_V_MSG(layer < 0 || layer >= GenerationChunk::kDataChunkNums, nullptr, vformat("Generator graph node %d writes to an invalid layer.", i));
+				node.block = static_cast<VoxelData>(block);
+				node.layer = static_cast<uint8_t>(layer);
+				break;
+			}
+			default:
+				break;
+		}
+		nodes.push_back(std::move(node));
+	}
+	return GeneratorProgram::compile(nodes, std::move(fields));
+}
+
+void VoxelGeneratorGraph::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("add_node", "op", "inputs", "parameters"), &VoxelGeneratorGraph::addNode, DEFVAL(PackedInt32Array()), DEFVAL(Dictionary()));
+	ClassDB::bind_method(D_METHOD("clear"), &VoxelGeneratorGraph::clear);
+
+	ClassDB::bind_method(D_METHOD("setNodes", "nodes"), &VoxelGeneratorGraph::setNodes);
+	ClassDB::bind_method(D_METHOD("getNodes"), &VoxelGeneratorGraph::getNodes);
+	ADD_PROPERTY(PropertyInfo(Variant::ARRAY, "nodes", PROPERTY_HINT_ARRAY_TYPE, "Dictionary"), "setNodes", "getNodes");
+}
+
+} //namespace pgvoxel
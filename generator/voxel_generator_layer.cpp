@@ -1,5 +1,6 @@
 #include "voxel_generator_layer.h"
 
+#include "chunk_key.h"
 #include "core/string/print_string.h"
 #include "voxel_generation_chunk.h"
 #include "voxel_generator.h"
@@ -10,20 +11,89 @@
 
 #include "modules/pgvoxel/thirdparty/thread-pool/include/BS_thread_pool.hpp"
 #include <tbb/task_group.h>
+#include <algorithm>
 #include <vector>
 
 namespace pgvoxel {
 
-void VoxelGeneratorLayer::generate(Ref<VoxelGenerationChunk> chunk) {
+bool VoxelGeneratorLayer::prepare() {
 	auto children = get_children();
-	std::vector<VoxelLocalGenerator *> generators;
+	neighbour_cache_.clear();
+	deferred_edits_.clear();
+	generators_.clear();
 	for (int i = 0; i < children.size(); ++i) {
-		generators.push_back(Object::cast_to<VoxelLocalGenerator>(children[i]));
+		generators_.push_back(Object::cast_to<VoxelLocalGenerator>(children[i]));
+	}
+	if (graph_.is_null()) {
+		program_.reset();
+		return true;
+	}
+	program_ = graph_->compile();
+	ERR_FAIL_COND_V_MSG(!program_, false, String("Failed to compile generator graph of layer {0}.").format(varray(get_name())));
+	print_verbose(String("Compiled generator graph of layer {0}: {1} instructions, {2} registers.").format(varray(get_name(), static_cast<uint64_t>(program_->instructionCount()), static_cast<uint64_t>(program_->registerCount()))));
+	return true;
+}
+
+void VoxelGeneratorLayer::finish() {
+	generators_.clear();
+	program_.reset();
+	neighbour_cache_.clear();
+	deferred_edits_.clear();
+}
+
+bool VoxelGeneratorLayer::getNeighbour(const CoordAxis x, const CoordAxis z, std::shared_ptr<const GenerationChunk> &result) {
+	result.reset();
+	if (index_ == 0) {
+		return true;
+	}
+	const uint64_t key = ChunkKey::encode(x, 0, z);
+	const auto slot = neighbour_cache_.getOrPut(key, [] { return std::make_shared<NeighbourSlot>(); }, kEstimatedNeighbourSize);
+	std::call_once(slot->loaded, [&]() {
+		slot->chunk = WorldDB::singleton().loadGenerationChunk(x, z, index_ - 1);
+		if (slot->chunk) {
+			// 加载后以实际大小重新计入预算
+			neighbour_cache_.put(key, slot, slot->chunk->memoryUsage());
+		} else {
+			// 等待同一次加载的线程同样得到失败，之后的请求重新读取
+			neighbour_cache_.erase(key);
+		}
+	});
+	ERR_FAIL_COND_V_MSG(!slot->chunk, false, "Failed to load a neighbour chunk from the previous layer.");
+	result = slot->chunk;
+	return true;
+}
+
+bool VoxelGeneratorLayer::applyDeferredEdits(const CoordAxis x, const CoordAxis z) {
+	const auto edits = deferred_edits_.take(ChunkKey::encode(x, 0, z));
+	if (edits.empty()) {
+		return true;
 	}
+	auto chunk = WorldDB::singleton().loadGenerationChunk(x, z, index_);
+	ERR_FAIL_COND_V_MSG(!chunk, false, "Deferred edits target a chunk that was not generated.");
+	for (size_t i = 0; i < edits.size();) {
+		// 排序后相邻、值相同且首尾相接的修改合并为一次写入，中间没有其他修改，结果与逐条写入相同
+		DeferredEditQueue::Edit merged = edits[i];
+		for (++i; i < edits.size(); ++i) {
+			const auto &edit = edits[i];
+			if (edit.layer != merged.layer || edit.x != merged.x || edit.z != merged.z || edit.data != merged.data ||
+					edit.buttom > merged.top || edit.top < merged.buttom) {
+				break;
+			}
+			merged.buttom = std::min(merged.buttom, edit.buttom);
+			merged.top = std::max(merged.top, edit.top);
+		}
+		chunk->setBar(merged.x, merged.z, merged.buttom, merged.top, merged.data, merged.layer);
+	}
+	return WorldDB::singleton().saveGenerationChunk(chunk.get(), index_);
+}
 
-	for (auto generator : generators) {
+void VoxelGeneratorLayer::generate(Ref<VoxelGenerationChunk> chunk) {
+	if (program_) {
+		program_->execute(*chunk.ptr());
+	}
+	for (auto generator : generators_) {
 		print_verbose(String("Generator : {0}").format(varray(generator->get_name())));
-		GDVIRTUAL_CALL_PTR(generator, _generate, chunk);
+		generator->generate(chunk);
 		print_verbose(String("Generator : {0} finished").format(varray(generator->get_name())));
 	}
 }
@@ -31,7 +101,7 @@ void VoxelGeneratorLayer::generate(Ref<VoxelGenerationChunk> chunk) {
 PackedStringArray VoxelGeneratorLayer::get_configuration_warnings() const {
 	PackedStringArray warnings = Node::get_configuration_warnings();
 
-	if (get_child_count() == 0) {
+	if (get_child_count() == 0 && graph_.is_null()) {
 		warnings.push_back(RTR("This layer has no local generator."));
 	}
 
@@ -39,6 +109,14 @@ PackedStringArray VoxelGeneratorLayer::get_configuration_warnings() const {
 }
 
 void VoxelGeneratorLayer::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("setNeighbourRadius", "neighbour_radius"), &VoxelGeneratorLayer::setNeighbourRadius);
+	ClassDB::bind_method(D_METHOD("getNeighbourRadius"), &VoxelGeneratorLayer::getNeighbourRadius);
+
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "neighbour_radius"), "setNeighbourRadius", "getNeighbourRadius");
+
+	ClassDB::bind_method(D_METHOD("setGraph", "graph"), &VoxelGeneratorLayer::setGraph);
+	ClassDB::bind_method(D_METHOD("getGraph"), &VoxelGeneratorLayer::getGraph);
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "graph", PROPERTY_HINT_RESOURCE_TYPE, "VoxelGeneratorGraph"), "setGraph", "getGraph");
 }
 
 } //namespace pgvoxel
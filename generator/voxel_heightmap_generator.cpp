@@ -0,0 +1,62 @@
+#include "voxel_heightmap_generator.h"
+
+#include "chunk.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace pgvoxel {
+
+void VoxelHeightmapGenerator::generate(Ref<VoxelGenerationChunk> chunk) {
+	ERR_FAIL_INDEX(layer_, GenerationChunk::kDataChunkNums);
+	ERR_FAIL_COND_MSG(noise_.is_null(), "VoxelHeightmapGenerator has no noise.");
+	constexpr int32_t kWidth = kGeneratingChunkWidth, kHeight = kGeneratingChunkHeight;
+	const int64_t origin_x = static_cast<int64_t>(chunk->getX()) * kWidth, origin_z = static_cast<int64_t>(chunk->getZ()) * kWidth;
+	for (int32_t x = 0; x < kWidth; ++x) {
+		for (int32_t z = 0; z < kWidth; ++z) {
+			const real_t sample = noise_->get_noise_2d(origin_x + x, origin_z + z);
+			const int32_t height = std::clamp<int32_t>(base_height_ + std::lround(sample * height_range_), 0, kHeight);
+			const int32_t surface = std::clamp<int32_t>(height - surface_depth_, 0, height);
+			if (surface > 0) {
+				chunk->setBar(x, z, 0, surface, block_, layer_);
+			}
+			if (height > surface) {
+				chunk->setBar(x, z, surface, height, surface_block_, layer_);
+			}
+		}
+	}
+}
+
+void VoxelHeightmapGenerator::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("setNoise", "noise"), &VoxelHeightmapGenerator::setNoise);
+	ClassDB::bind_method(D_METHOD("getNoise"), &VoxelHeightmapGenerator::getNoise);
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "noise", PROPERTY_HINT_RESOURCE_TYPE, "Noise"), "setNoise", "getNoise");
+
+	ClassDB::bind_method(D_METHOD("setBaseHeight", "base_height"), &VoxelHeightmapGenerator::setBaseHeight);
+	ClassDB::bind_method(D_METHOD("getBaseHeight"), &VoxelHeightmapGenerator::getBaseHeight);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "base_height"), "setBaseHeight", "getBaseHeight");
+
+	ClassDB::bind_method(D_METHOD("setHeightRange", "height_range"), &VoxelHeightmapGenerator::setHeightRange);
+	ClassDB::bind_method(D_METHOD("getHeightRange"), &VoxelHeightmapGenerator::getHeightRange);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "height_range"), "setHeightRange", "getHeightRange");
+
+	ADD_GROUP("Blocks", "");
+
+	ClassDB::bind_method(D_METHOD("setBlock", "block"), &VoxelHeightmapGenerator::setBlock);
+	ClassDB::bind_method(D_METHOD("getBlock"), &VoxelHeightmapGenerator::getBlock);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "block"), "setBlock", "getBlock");
+
+	ClassDB::bind_method(D_METHOD("setSurfaceBlock", "surface_block"), &VoxelHeightmapGenerator::setSurfaceBlock);
+	ClassDB::bind_method(D_METHOD("getSurfaceBlock"), &VoxelHeightmapGenerator::getSurfaceBlock);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "surface_block"), "setSurfaceBlock", "getSurfaceBlock");
+
+	ClassDB::bind_method(D_METHOD("setSurfaceDepth", "surface_depth"), &VoxelHeightmapGenerator::setSurfaceDepth);
+	ClassDB::bind_method(D_METHOD("getSurfaceDepth"), &VoxelHeightmapGenerator::getSurfaceDepth);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "surface_depth"), "setSurfaceDepth", "getSurfaceDepth");
+
+	ClassDB::bind_method(D_METHOD("setLayer", "layer"), &VoxelHeightmapGenerator::setLayer);
+	ClassDB::bind_method(D_METHOD("getLayer"), &VoxelHeightmapGenerator::getLayer);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "layer", PROPERTY_HINT_RANGE, "0,7"), "setLayer", "getLayer");
+}
+
+} //namespace pgvoxel
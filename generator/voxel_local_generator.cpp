@@ -2,6 +2,10 @@
 
 namespace pgvoxel{
 
+void VoxelLocalGenerator::generate(Ref<VoxelGenerationChunk> chunk) {
+	GDVIRTUAL_CALL(_generate, chunk);
+}
+
 void VoxelLocalGenerator::_bind_methods() {
 	GDVIRTUAL_BIND(_generate, "chunk")
 }
@@ -0,0 +1,64 @@
+#include "voxel_noise.h"
+
+#include "forward.h"
+#include "world_config.h"
+
+namespace pgvoxel {
+
+GradientNoise VoxelNoise::noise() const {
+	GET_WORLD_CONFIG(GradientNoise(seed_offset_, parameters_), config);
+	return GradientNoise(static_cast<uint32_t>(config.seed) + seed_offset_, parameters_);
+}
+
+PackedFloat32Array VoxelNoise::fill2d(const int64_t chunk_x, const int64_t chunk_z) const {
+	constexpr size_t kWidth = kGeneratingChunkWidth;
+	PackedFloat32Array result;
+	result.resize(kWidth * kWidth);
+	noise().fillGrid2d(chunk_x * kWidth, chunk_z * kWidth, 1, kWidth, kWidth, result.ptrw());
+	return result;
+}
+
+PackedFloat32Array VoxelNoise::fill3d(const int64_t chunk_x, const int64_t chunk_z, const int stride, const bool upsample) const {
+	constexpr size_t kWidth = kGeneratingChunkWidth, kHeight = kGeneratingChunkHeight;
+	ERR_FAIL_COND_V_MSG(stride <= 0 || kWidth % stride != 0, PackedFloat32Array(), "The stride must divide the chunk width.");
+	const double origin_x = chunk_x * kWidth, origin_z = chunk_z * kWidth;
+	PackedFloat32Array result;
+	if (!upsample) {
+		const size_t width = kWidth / stride, height = kHeight / stride;
+		result.resize(width * height * width);
+		noise().fillGrid3d(origin_x, 0, origin_z, stride, width, height, width, result.ptrw());
+		return result;
+	}
+	result.resize(kWidth * kHeight * kWidth);
+	noise().fillUpsampled3d(origin_x, 0, origin_z, stride, kWidth, kHeight, kWidth, result.ptrw());
+	return result;
+}
+
+void VoxelNoise::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("fill_2d", "chunk_x", "chunk_z"), &VoxelNoise::fill2d);
+	ClassDB::bind_method(D_METHOD("fill_3d", "chunk_x", "chunk_z", "stride", "upsample"), &VoxelNoise::fill3d, DEFVAL(1), DEFVAL(true));
+
+	ClassDB::bind_method(D_METHOD("setSeedOffset", "seed_offset"), &VoxelNoise::setSeedOffset);
+	ClassDB::bind_method(D_METHOD("getSeedOffset"), &VoxelNoise::getSeedOffset);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "seed_offset"), "setSeedOffset", "getSeedOffset");
+
+	ClassDB::bind_method(D_METHOD("setFrequency", "frequency"), &VoxelNoise::setFrequency);
+	ClassDB::bind_method(D_METHOD("getFrequency"), &VoxelNoise::getFrequency);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "frequency", PROPERTY_HINT_RANGE, "0.0001,1,0.0001,or_greater"), "setFrequency", "getFrequency");
+
+	ADD_GROUP("Fractal", "");
+
+	ClassDB::bind_method(D_METHOD("setOctaves", "octaves"), &VoxelNoise::setOctaves);
+	ClassDB::bind_method(D_METHOD("getOctaves"), &VoxelNoise::getOctaves);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "octaves", PROPERTY_HINT_RANGE, "1,10,1"), "setOctaves", "getOctaves");
+
+	ClassDB::bind_method(D_METHOD("setLacunarity", "lacunarity"), &VoxelNoise::setLacunarity);
+	ClassDB::bind_method(D_METHOD("getLacunarity"), &VoxelNoise::getLacunarity);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "lacunarity"), "setLacunarity", "getLacunarity");
+
+	ClassDB::bind_method(D_METHOD("setGain", "gain"), &VoxelNoise::setGain);
+	ClassDB::bind_method(D_METHOD("getGain"), &VoxelNoise::getGain);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "gain"), "setGain", "getGain");
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,70 @@
+#include "voxel_ore_generator.h"
+
+#include "chunk.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace pgvoxel {
+
+void VoxelOreGenerator::generate(Ref<VoxelGenerationChunk> chunk) {
+	ERR_FAIL_INDEX(layer_, GenerationChunk::kDataChunkNums);
+	ERR_FAIL_COND_MSG(noise_.is_null(), "VoxelOreGenerator has no noise.");
+	constexpr int32_t kWidth = kGeneratingChunkWidth, kHeight = kGeneratingChunkHeight;
+	const int32_t buttom = std::clamp<int32_t>(min_height_, 0, kHeight), top = std::clamp<int32_t>(max_height_, buttom, kHeight);
+	if (buttom == top) {
+		return;
+	}
+	const int64_t origin_x = static_cast<int64_t>(chunk->getX()) * kWidth, origin_z = static_cast<int64_t>(chunk->getZ()) * kWidth;
+	for (int32_t x = 0; x < kWidth; ++x) {
+		for (int32_t z = 0; z < kWidth; ++z) {
+			auto bar = chunk->readBar(x, z, buttom, top, layer_);
+			bool changed = false;
+			for (int32_t y = buttom; y < top; ++y) {
+				// 只在可替换的方块处采样，空气和其他方块不必计算噪声
+				auto &voxel = bar[y - buttom];
+				if (voxel == replace_ && noise_->get_noise_3d(origin_x + x, y, origin_z + z) > threshold_) {
+					voxel = block_;
+					changed = true;
+				}
+			}
+			if (changed) {
+				chunk->writeBar(x, z, buttom, bar, layer_);
+			}
+		}
+	}
+}
+
+void VoxelOreGenerator::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("setNoise", "noise"), &VoxelOreGenerator::setNoise);
+	ClassDB::bind_method(D_METHOD("getNoise"), &VoxelOreGenerator::getNoise);
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "noise", PROPERTY_HINT_RESOURCE_TYPE, "Noise"), "setNoise", "getNoise");
+
+	ClassDB::bind_method(D_METHOD("setThreshold", "threshold"), &VoxelOreGenerator::setThreshold);
+	ClassDB::bind_method(D_METHOD("getThreshold"), &VoxelOreGenerator::getThreshold);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "threshold", PROPERTY_HINT_RANGE, "-1,1,0.01"), "setThreshold", "getThreshold");
+
+	ClassDB::bind_method(D_METHOD("setMinHeight", "min_height"), &VoxelOreGenerator::setMinHeight);
+	ClassDB::bind_method(D_METHOD("getMinHeight"), &VoxelOreGenerator::getMinHeight);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "min_height"), "setMinHeight", "getMinHeight");
+
+	ClassDB::bind_method(D_METHOD("setMaxHeight", "max_height"), &VoxelOreGenerator::setMaxHeight);
+	ClassDB::bind_method(D_METHOD("getMaxHeight"), &VoxelOreGenerator::getMaxHeight);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "max_height"), "setMaxHeight", "getMaxHeight");
+
+	ADD_GROUP("Blocks", "");
+
+	ClassDB::bind_method(D_METHOD("setBlock", "block"), &VoxelOreGenerator::setBlock);
+	ClassDB::bind_method(D_METHOD("getBlock"), &VoxelOreGenerator::getBlock);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "block"), "setBlock", "getBlock");
+
+	ClassDB::bind_method(D_METHOD("setReplace", "replace"), &VoxelOreGenerator::setReplace);
+	ClassDB::bind_method(D_METHOD("getReplace"), &VoxelOreGenerator::getReplace);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "replace"), "setReplace", "getReplace");
+
+	ClassDB::bind_method(D_METHOD("setLayer", "layer"), &VoxelOreGenerator::setLayer);
+	ClassDB::bind_method(D_METHOD("getLayer"), &VoxelOreGenerator::getLayer);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "layer", PROPERTY_HINT_RANGE, "0,7"), "setLayer", "getLayer");
+}
+
+} //namespace pgvoxel
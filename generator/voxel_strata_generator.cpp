@@ -0,0 +1,67 @@
+#include "voxel_strata_generator.h"
+
+#include "chunk.h"
+
+#include <cmath>
+#include <vector>
+
+namespace pgvoxel {
+
+void VoxelStrataGenerator::generate(Ref<VoxelGenerationChunk> chunk) {
+	ERR_FAIL_INDEX(layer_, GenerationChunk::kDataChunkNums);
+	if (blocks_.is_empty()) {
+		return;
+	}
+	ERR_FAIL_COND_MSG(thickness_ <= 0, "VoxelStrataGenerator requires a positive thickness.");
+	constexpr int32_t kWidth = kGeneratingChunkWidth, kHeight = kGeneratingChunkHeight;
+	const int64_t origin_x = static_cast<int64_t>(chunk->getX()) * kWidth, origin_z = static_cast<int64_t>(chunk->getZ()) * kWidth;
+	const int64_t count = blocks_.size();
+	for (int32_t x = 0; x < kWidth; ++x) {
+		for (int32_t z = 0; z < kWidth; ++z) {
+			const int64_t offset = noise_.is_valid() ? std::lround(noise_->get_noise_2d(origin_x + x, origin_z + z) * warp_) : 0;
+			auto bar = chunk->readBar(x, z, 0, kHeight, layer_);
+			bool changed = false;
+			for (int32_t y = 0; y < kHeight; ++y) {
+				if (bar[y] != replace_) {
+					continue;
+				}
+				// 起伏可能使高度为负，向下取整后再取非负的余数
+				const int64_t height = y + offset;
+				const int64_t stratum = (height >= 0 ? height / thickness_ : (height + 1) / thickness_ - 1) % count;
+				bar[y] = blocks_[stratum < 0 ? stratum + count : stratum];
+				changed = true;
+			}
+			if (changed) {
+				chunk->writeBar(x, z, 0, bar, layer_);
+			}
+		}
+	}
+}
+
+void VoxelStrataGenerator::_bind_methods() {
+	ClassDB::bind_method(D_METHOD("setBlocks", "blocks"), &VoxelStrataGenerator::setBlocks);
+	ClassDB::bind_method(D_METHOD("getBlocks"), &VoxelStrataGenerator::getBlocks);
+	ADD_PROPERTY(PropertyInfo(Variant::PACKED_INT32_ARRAY, "blocks"), "setBlocks", "getBlocks");
+
+	ClassDB::bind_method(D_METHOD("setThickness", "thickness"), &VoxelStrataGenerator::setThickness);
+	ClassDB::bind_method(D_METHOD("getThickness"), &VoxelStrataGenerator::getThickness);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "thickness"), "setThickness", "getThickness");
+
+	ClassDB::bind_method(D_METHOD("setReplace", "replace"), &VoxelStrataGenerator::setReplace);
+	ClassDB::bind_method(D_METHOD("getReplace"), &VoxelStrataGenerator::getReplace);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "replace"), "setReplace", "getReplace");
+
+	ClassDB::bind_method(D_METHOD("setNoise", "noise"), &VoxelStrataGenerator::setNoise);
+	ClassDB::bind_method(D_METHOD("getNoise"), &VoxelStrataGenerator::getNoise);
+	ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "noise", PROPERTY_HINT_RESOURCE_TYPE, "Noise"), "setNoise", "getNoise");
+
+	ClassDB::bind_method(D_METHOD("setWarp", "warp"), &VoxelStrataGenerator::setWarp);
+	ClassDB::bind_method(D_METHOD("getWarp"), &VoxelStrataGenerator::getWarp);
+	ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "warp"), "setWarp", "getWarp");
+
+	ClassDB::bind_method(D_METHOD("setLayer", "layer"), &VoxelStrataGenerator::setLayer);
+	ClassDB::bind_method(D_METHOD("getLayer"), &VoxelStrataGenerator::getLayer);
+	ADD_PROPERTY(PropertyInfo(Variant::INT, "layer", PROPERTY_HINT_RANGE, "0,7"), "setLayer", "getLayer");
+}
+
+} //namespace pgvoxel
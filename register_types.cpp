@@ -4,8 +4,17 @@
 #include "voxel_buffer.h"
 #include "voxel_generator_layer.h"
 #include "voxel_local_generator.h"
+#include "voxel_heightmap_generator.h"
+#include "voxel_strata_generator.h"
+#include "voxel_ore_generator.h"
+#include "voxel_cave_generator.h"
+#include "voxel_noise.h"
+#include "voxel_generator_graph.h"
 #include "voxel_world_config.h"
 #include "voxel_world.h"
+#include "async_world_db.h"
+#include "world_db.h"
+#include "voxel_world_tool.h"
 #include "voxel_block.h"
 #include "voxel_generator.h"
 #include "voxel_block_library.h"
@@ -24,14 +33,26 @@ void initialize_pgvoxel_module(ModuleInitializationLevel p_level) {
 	ClassDB::register_class<VoxelGenerator>();
 	ClassDB::register_class<VoxelGeneratorLayer>();
 	ClassDB::register_class<VoxelLocalGenerator>();
+	ClassDB::register_class<VoxelHeightmapGenerator>();
+	ClassDB::register_class<VoxelStrataGenerator>();
+	ClassDB::register_class<VoxelOreGenerator>();
+	ClassDB::register_class<VoxelCaveGenerator>();
+	ClassDB::register_class<VoxelNoise>();
+	ClassDB::register_class<VoxelGeneratorGraph>();
 	ClassDB::register_class<VoxelWorld>();
+	ClassDB::register_class<VoxelWorldTool>();
 	ClassDB::register_class<VoxelBlock>();
 	ClassDB::register_class<VoxelBlockLibrary>();
 	ClassDB::register_class<VoxelMesher>();
 }
 
 void uninitialize_pgvoxel_module(ModuleInitializationLevel p_level) {
+	using namespace pgvoxel;
+
 	if (p_level != MODULE_INITIALIZATION_LEVEL_SCENE) {
 		return;
 	}
+	// I/O 线程仍可能在读取 WorldDB，先让它们退出，再关闭数据库
+	AsyncWorldDB::destroy();
+	WorldDB::destroy();
 }
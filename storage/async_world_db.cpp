@@ -0,0 +1,39 @@
+#include "async_world_db.h"
+#include "chunk_key.h"
+#include "world_db.h"
+
+namespace pgvoxel {
+
+AsyncWorldDB::AsyncWorldDB() :
+		chunk_queue_([](const Coord &pos) -> ChunkResult { return WorldDB::singleton().loadChunk(pos); }, kChunkThreads),
+		metadata_queue_([](const uint64_t key) {
+			const Coord pos = ChunkKey(key).position();
+			return WorldDB::singleton().getMetadata(pos.x, pos.z);
+		},
+				kMetadataThreads) {}
+
+AsyncWorldDB::ChunkSubmission AsyncWorldDB::requestChunk(const Coord &pos, const int32_t priority, ChunkCallback callback) {
+	return chunk_queue_.request(pos, priority, std::move(callback));
+}
+
+bool AsyncWorldDB::reprioritizeChunk(const Coord &pos, const int32_t priority) {
+	return chunk_queue_.reprioritize(pos, priority);
+}
+
+bool AsyncWorldDB::cancelChunk(const Ticket ticket) {
+	return chunk_queue_.cancel(ticket);
+}
+
+AsyncWorldDB::MetadataSubmission AsyncWorldDB::requestMetadata(const CoordAxis x, const CoordAxis z, const int32_t priority, MetadataCallback callback) {
+	return metadata_queue_.request(ChunkKey::encode(x, 0, z), priority, std::move(callback));
+}
+
+bool AsyncWorldDB::reprioritizeMetadata(const CoordAxis x, const CoordAxis z, const int32_t priority) {
+	return metadata_queue_.reprioritize(ChunkKey::encode(x, 0, z), priority);
+}
+
+bool AsyncWorldDB::cancelMetadata(const Ticket ticket) {
+	return metadata_queue_.cancel(ticket);
+}
+
+} //namespace pgvoxel
@@ -65,7 +65,7 @@ void Buffer::serialize(std::ostringstream &oss) const {
 }
 
 // 反序列化
-void Buffer::deserialize(std::istringstream &iss, const uint32_t size) {
+void Buffer::deserialize(std::istream &iss, const uint32_t size) {
     // 读取未压缩数据的大小
     uint32_t original_size;
     iss.read(reinterpret_cast<char *>(&original_size), sizeof(original_size));
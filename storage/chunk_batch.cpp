@@ -0,0 +1,138 @@
+#include "chunk_batch.h"
+#include "chunk.inl"
+
+#include <lz4.h>
+
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+namespace pgvoxel {
+
+std::string ChunkBatch::encode(const std::vector<const LoadedChunk *> &chunks) {
+	const uint8_t count = chunks.size();
+	// 各层先以不压缩的格式序列化，压缩由这里统一完成
+	std::vector<std::string> raws(count * LoadedChunk::kDataChunkNums);
+	const int previous_level = data_chunk_compression_level;
+	data_chunk_compression_level = kDataChunkUncompressed;
+	for (uint8_t i = 0; i < count; ++i) {
+		for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+			std::ostringstream oss;
+			chunks[i]->serializeLayer(oss, layer);
+			raws[i * LoadedChunk::kDataChunkNums + layer] = std::move(oss).str();
+		}
+	}
+	data_chunk_compression_level = previous_level;
+
+	std::string header, frames;
+	header.push_back(static_cast<char>(count));
+	for (const LoadedChunk *chunk : chunks) {
+		header.push_back(static_cast<char>(localIndex(chunk->getPosition())));
+	}
+	const std::unique_ptr<LZ4_stream_t, decltype(&LZ4_freeStream)> stream(LZ4_createStream(), &LZ4_freeStream);
+	std::string buffer;
+	for (size_t i = 0; i < raws.size(); ++i) {
+		const std::string &raw = raws[i];
+		buffer.resize(LZ4_compressBound(raw.size()));
+		int size;
+		if (i < LoadedChunk::kDataChunkNums) {
+			// 第一个区块的各层作为字典，独立压缩
+			size = LZ4_compress_default(raw.data(), buffer.data(), raw.size(), buffer.size());
+		} else {
+			const std::string &dictionary = raws[i % LoadedChunk::kDataChunkNums];
+			LZ4_resetStream_fast(stream.get());
+			LZ4_loadDict(stream.get(), dictionary.data(), dictionary.size());
+			size = LZ4_compress_fast_continue(stream.get(), raw.data(), buffer.data(), raw.size(), buffer.size(), 1);
+		}
+		if (size <= 0) [[unlikely]] {
+			throw std::runtime_error("Chunk batch compression failed!");
+		}
+		const Segment segment{ static_cast<uint32_t>(frames.size()), static_cast<uint32_t>(size), static_cast<uint32_t>(raw.size()) };
+		header.append(reinterpret_cast<const char *>(&segment), sizeof(segment));
+		frames.append(buffer.data(), size);
+	}
+	return header + frames;
+}
+
+bool ChunkBatch::decode(const std::string_view batch, LoadedChunk &chunk, const LoadedChunk::LayerMask layers) {
+	const int found = find(batch, chunk.getPosition());
+	if (found < 0) {
+		return false;
+	}
+	const uint8_t count = batch[0];
+	const uint8_t index = found;
+
+	std::string dictionary, raw;
+	for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+		if (!(layers & (1 << layer))) {
+			continue;
+		}
+		Segment target;
+		if (!segment(batch, count, index, layer, target)) [[unlikely]] {
+			return false;
+		}
+		dictionary.clear();
+		if (index != 0) {
+			Segment first;
+			if (!segment(batch, count, 0, layer, first) || !decompress(batch, count, first, {}, dictionary)) [[unlikely]] {
+				return false;
+			}
+		}
+		if (!decompress(batch, count, target, dictionary, raw)) [[unlikely]] {
+			return false;
+		}
+		ViewStream iss(raw);
+		chunk.deserializeLayer(iss, layer);
+	}
+	chunk.clearDirty();
+	return true;
+}
+
+bool ChunkBatch::contains(const std::string_view batch, const Coord &pos) {
+	return find(batch, pos) >= 0;
+}
+
+std::vector<Coord> ChunkBatch::positions(const std::string_view batch, const Coord &corner) {
+	std::vector<Coord> result;
+	if (batch.empty()) [[unlikely]] {
+		return result;
+	}
+	const uint8_t count = batch[0];
+	for (uint8_t i = 0; i < count && 1u + i < batch.size(); ++i) {
+		const uint8_t local = batch[1 + i];
+		result.emplace_back(corner.x + local / kWidth, corner.y, corner.z + local % kWidth);
+	}
+	return result;
+}
+
+int ChunkBatch::find(const std::string_view batch, const Coord &pos) {
+	if (batch.empty() || batch.size() < 1u + static_cast<uint8_t>(batch[0])) [[unlikely]] {
+		return -1;
+	}
+	const auto found = std::memchr(batch.data() + 1, localIndex(pos), static_cast<uint8_t>(batch[0]));
+	return found ? static_cast<const char *>(found) - (batch.data() + 1) : -1;
+}
+
+bool ChunkBatch::segment(const std::string_view batch, const uint8_t count, const uint8_t chunk, const uint8_t layer, Segment &result) {
+	const size_t offset = 1 + count + (static_cast<size_t>(chunk) * LoadedChunk::kDataChunkNums + layer) * sizeof(Segment);
+	if (offset + sizeof(Segment) > batch.size()) [[unlikely]] {
+		return false;
+	}
+	std::memcpy(&result, batch.data() + offset, sizeof(Segment));
+	return true;
+}
+
+bool ChunkBatch::decompress(const std::string_view batch, const uint8_t count, const Segment &segment, const std::string_view dictionary, std::string &raw) {
+	const size_t frames = 1 + count + static_cast<size_t>(count) * LoadedChunk::kDataChunkNums * sizeof(Segment);
+	if (frames + segment.offset + segment.size > batch.size()) [[unlikely]] {
+		return false;
+	}
+	raw.resize(segment.raw_size);
+	const char *source = batch.data() + frames + segment.offset;
+	const int size = dictionary.empty()
+			? LZ4_decompress_safe(source, raw.data(), segment.size, segment.raw_size)
+			: LZ4_decompress_safe_usingDict(source, raw.data(), segment.size, segment.raw_size, dictionary.data(), dictionary.size());
+	return size == static_cast<int>(segment.raw_size);
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,225 @@
+#include "generation_store.h"
+#include "chunk.inl"
+#include "chunk_key.h"
+#include "serialize.h"
+
+#include "core/error/error_macros.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <sstream>
+
+namespace pgvoxel {
+
+GenerationStore::GenerationStore(const size_t memory_budget, const std::string &scratch_path) :
+		memory_budget_(memory_budget), scratch_path_(scratch_path) {}
+
+GenerationStore::~GenerationStore() {
+	if (scratch_map_) {
+		munmap(scratch_map_, scratch_capacity_);
+	}
+	if (scratch_fd_ >= 0) {
+		close(scratch_fd_);
+		unlink(scratch_path_.c_str());
+	}
+}
+
+std::unique_ptr<GenerationChunk> GenerationStore::load(const CoordAxis x, const CoordAxis z, const uint16_t version) {
+	auto chunk = GenerationChunk::create({ x, 0, z });
+	if (!load(*chunk, version)) [[unlikely]] {
+		return nullptr;
+	}
+	return chunk;
+}
+
+bool GenerationStore::load(GenerationChunk &chunk, const uint16_t version) {
+	const uint64_t key = ChunkKey::encode(chunk.getPosition().x, version, chunk.getPosition().z);
+	// 各线程复用的缓冲区
+	thread_local std::string data;
+	{
+		auto &shard = shardOf(key);
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		auto iter = shard.entries.find(key);
+		ERR_FAIL_COND_V_MSG(iter == shard.entries.end(), false, "Generation chunk not found.");
+		const Entry &entry = iter->second;
+		if (entry.spilled) {
+			std::shared_lock<std::shared_mutex> scratchLock(scratch_mtx_);
+			data.assign(scratch_map_ + entry.offset, entry.size);
+		} else {
+			data = entry.data;
+		}
+	}
+
+	std::istringstream iss(std::move(data));
+	iss >> chunk;
+	data = std::move(iss).str();
+	return true;
+}
+
+bool GenerationStore::save(GenerationChunk *chunk, const uint16_t version) {
+	chunk->fit();
+	std::ostringstream oss;
+	oss << *chunk;
+
+	const uint64_t key = ChunkKey::encode(chunk->getPosition().x, version, chunk->getPosition().z);
+	Entry entry;
+	if (reserveMemory(oss.view().size())) {
+		entry.data = std::move(oss).str();
+	} else {
+		// 超出预算，溢出到临时文件
+		entry.size = oss.view().size();
+		entry.offset = spill(oss.str());
+		ERR_FAIL_COND_V_MSG(entry.offset == UINT64_MAX, false, "Failed to spill generation chunk to scratch file.");
+		entry.spilled = true;
+	}
+
+	auto &shard = shardOf(key);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	auto &slot = shard.entries[key];
+	// 被替换的旧数据不再占用预算或临时文件中的空间
+	release(slot);
+	slot = std::move(entry);
+	return true;
+}
+
+void GenerationStore::erase(const CoordAxis x, const CoordAxis z, const uint16_t version) {
+	const uint64_t key = ChunkKey::encode(x, version, z);
+	auto &shard = shardOf(key);
+	std::lock_guard<std::mutex> lock(shard.mtx);
+	auto iter = shard.entries.find(key);
+	if (iter == shard.entries.end()) {
+		return;
+	}
+	release(iter->second);
+	shard.entries.erase(iter);
+}
+
+bool GenerationStore::reserveMemory(const size_t size) {
+	// 多个线程同时保存时，检查与记账需要是原子的，否则会一起越过预算
+	size_t current = memory_usage_.load();
+	do {
+		if (current + size > memory_budget_) {
+			return false;
+		}
+	} while (!memory_usage_.compare_exchange_weak(current, current + size));
+	return true;
+}
+
+void GenerationStore::release(const Entry &entry) {
+	if (entry.spilled) {
+		std::lock_guard<std::mutex> lock(scratch_alloc_mtx_);
+		releaseScratch(entry.offset, entry.size);
+	} else {
+		memory_usage_ -= entry.data.size();
+	}
+}
+
+uint64_t GenerationStore::spill(const std::string &data) {
+	uint64_t offset;
+	{
+		std::lock_guard<std::mutex> lock(scratch_alloc_mtx_);
+		offset = allocateScratch(data.size());
+	}
+	if (offset == UINT64_MAX) {
+		return UINT64_MAX;
+	}
+	std::shared_lock<std::shared_mutex> scratchLock(scratch_mtx_);
+	memcpy(scratch_map_ + offset, data.data(), data.size());
+	return offset;
+}
+
+uint64_t GenerationStore::allocateScratch(const uint64_t size) {
+	// 优先使用能容纳 size 的最小空闲区间，剩余的部分放回空闲列表
+	auto iter = free_by_size_.lower_bound(size);
+	if (iter != free_by_size_.end()) {
+		const uint64_t extent_size = iter->first, offset = iter->second;
+		free_by_size_.erase(iter);
+		free_by_offset_.erase(offset);
+		if (extent_size > size) {
+			free_by_offset_.emplace(offset + size, extent_size - size);
+			free_by_size_.emplace(extent_size - size, offset + size);
+		}
+		return offset;
+	}
+	// 在末尾分配，扩大映射失败时不改变已分配的长度
+	if (!reserveScratch(scratch_end_ + size)) {
+		return UINT64_MAX;
+	}
+	const uint64_t offset = scratch_end_;
+	scratch_end_ += size;
+	return offset;
+}
+
+void GenerationStore::releaseScratch(uint64_t offset, uint64_t size) {
+	const auto eraseFree = [&](const std::map<uint64_t, uint64_t>::iterator extent) {
+		const auto range = free_by_size_.equal_range(extent->second);
+		for (auto iter = range.first; iter != range.second; ++iter) {
+			if (iter->second == extent->first) {
+				free_by_size_.erase(iter);
+				break;
+			}
+		}
+		free_by_offset_.erase(extent);
+	};
+	// 与前后相邻的空闲区间合并
+	auto next = free_by_offset_.lower_bound(offset);
+	if (next != free_by_offset_.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			eraseFree(previous);
+		}
+	}
+	if (next != free_by_offset_.end() && offset + size == next->first) {
+		size += next->second;
+		eraseFree(next);
+	}
+	if (offset + size == scratch_end_) {
+		// 位于末尾的空间直接归还
+		scratch_end_ = offset;
+		return;
+	}
+	free_by_offset_.emplace(offset, size);
+	free_by_size_.emplace(size, offset);
+}
+
+bool GenerationStore::reserveScratch(const uint64_t size) {
+	{
+		std::shared_lock<std::shared_mutex> scratchLock(scratch_mtx_);
+		if (size <= scratch_capacity_) [[likely]] {
+			return true;
+		}
+	}
+
+	std::unique_lock<std::shared_mutex> scratchLock(scratch_mtx_);
+	if (size <= scratch_capacity_) {
+		return true;
+	}
+	if (scratch_fd_ < 0) {
+		scratch_fd_ = open(scratch_path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+		ERR_FAIL_COND_V_MSG(scratch_fd_ < 0, false, "Failed to create generation scratch file.");
+	}
+
+	uint64_t new_capacity = std::max<uint64_t>(scratch_capacity_, kInitialScratchSize);
+	while (new_capacity < size) {
+		new_capacity *= 2;
+	}
+	ERR_FAIL_COND_V_MSG(ftruncate(scratch_fd_, new_capacity) != 0, false, "Failed to grow generation scratch file.");
+	// 新的映射建立成功后才解除旧的映射，失败时已溢出的区块仍然可以读取
+	void *map = mmap(nullptr, new_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, scratch_fd_, 0);
+	ERR_FAIL_COND_V_MSG(map == MAP_FAILED, false, "Failed to map generation scratch file.");
+	if (scratch_map_) {
+		munmap(scratch_map_, scratch_capacity_);
+	}
+	scratch_map_ = static_cast<char *>(map);
+	scratch_capacity_ = new_capacity;
+	return true;
+}
+
+} //namespace pgvoxel
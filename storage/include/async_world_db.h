@@ -0,0 +1,61 @@
+#pragma once
+
+#include "chunk.h"
+#include "forward.h"
+#include "request_queue.h"
+
+#include "core/variant/dictionary.h"
+
+#include <cstdint>
+#include <future>
+#include <memory>
+
+namespace pgvoxel {
+
+// WorldDB 的异步前端，所有读取都在独立的 I/O 线程中进行，调用方不会被阻塞
+// 回调在 I/O 线程中调用，需要回到主线程时可以在回调中使用 call_deferred
+class AsyncWorldDB {
+public:
+	typedef std::shared_ptr<const LoadedChunk> ChunkResult;
+	typedef RequestQueue<Coord, ChunkResult>::Callback ChunkCallback;
+	typedef RequestQueue<uint64_t, Dictionary>::Callback MetadataCallback;
+	typedef RequestQueue<Coord, ChunkResult>::Submission ChunkSubmission;
+	typedef RequestQueue<uint64_t, Dictionary>::Submission MetadataSubmission;
+	// 各调用方持有自己的 ticket，取消时只影响自己的请求
+	typedef uint64_t Ticket;
+
+	static AsyncWorldDB &singleton() {
+		if (!instance_) [[unlikely]] {
+			instance_ = new AsyncWorldDB();
+		}
+		return *instance_;
+	}
+	// 关闭模块时调用，等待 I/O 线程退出，须在 WorldDB 之前销毁
+	static void destroy() {
+		delete instance_;
+		instance_ = nullptr;
+	}
+
+	// 区块不存在时结果为 nullptr，请求被取消时为 std::nullopt
+	ChunkSubmission requestChunk(const Coord &pos, const int32_t priority, ChunkCallback callback = nullptr);
+	bool reprioritizeChunk(const Coord &pos, const int32_t priority);
+	bool cancelChunk(const Ticket ticket);
+
+	MetadataSubmission requestMetadata(const CoordAxis x, const CoordAxis z, const int32_t priority, MetadataCallback callback = nullptr);
+	bool reprioritizeMetadata(const CoordAxis x, const CoordAxis z, const int32_t priority);
+	bool cancelMetadata(const Ticket ticket);
+
+private:
+	AsyncWorldDB();
+
+	// LMDB 的读事务互不阻塞，少量线程即可让磁盘保持忙碌
+	static const size_t kChunkThreads = 4;
+	static const size_t kMetadataThreads = 1;
+
+	static inline AsyncWorldDB *instance_ = nullptr;
+
+	RequestQueue<Coord, ChunkResult> chunk_queue_;
+	RequestQueue<uint64_t, Dictionary> metadata_queue_;
+};
+
+} //namespace pgvoxel
@@ -52,7 +52,7 @@ public:
 
 	// 序列化/反序列化
 	void serialize(std::ostringstream &oss) const;
-	void deserialize(std::istringstream &iss, const uint32_t size);
+	void deserialize(std::istream &iss, const uint32_t size);
 
 private:
 	CoordAxis width_, height_, depth_;
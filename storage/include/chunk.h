@@ -17,16 +17,23 @@ class Chunk {
     static inline const CoordAxis kWidth = Width;
     static inline const CoordAxis kHeight = Height;
     static inline const uint8_t kDataChunkNums{8};
+    // 每一位对应一个 DataChunk，用于只读取部分层
+    typedef uint8_t LayerMask;
+    static inline const LayerMask kAllLayers{0xFF};
     // 辅助函数，方便创建
     static std::unique_ptr<Chunk<kWidth, Height>> create(const Coord &position) { return std::make_unique<Chunk<kWidth, Height>>(position); }
 
    public:
-    Chunk(const Coord &position) : kPosition(position) {}
+    Chunk(const Coord &position) : position_(position) {}
     // Chunk 太重了，没有理由被整个拷贝
     Chunk(const Chunk<kWidth, Height> &other) = delete;
     Chunk<kWidth, Height> &operator=(const Chunk<kWidth, Height> &other) = delete;
+    // 确实需要副本时显式复制，如从共享的只读缓存中取得可以修改的区块
+    std::unique_ptr<Chunk> clone() const;
 
-    Coord getPosition() const { return kPosition; }
+    Coord getPosition() const { return position_; }
+    // 移动到 position 并清空所有层，相当于重新创建，用于复用同一个区块对象
+    void reset(const Coord &position);
 
     // 单点操作
     void setVoxel(const Coord &pos, const VoxelData data, uint8_t layer);
@@ -46,18 +53,43 @@ class Chunk {
 
     // 序列化/反序列化
     void serialize(std::ostringstream &oss) const;
-    void deserialize(std::istringstream &iss, const uint32_t size);
+    void deserialize(std::istream &iss, const uint32_t size);
+    // 只反序列化 layers 中指定的层，其余层会被跳过并保持为空
+    void deserialize(std::istream &iss, const uint32_t size, const LayerMask layers);
+    // 单独序列化/反序列化一层，用于按层储存
+    void serializeLayer(std::ostringstream &oss, const uint8_t layer) const { oss << dataChunks_[layer]; }
+    void deserializeLayer(std::istream &iss, const uint8_t layer) { iss >> dataChunks_[layer]; }
+
+    // 只读地访问一层，用于统计调色板等信息
+    const DataChunk<kWidth, Height> &getDataChunk(const uint8_t layer) const { return dataChunks_[layer]; }
+
+    // 自上次读取或保存以来被修改过的层。新创建的区块尚未被保存过，所有层都视为已修改
+    LayerMask dirtyLayers() const { return dirty_layers_; }
+    void clearDirty() { dirty_layers_ = 0; }
 
     // 尝试清理冗余数据
     void fit();
 
+    // 区块占用的内存大小（字节），用于缓存的容量统计
+    size_t memoryUsage() const {
+        size_t result = sizeof(*this);
+        for (const auto &dataChunk : dataChunks_) {
+            result += dataChunk.memoryUsage();
+        }
+        return result;
+    }
+
    private:
-    const Coord kPosition;
+    void markDirty(const uint8_t layer) { dirty_layers_ |= static_cast<LayerMask>(1 << layer); }
+
+    Coord position_;
+    LayerMask dirty_layers_{kAllLayers};
     std::array<DataChunk<kWidth, Height>, kDataChunkNums> dataChunks_;
     std::unordered_map<Coord, std::string> metadatas;
 };
 
+// 截取 chunk 中从下往上第 index 个边长为 kWidth 的立方体，包含所有层
 template <CoordAxis kWidth, CoordAxis kHeight>
-Chunk<kWidth, kWidth> slice(const Chunk<kWidth, kHeight> *const chunk, int index);
+std::unique_ptr<Chunk<kWidth, kWidth>> slice(const Chunk<kWidth, kHeight> *const chunk, int index);
 
 }  // namespace pgvoxel
@@ -1,7 +1,8 @@
 #pragma once
 
 #include "chunk.h"
-#include "data_chunk.h"
+#include "data_chunk.inl"
+#include "serialize.h"
 #include <memory>
 
 namespace pgvoxel {
@@ -9,6 +10,7 @@ namespace pgvoxel {
 template <CoordAxis Width, CoordAxis Height>
 void Chunk<Width, Height>::setVoxel(const Coord& pos, const VoxelData data, uint8_t layer) {
     dataChunks_[layer].setVoxel(pos, data);
+    markDirty(layer);
 }
 
 template <CoordAxis Width, CoordAxis Height>
@@ -19,11 +21,13 @@ VoxelData Chunk<Width, Height>::getVoxel(const Coord& pos, uint8_t layer) const
 template <CoordAxis Width, CoordAxis Height>
 void Chunk<Width, Height>::setBar(const Coord& pos, const std::vector<VoxelData>& data, uint8_t layer) {
     dataChunks_[layer].setBar(pos, data);
+    markDirty(layer);
 }
 
 template <CoordAxis Width, CoordAxis Height>
 void Chunk<Width, Height>::setBar(const CoordAxis x, const CoordAxis z, const CoordAxis buttom, const CoordAxis top, const VoxelData data, uint8_t layer) {
     dataChunks_[layer].setBar(x, z, buttom, top, data);
+    markDirty(layer);
 }
 
 template <CoordAxis Width, CoordAxis Height>
@@ -34,11 +38,13 @@ std::vector<VoxelData> Chunk<Width, Height>::getBar(const CoordAxis x, const Coo
 template <CoordAxis Width, CoordAxis Height>
 void Chunk<Width, Height>::setBlock(const Coord& begin, const Coord& end, const VoxelData data, uint8_t layer) {
     dataChunks_[layer].setBlock(begin, end, data);
+    markDirty(layer);
 }
 
 template <CoordAxis Width, CoordAxis Height>
 void Chunk<Width, Height>::setBlock(const Coord& pos, const Buffer& data, uint8_t layer) {
     dataChunks_[layer].setBlock(pos, data);
+    markDirty(layer);
 }
 
 template <CoordAxis Width, CoordAxis Height>
@@ -48,10 +54,12 @@ Buffer Chunk<Width, Height>::getBlock(const Coord& begin, const Coord& end, uint
 template <CoordAxis Width, CoordAxis Height>
 std::unique_ptr<Chunk<Width, Width>> slice(const Chunk<Width, Height>* const sourceChunk, int index) {
 	const auto& pos = sourceChunk->getPosition();
-	auto targetChunk = LoadedChunk::create({pos.x, index * Width, pos.z});
-	for (CoordAxis x = 0; x < Width; ++x) {
-		for (CoordAxis z = 0; z < Width; ++z) {
-			targetChunk->setBar({x, 0, z}, sourceChunk->getBar(x, z, index * Width, (index + 1) * Width));
+	auto targetChunk = Chunk<Width, Width>::create({pos.x, index * Width, pos.z});
+	for (uint8_t layer = 0; layer < Chunk<Width, Height>::kDataChunkNums; ++layer) {
+		for (CoordAxis x = 0; x < Width; ++x) {
+			for (CoordAxis z = 0; z < Width; ++z) {
+				targetChunk->setBar({x, 0, z}, sourceChunk->getBar(x, z, index * Width, (index + 1) * Width, layer), layer);
+			}
 		}
 	}
 
@@ -67,10 +75,52 @@ void Chunk<Width, Height>::serialize(std::ostringstream &oss) const {
 }
 
 template <CoordAxis Width, CoordAxis Height>
-void Chunk<Width, Height>::deserialize(std::istringstream &iss, const uint32_t size) {
+std::unique_ptr<Chunk<Width, Height>> Chunk<Width, Height>::clone() const {
+	auto result = create(position_);
+	result->dataChunks_ = dataChunks_;
+	result->metadatas = metadatas;
+	result->dirty_layers_ = dirty_layers_;
+	return result;
+}
+
+template <CoordAxis Width, CoordAxis Height>
+void Chunk<Width, Height>::reset(const Coord &position) {
+	position_ = position;
+	for (auto& dataChunk: dataChunks_) {
+		dataChunk.clear();
+	}
+	metadatas.clear();
+	dirty_layers_ = kAllLayers;
+}
+
+template <CoordAxis Width, CoordAxis Height>
+void Chunk<Width, Height>::fit() {
+	for (auto& dataChunk: dataChunks_) {
+		dataChunk.fit();
+	}
+}
+
+template <CoordAxis Width, CoordAxis Height>
+void Chunk<Width, Height>::deserialize(std::istream &iss, const uint32_t size) {
 	for (auto& dataChunk: dataChunks_) {
 		iss >> dataChunk;
 	}
+	clearDirty();
+}
+
+template <CoordAxis Width, CoordAxis Height>
+void Chunk<Width, Height>::deserialize(std::istream &iss, const uint32_t size, const LayerMask layers) {
+	for (uint8_t i = 0; i < kDataChunkNums; ++i) {
+		if (layers & (1 << i)) {
+			iss >> dataChunks_[i];
+		} else {
+			// 每个 DataChunk 前都记录了自身的大小，直接跳过即可，无需解压
+			uint32_t data_chunk_size;
+			DESERIALIZE_READ(iss, data_chunk_size);
+			iss.seekg(data_chunk_size, std::ios_base::cur);
+		}
+	}
+	clearDirty();
 }
 
 }  // namespace pgvoxel
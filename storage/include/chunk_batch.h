@@ -0,0 +1,52 @@
+#pragma once
+
+#include "chunk.h"
+#include "chunk_key.h"
+#include "forward.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace pgvoxel {
+
+// 将 kWidth x kWidth 个区块竖列中同一高度的区块储存为 terrain 中的一个值
+// 各区块的每一层是一个独立压缩的段，以组中第一个区块的同一层作为 LZ4 的字典，借此利用相邻区块之间的冗余
+// 值的开头是各段的索引，读取单个区块时只需解压它自己的段和作为字典的段
+// 格式为 [u8 区块数][每个区块的 u8 组内序号][每个区块每层的 Segment][各段压缩后的数据]
+class ChunkBatch {
+public:
+	static const CoordAxis kWidth = 4;
+	// key 后追加的层号，与按层储存的 key 区分
+	static const uint8_t kBatchLayer = 0xFF;
+
+	// pos 所在组的角落，组内各区块的值都储存在角落的 key 下
+	static Coord corner(const Coord &pos) { return { pos.x & ~(kWidth - 1), pos.y, pos.z & ~(kWidth - 1) }; }
+	static std::string key(const Coord &pos) { return ChunkKey(corner(pos)).layerKey(kBatchLayer); }
+	static bool isBatchKey(const std::string_view key) { return key.size() == ChunkKey::kSize + 1 && static_cast<uint8_t>(key.back()) == kBatchLayer; }
+
+	// chunks 须属于同一组，且位于同一高度
+	static std::string encode(const std::vector<const LoadedChunk *> &chunks);
+	// 从 batch 中解码 chunk 所在位置的区块的 layers 层，batch 中没有该区块或数据损坏时返回 false
+	static bool decode(const std::string_view batch, LoadedChunk &chunk, const LoadedChunk::LayerMask layers);
+	static bool contains(const std::string_view batch, const Coord &pos);
+	// batch 中所有区块的位置，corner 为 batch 所在的 key 对应的位置
+	static std::vector<Coord> positions(const std::string_view batch, const Coord &corner);
+
+private:
+	struct Segment {
+		uint32_t offset;
+		uint32_t size;
+		uint32_t raw_size;
+	};
+
+	static uint8_t localIndex(const Coord &pos) { return (pos.x & (kWidth - 1)) * kWidth + (pos.z & (kWidth - 1)); }
+	// pos 处的区块在 batch 中的序号，不存在时返回 -1
+	static int find(const std::string_view batch, const Coord &pos);
+	// 读取第 chunk 个区块第 layer 层的段，越界时返回 false
+	static bool segment(const std::string_view batch, const uint8_t count, const uint8_t chunk, const uint8_t layer, Segment &result);
+	static bool decompress(const std::string_view batch, const uint8_t count, const Segment &segment, const std::string_view dictionary, std::string &raw);
+};
+
+} //namespace pgvoxel
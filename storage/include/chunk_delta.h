@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "chunk.h"
+#include "forward.h"
+#include "serialize.h"
+
+#include "core/error/error_macros.h"
+
+namespace pgvoxel {
+
+// 区块一层相对于基础地形的稀疏差异
+// 由若干竖直方向上的游程组成，每个游程是一个竖列中连续的、值相同且与基础地形不同的一段
+// 玩家的修改通常只涉及少量格子，储存差异要比储存整层小得多
+// 大范围的修改（爆炸、填充等）产生的游程很多，游程的总大小超过该层不经压缩的大小时直接储存整层（经过 LZ4 压缩），首字节的格式标记区分这两种形式
+class ChunkDelta {
+public:
+	// 计算 chunk 的 layer 层相对于 base 的差异，没有差异时返回空字符串
+	template <CoordAxis kWidth, CoordAxis kHeight>
+	static std::string diff(const Chunk<kWidth, kHeight> &base, const Chunk<kWidth, kHeight> &chunk, const uint8_t layer);
+
+	// 将 diff 得到的差异应用到 chunk 的 layer 层上
+	template <CoordAxis kWidth, CoordAxis kHeight>
+	static void apply(Chunk<kWidth, kHeight> &chunk, const uint8_t layer, const std::string_view delta);
+
+private:
+	enum Format : uint8_t {
+		// [u32 游程数][各游程]
+		kRuns,
+		// 修改后的整层，以 Chunk::serializeLayer 的格式储存，应用时替换整层
+		kLayer
+	};
+
+	// 竖列坐标与高度都以 16 位储存
+	struct Run {
+		uint16_t x;
+		uint16_t z;
+		uint16_t buttom;
+		uint16_t length;
+		VoxelData data;
+	};
+	// 一个游程序列化后的大小
+	static constexpr size_t kRunSize = 4 * sizeof(uint16_t) + sizeof(VoxelData);
+};
+
+template <CoordAxis kWidth, CoordAxis kHeight>
+std::string ChunkDelta::diff(const Chunk<kWidth, kHeight> &base, const Chunk<kWidth, kHeight> &chunk, const uint8_t layer) {
+	static_assert(kWidth <= UINT16_MAX && kHeight <= UINT16_MAX);
+
+	// 游程超过这个数量时整层更小，不再继续统计，也不必序列化游程
+	const size_t max_runs = chunk.getDataChunk(layer).packedSize() / kRunSize;
+	std::vector<Run> runs;
+	for (CoordAxis x = 0; x < kWidth && runs.size() <= max_runs; ++x) {
+		for (CoordAxis z = 0; z < kWidth && runs.size() <= max_runs; ++z) {
+			const auto base_bar = base.getBar(x, z, 0, kHeight, layer);
+			const auto bar = chunk.getBar(x, z, 0, kHeight, layer);
+			for (CoordAxis y = 0; y < kHeight;) {
+				if (bar[y] == base_bar[y]) {
+					++y;
+					continue;
+				}
+				// 延伸到值改变或与基础地形相同为止
+				CoordAxis end = y + 1;
+				while (end < kHeight && bar[end] == bar[y] && bar[end] != base_bar[end]) {
+					++end;
+				}
+				runs.push_back({ static_cast<uint16_t>(x), static_cast<uint16_t>(z), static_cast<uint16_t>(y), static_cast<uint16_t>(end - y), bar[y] });
+				y = end;
+			}
+		}
+	}
+	if (runs.empty()) {
+		return {};
+	}
+	if (runs.size() > max_runs) {
+		std::ostringstream oss;
+		const uint8_t format = kLayer;
+		SERIALIZE_WRITE(oss, format);
+		chunk.serializeLayer(oss, layer);
+		return std::move(oss).str();
+	}
+
+	std::ostringstream oss;
+	const uint8_t format = kRuns;
+	SERIALIZE_WRITE(oss, format);
+	const uint32_t count = runs.size();
+	SERIALIZE_WRITE(oss, count);
+	for (const Run &run : runs) {
+		SERIALIZE_WRITE(oss, run.x);
+		SERIALIZE_WRITE(oss, run.z);
+		SERIALIZE_WRITE(oss, run.buttom);
+		SERIALIZE_WRITE(oss, run.length);
+		SERIALIZE_WRITE(oss, run.data);
+	}
+	return std::move(oss).str();
+}
+
+template <CoordAxis kWidth, CoordAxis kHeight>
+void ChunkDelta::apply(Chunk<kWidth, kHeight> &chunk, const uint8_t layer, const std::string_view delta) {
+	ViewStream iss(delta);
+	uint8_t format;
+	DESERIALIZE_READ(iss, format);
+	if (format == kLayer) {
+		chunk.deserializeLayer(iss, layer);
+		return;
+	}
+	ERR_FAIL_COND_MSG(format != kRuns, "Unknown chunk delta format.");
+	uint32_t count;
+	DESERIALIZE_READ(iss, count);
+	Run run;
+	for (uint32_t i = 0; i < count && iss; ++i) {
+		DESERIALIZE_READ(iss, run.x);
+		DESERIALIZE_READ(iss, run.z);
+		DESERIALIZE_READ(iss, run.buttom);
+		DESERIALIZE_READ(iss, run.length);
+		DESERIALIZE_READ(iss, run.data);
+		chunk.setBar(run.x, run.z, run.buttom, run.buttom + run.length, run.data, layer);
+	}
+}
+
+} // namespace pgvoxel
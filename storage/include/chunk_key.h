@@ -0,0 +1,157 @@
+#pragma once
+
+#include "forward.h"
+
+#include <lmdb.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace pgvoxel {
+
+// 所有数据库共用的 key
+// 高 52 位是 z, x 交错得到的 Morton 码，低 12 位是 y，整体按大端序储存
+// 大端序使 key 的字节序与数值大小一致，因此空间上相邻的区块在 B 树中也大概率相邻，区域查询可以转化为连续的 cursor 遍历
+class ChunkKey {
+public:
+	// x, z 上限为 2^26 - 1, y 上限为 2^12 - 1，与 global_pos_to_index 一致
+	static const uint8_t kAxisBits = 26;
+	static const uint8_t kHeightBits = 12;
+	static const uint8_t kSize = sizeof(uint64_t);
+
+	explicit ChunkKey(const uint64_t value) {
+		for (int i = kSize - 1; i >= 0; --i) {
+			bytes_[kSize - 1 - i] = static_cast<uint8_t>(value >> (i * 8));
+		}
+	}
+	ChunkKey(const CoordAxis x, const CoordAxis y, const CoordAxis z) :
+			ChunkKey(encode(x, y, z)) {}
+	explicit ChunkKey(const Coord &pos) :
+			ChunkKey(pos.x, pos.y, pos.z) {}
+
+	// 从数据库返回的 key 中恢复
+	static ChunkKey fromBytes(const void *data) {
+		const auto bytes = static_cast<const uint8_t *>(data);
+		uint64_t value{ 0 };
+		for (int i = 0; i < kSize; ++i) {
+			value = value << 8 | bytes[i];
+		}
+		return ChunkKey(value);
+	}
+
+	uint64_t value() const {
+		uint64_t value{ 0 };
+		for (const auto byte : bytes_) {
+			value = value << 8 | byte;
+		}
+		return value;
+	}
+
+	Coord position() const {
+		const uint64_t v = value();
+		const uint64_t morton = v >> kHeightBits;
+		return { compact(morton), v & ((1ULL << kHeightBits) - 1), compact(morton >> 1) };
+	}
+
+	// 返回的 MDB_val 和 string_view 指向 key 内部的数据，使用期间 key 必须有效
+	MDB_val val() const { return { kSize, const_cast<uint8_t *>(bytes_.data()) }; }
+	std::string_view bytes() const { return { reinterpret_cast<const char *>(bytes_.data()), kSize }; }
+
+	// 按层储存时各层的 key，在区块的 key 之后追加层号，同一区块的各层在数据库中相邻
+	// 它们都排在下一个区块的 key 之前，也排在旧版本整个区块储存在一起时使用的 key 之后
+	std::string layerKey(const uint8_t layer) const {
+		std::string result{ bytes() };
+		result.push_back(static_cast<char>(layer));
+		return result;
+	}
+
+	static uint64_t encode(const CoordAxis x, const CoordAxis y, const CoordAxis z) {
+		return (spread(z) << 1 | spread(x)) << kHeightBits | (y & ((1ULL << kHeightBits) - 1));
+	}
+
+	// 区域 [min, max) 中大于等于 key 的最小 key，若不存在则返回 false
+	// 用于在 cursor 遍历时跳过落在区域外的 key，而不必逐个访问
+	static bool nextInRegion(const uint64_t key, const Coord &min, const Coord &max, uint64_t &next) {
+		if (min.x >= max.x || min.y >= max.y || min.z >= max.z) {
+			return false;
+		}
+		const uint64_t y_mask = (1ULL << kHeightBits) - 1;
+		const uint64_t min_morton = spread(min.z) << 1 | spread(min.x);
+		const uint64_t max_morton = spread(max.z - 1) << 1 | spread(max.x - 1);
+		uint64_t morton = key >> kHeightBits;
+		uint64_t y = key & y_mask;
+
+		while (morton <= max_morton) {
+			const CoordAxis x = compact(morton), z = compact(morton >> 1);
+			if (x >= min.x && x < max.x && z >= min.z && z < max.z) {
+				if (y < max.y) {
+					next = morton << kHeightBits | std::max<uint64_t>(y, min.y);
+					return true;
+				}
+				// 当前竖列已经遍历完，前进到下一个竖列
+				++morton;
+				y = min.y;
+			} else {
+				morton = bigMin(morton, min_morton, max_morton);
+				y = min.y;
+			}
+		}
+		return false;
+	}
+
+	bool operator==(const ChunkKey &other) const { return bytes_ == other.bytes_; }
+	bool operator<(const ChunkKey &other) const { return bytes_ < other.bytes_; }
+
+private:
+	// 在每一位之间插入一个 0，即 Morton 码中单个轴的部分
+	static uint64_t spread(uint64_t v) {
+		v &= (1ULL << kAxisBits) - 1;
+		v = (v | v << 16) & 0x0000FFFF0000FFFFULL;
+		v = (v | v << 8) & 0x00FF00FF00FF00FFULL;
+		v = (v | v << 4) & 0x0F0F0F0F0F0F0F0FULL;
+		v = (v | v << 2) & 0x3333333333333333ULL;
+		v = (v | v << 1) & 0x5555555555555555ULL;
+		return v;
+	}
+
+	// spread 的逆操作
+	static uint64_t compact(uint64_t v) {
+		v &= 0x5555555555555555ULL;
+		v = (v | v >> 1) & 0x3333333333333333ULL;
+		v = (v | v >> 2) & 0x0F0F0F0F0F0F0F0FULL;
+		v = (v | v >> 4) & 0x00FF00FF00FF00FFULL;
+		v = (v | v >> 8) & 0x0000FFFF0000FFFFULL;
+		v = (v | v >> 16) & 0x00000000FFFFFFFFULL;
+		return v;
+	}
+
+	// Tropf-Herzog BIGMIN，计算 z, x 构成的矩形中大于 morton 的最小 Morton 码
+	// 调用方需保证 morton 不在矩形中，且小于 max_morton
+	static uint64_t bigMin(const uint64_t morton, uint64_t min_morton, uint64_t max_morton) {
+		uint64_t result{ 0 };
+		for (int bit = kAxisBits * 2 - 1; bit >= 0; --bit) {
+			const uint64_t mask = 1ULL << bit;
+			// 与当前位属于同一个轴的所有低位
+			const uint64_t lower = (0x5555555555555555ULL << (bit & 1)) & (mask - 1);
+			const bool v = morton & mask, lo = min_morton & mask, hi = max_morton & mask;
+			if (!v && !lo && hi) {
+				result = (min_morton | mask) & ~lower;
+				max_morton = (max_morton & ~mask) | lower;
+			} else if (!v && lo && hi) {
+				return min_morton;
+			} else if (v && !lo && !hi) {
+				return result;
+			} else if (v && !lo && hi) {
+				min_morton = (min_morton | mask) & ~lower;
+			}
+		}
+		return result;
+	}
+
+	std::array<uint8_t, kSize> bytes_;
+};
+
+} //namespace pgvoxel
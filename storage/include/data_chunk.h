@@ -11,6 +11,12 @@
 
 namespace pgvoxel {
 
+// 当前线程序列化 DataChunk 时使用的 LZ4HC 压缩等级，为 0 时使用更快的 LZ4_compress_default
+// 压缩更慢但解压速度不变，适合离线压缩等对写入速度不敏感的场合
+// 为 kDataChunkUncompressed 时不压缩，读取时省去解压，用于打包世界中经常访问的区域
+inline thread_local int data_chunk_compression_level = 0;
+inline constexpr int kDataChunkUncompressed = -1;
+
 // DataChunk 是一个长宽均为 kWidth，高为 kHeight 的立方体，采用 Palette + PackedArray 的方式减小数据体积
 // 局部坐标按照 vec3_to_index 的规定映射到 data 中的序号
 template <CoordAxis kWidth, CoordAxis kHeight>
@@ -20,6 +26,8 @@ class DataChunk {
     inline static const uint8_t kWidthBits = std::bit_width(kWidth - 1);
     inline static const uint8_t kHeightBits = std::bit_width(kHeight - 1);
     static uint64_t pos_to_index(const Coord &pos) { return pgvoxel::pos_to_index(pos, kWidthBits, kHeightBits); }
+    // 序列化时写在未压缩大小的最高位，表示其后的数据没有压缩
+    static constexpr uint32_t kUncompressedFlag{1u << 31};
 
    public:
     // 单点操作
@@ -40,12 +48,24 @@ class DataChunk {
 
     // 序列化/反序列化
     void serialize(std::ostringstream &oss) const;
-    void deserialize(std::istringstream &iss, const uint32_t size);
+    void deserialize(std::istream &iss, const uint32_t size);
 
     std::string toString() const;
 
+    // 调色板中元素的数量和每个格子占用的位数，用于统计
+    size_t paletteSize() const { return palette_.size(); }
+    uint8_t bitWidth() const { return data_.elementBitWidth(); }
+
+    // 不经压缩时调色板与数据序列化后的大小（字节），调色板每项为 [序号][值][引用数]
+    size_t packedSize() const { return palette_.size() * 3 * sizeof(VoxelData) + (kSize * uint64_t{bitWidth()} + CHAR_BIT - 1) / CHAR_BIT; }
+
+    // 调色板和数据实际占用的堆内存大小（字节）
+    size_t memoryUsage() const { return palette_.memoryUsage() + data_.memoryUsage(); }
+
     // 尝试清除冗余数据
     void fit();
+    // 恢复为全部是 0 的初始状态
+    void clear();
 
    private:
     static constexpr VoxelData kSize{kWidth * kWidth * kHeight};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <lz4.h>
+#include <lz4hc.h>
 
 #include <cstddef>
 #include <sstream>
@@ -10,6 +11,7 @@
 
 #include "data_chunk.h"
 #include "forward.h"
+#include "packed_array.inl"
 #include "palette.inl"
 #include "serialize.h"
 
@@ -119,13 +121,23 @@ void DataChunk<kWidth, kHeight>::serialize(std::ostringstream &oss) const {
 
     // 写入未压缩时数据的大小
     uint32_t size{static_cast<uint32_t>(data.size())};
+    if (data_chunk_compression_level == kDataChunkUncompressed) {
+        const uint32_t flagged_size = size | kUncompressedFlag;
+        oss.write(reinterpret_cast<const char *>(&flagged_size), sizeof(flagged_size));
+        oss.write(data.data(), size);
+        return;
+    }
     oss.write(reinterpret_cast<const char *>(&size), sizeof(size));
 
-    // 使用LZ4压缩
+    // 使用LZ4压缩，配置了压缩等级时使用 LZ4HC，两者的输出格式相同
     std::string buffer;
     buffer.resize(LZ4_COMPRESSBOUND(size));
     // 此处 size 表示压缩后数据的大小
-    size = LZ4_compress_default(data.data(), buffer.data(), size, buffer.size());
+    if (data_chunk_compression_level > 0) {
+        size = LZ4_compress_HC(data.data(), buffer.data(), size, buffer.size(), data_chunk_compression_level);
+    } else {
+        size = LZ4_compress_default(data.data(), buffer.data(), size, buffer.size());
+    }
     if (size <= 0) [[unlikely]] {
         throw std::runtime_error("Chunk compression failed!");
     }
@@ -134,28 +146,40 @@ void DataChunk<kWidth, kHeight>::serialize(std::ostringstream &oss) const {
 }
 
 template <CoordAxis kWidth, CoordAxis kHeight>
-void DataChunk<kWidth, kHeight>::deserialize(std::istringstream &iss, const uint32_t size) {
+void DataChunk<kWidth, kHeight>::deserialize(std::istream &iss, const uint32_t size) {
     // 读取未压缩时数据的大小
     uint32_t original_size;
     iss.read(reinterpret_cast<char *>(&original_size), sizeof(original_size));
 
+    // 没有压缩的数据直接反序列化
+    if (original_size & kUncompressedFlag) {
+        iss >> palette_ >> data_;
+        return;
+    }
+
     // 分配足够的空间来存储解压后的数据
     std::string decompressedData;
     decompressedData.resize(original_size);
 
-    // 读取压缩过数据
-    std::string compressedData;
-    compressedData.resize(size);
-    iss.read(compressedData.data(), size);
+    // 读取压缩过数据，size 包含了 original_size 本身
+    // 从 ViewStream 读取时直接解压其引用的内存，不再复制一次
+    std::string_view compressedData;
+    std::string compressedCopy;
+    auto *view = dynamic_cast<ViewStreamBuf *>(iss.rdbuf());
+    if (!view || !view->take(size - sizeof(original_size), compressedData)) {
+        compressedCopy.resize(size - sizeof(original_size));
+        iss.read(compressedCopy.data(), compressedCopy.size());
+        compressedData = compressedCopy;
+    }
 
     // 使用LZ4解压
-    int decompressedSize = LZ4_decompress_safe(compressedData.data(), decompressedData.data(), size - sizeof(original_size), original_size);
+    int decompressedSize = LZ4_decompress_safe(compressedData.data(), decompressedData.data(), compressedData.size(), original_size);
     if (decompressedSize <= 0) [[unlikely]] {
         throw std::runtime_error("Chunk decompression failed!");
     }
 
     // 反序列化解压后的数据
-    std::istringstream iss_uncompressed(decompressedData);
+    ViewStream iss_uncompressed(decompressedData);
     iss_uncompressed >> palette_ >> data_;
 }
 
@@ -173,8 +197,23 @@ std::string DataChunk<kWidth, kHeight>::toString() const {
 
 template <CoordAxis kWidth, CoordAxis kHeight>
 void DataChunk<kWidth, kHeight>::fit() {
-    palette_.fit();
+    // 调色板移除空位后，index 只会变小，因此可以在原有的位宽下直接改写
+    const auto remap = palette_.fit();
+    if (!remap.empty()) {
+        auto indices = data_.getRange(0, data_.size());
+        for (auto &index : indices) {
+            index = remap[index];
+        }
+        data_.setRange(0, data_.size(), indices);
+    }
     data_.fit();
 }
 
+template <CoordAxis kWidth, CoordAxis kHeight>
+void DataChunk<kWidth, kHeight>::clear() {
+    palette_.clear();
+    // 位宽为 0 时不占用任何内存
+    data_ = PackedArray<>{kSize};
+}
+
 }  // namespace pgvoxel
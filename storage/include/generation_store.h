@@ -0,0 +1,93 @@
+#pragma once
+
+#include "chunk.h"
+#include "forward.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+namespace pgvoxel {
+
+// 生成期间各层之间传递 GenerationChunk 的内存存储，接口与 WorldDB 中基于 LMDB 的实现相同
+// 区块以序列化（各层 LZ4 压缩）后的形式保存，省去了每个区块每层一次的 LMDB 写入、提交和读取
+// 内存中的数据超出预算后，新写入的区块会溢出到 mmap 映射的临时文件中，由操作系统负责换页
+// 临时文件中被删除或覆盖的区块留下的空间记入空闲列表，之后溢出的区块优先复用
+class GenerationStore {
+public:
+	GenerationStore(const size_t memory_budget, const std::string &scratch_path);
+	~GenerationStore();
+	GenerationStore(const GenerationStore &) = delete;
+	GenerationStore &operator=(const GenerationStore &) = delete;
+
+	std::unique_ptr<GenerationChunk> load(const CoordAxis x, const CoordAxis z, const uint16_t version);
+	// 读取到已有的 chunk 中，位置由 chunk 决定。不存在时返回 false
+	bool load(GenerationChunk &chunk, const uint16_t version);
+	// 溢出到临时文件失败时返回 false，此时区块没有被保存，生成应当中止
+	bool save(GenerationChunk *chunk, const uint16_t version);
+	void erase(const CoordAxis x, const CoordAxis z, const uint16_t version);
+
+	size_t memoryUsage() const { return memory_usage_; }
+	// 临时文件中已使用的长度，包括空闲列表中的空间
+	size_t spilledSize() const {
+		std::lock_guard<std::mutex> lock(scratch_alloc_mtx_);
+		return scratch_end_;
+	}
+
+private:
+	// 溢出到临时文件中的区块只记录位置
+	struct Entry {
+		std::string data;
+		uint64_t offset{ 0 };
+		uint64_t size{ 0 };
+		bool spilled{ false };
+	};
+
+	struct Shard {
+		std::mutex mtx;
+		std::unordered_map<uint64_t, Entry> entries;
+	};
+
+	static const size_t kShardCount = 16;
+	// 临时文件初始大小，之后按两倍增长
+	static constexpr size_t kInitialScratchSize = 67108864;
+
+	Shard &shardOf(const uint64_t key) { return shards_[(key * 0x9E3779B97F4A7C15ULL >> 32) % kShardCount]; }
+
+	// 在预算内为 size 字节的内存数据记账，超出预算时返回 false
+	bool reserveMemory(const size_t size);
+	// 将数据写入临时文件中，返回写入的位置，失败时返回 UINT64_MAX
+	uint64_t spill(const std::string &data);
+	// 在临时文件中分配和释放一段空间，调用时需持有 scratch_alloc_mtx_
+	uint64_t allocateScratch(const uint64_t size);
+	void releaseScratch(uint64_t offset, uint64_t size);
+	// 释放 entry 占用的内存预算或临时文件空间
+	void release(const Entry &entry);
+	// 确保临时文件至少有 size 字节，必要时重新映射。失败时原有的映射保持不变
+	bool reserveScratch(const uint64_t size);
+
+	const size_t memory_budget_;
+	std::atomic<size_t> memory_usage_{ 0 };
+	std::array<Shard, kShardCount> shards_;
+
+	const std::string scratch_path_;
+	int scratch_fd_{ -1 };
+	char *scratch_map_{ nullptr };
+	uint64_t scratch_capacity_{ 0 };
+	// 临时文件中的空间分配，scratch_end_ 之后的部分未被使用
+	// 空闲的区间按位置和按大小各索引一份，按位置的索引用于释放时与相邻的区间合并
+	mutable std::mutex scratch_alloc_mtx_;
+	uint64_t scratch_end_{ 0 };
+	std::map<uint64_t, uint64_t> free_by_offset_;
+	std::multimap<uint64_t, uint64_t> free_by_size_;
+	// 访问映射的内存时持有共享锁，重新映射时需要独占
+	std::shared_mutex scratch_mtx_;
+};
+
+} //namespace pgvoxel
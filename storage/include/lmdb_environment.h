@@ -0,0 +1,104 @@
+#pragma once
+
+#include "storage_backend.h"
+
+#include "core/error/error_macros.h"
+
+#include <lmdb.h>
+
+#include <array>
+#include <cstdint>
+#include <initializer_list>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#define MDB_CALL(ERR_RETVAL, MDB_FUNC, ...)           \
+	do {                                              \
+		if (const auto err = MDB_FUNC(__VA_ARGS__)) { \
+			ERR_PRINT(mdb_strerror(err));             \
+			return ERR_RETVAL;                        \
+		}                                             \
+	} while (false)
+
+namespace pgvoxel {
+
+// 一个 LMDB 环境及其中的各个数据库
+// LMDB 每个环境同时只允许一个写者，WorldDB 可以把世界分散到多个环境中以并行写入
+class LmdbEnvironment : public StorageBackend {
+public:
+	// 持有一个读事务和游标，从头沿 key 的顺序遍历一个数据库
+	// 用于需要同时遍历多个环境的场合，如合并分片。存活期间会阻止该环境调整 map size
+	class Cursor {
+	public:
+		Cursor(LmdbEnvironment &env, const Table table);
+		~Cursor();
+		Cursor(const Cursor &) = delete;
+		Cursor &operator=(const Cursor &) = delete;
+
+		// 游标是否指向一条数据，遍历结束或出错时为 false
+		bool valid() const { return err_ == MDB_SUCCESS; }
+		// 出错时返回 false，遍历正常结束不算出错
+		bool ok() const { return err_ == MDB_SUCCESS || err_ == MDB_NOTFOUND; }
+		// 返回的数据在游标析构前一直有效
+		std::string_view key() const { return toView(key_); }
+		std::string_view value() const { return toView(value_); }
+		void next();
+
+	private:
+		std::shared_lock<std::shared_mutex> env_lock_;
+		MDB_txn *txn_{};
+		MDB_cursor *cursor_{};
+		MDB_val key_{}, value_{};
+		int err_{ MDB_NOTFOUND };
+	};
+
+	// 打开时创建并打开 tables 中的数据库，generation 只在生成期间打开
+	LmdbEnvironment(const std::string &path, const size_t mapsize, const std::initializer_list<Table> tables = { kMetadataTable, kTerrainTable });
+	~LmdbEnvironment() override;
+
+	// 在读事务中读取，scan 在事务提交前调用 finish
+	bool get(const Table table, const std::string_view key, const Reader &reader) override;
+	bool scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) override;
+
+	// 在一个写事务中写入，append 时使用 MDB_APPEND，key 不大于已有的 key 时退回普通写入。map 写满时会扩大 map size 后整批重试
+	bool putBatch(const Table table, const Batch &entries, const bool append = false) override;
+	bool del(const Table table, const std::string_view key) override;
+
+	bool openTable(const Table table) override;
+	bool dropTable(const Table table) override;
+
+	// 写事务均以 MDB_NOSYNC 提交，需要时再刷到磁盘
+	bool flush() override;
+	// 最近一次提交的写事务的 id
+	uint64_t version() const override;
+
+	// 读取数据库的统计信息，用于计算占用的页数
+	bool stat(const Table table, MDB_stat &result);
+
+	MDB_env *env() const { return env_; }
+	MDB_dbi dbi(const Table table) const { return dbis_[table]; }
+	size_t mapsize() const { return mapsize_; }
+
+private:
+	static const MDB_dbi kMaxdbs = 8;
+	static const mdb_mode_t kPermission = 0664;
+	// map 写满时按此倍数扩大
+	static const size_t kMapsizeGrowthFactor = 2;
+
+	static MDB_val toVal(const std::string_view view) { return { view.size(), const_cast<char *>(view.data()) }; }
+	static std::string_view toView(const MDB_val &val) { return { static_cast<const char *>(val.mv_data), val.mv_size }; }
+
+	// 将 map size 从 current 扩大，若其他线程已经扩大过则什么也不做
+	bool growMapsize(const size_t current);
+
+	MDB_env *env_{};
+	size_t mapsize_{};
+	std::array<MDB_dbi, kTableCount> dbis_{};
+	// 所有事务都持有 env_mtx_ 的共享锁，调整 map size 时需要独占，以保证没有活动中的事务
+	std::shared_mutex env_mtx_;
+};
+
+} //namespace pgvoxel
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+
+namespace pgvoxel {
+
+// 按字节预算淘汰的并发 LRU 缓存
+// key 按哈希分散到多个 shard 中，每个 shard 各自加锁、各自维护 LRU 顺序，预算也均分到每个 shard
+// 条目的大小由调用方在插入时给出，Value 应当是可以廉价拷贝的类型，比如 shared_ptr
+// 可以设置淘汰回调，用于把被淘汰的条目转移到下一级缓存中
+template <typename Key, typename Value, size_t kShardCount = 16>
+class ShardedLruCache {
+public:
+	struct Stats {
+		uint64_t hits, misses, evictions;
+		size_t bytes, entries;
+	};
+	// 在调用 put 的线程中、释放 shard 的锁之后调用，只有因超出预算被淘汰的条目会触发
+	typedef std::function<void(const Key &, Value &&)> EvictionHandler;
+
+	explicit ShardedLruCache(const size_t budget) { setBudget(budget); }
+	ShardedLruCache(const ShardedLruCache &) = delete;
+	ShardedLruCache &operator=(const ShardedLruCache &) = delete;
+
+	// 命中时将条目移到最近使用的位置
+	std::optional<Value> get(const Key &key) {
+		auto &shard = shardOf(key);
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		auto iter = shard.index.find(key);
+		if (iter == shard.index.end()) {
+			misses_.fetch_add(1, std::memory_order_relaxed);
+			return std::nullopt;
+		}
+		hits_.fetch_add(1, std::memory_order_relaxed);
+		shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+		return iter->second->value;
+	}
+
+	// 插入或替换条目，超出预算时从最久未使用的条目开始淘汰
+	// 单个条目超过 shard 预算时不会被缓存
+	void put(const Key &key, Value value, const size_t bytes) {
+		auto &shard = shardOf(key);
+		std::unique_lock<std::mutex> lock(shard.mtx);
+		eraseLocked(shard, key);
+		if (bytes > shard_budget_) {
+			return;
+		}
+		std::list<Entry> victims = insertLocked(shard, key, std::move(value), bytes);
+		lock.unlock();
+		handleEvictions(victims);
+	}
+
+	// 命中时返回已有的值，否则在同一次加锁中插入 make() 的结果并返回
+	// 并发的多个调用者因此总是得到同一个值，比如一个可以共享的加载中的槽位。make 在持有 shard 的锁时调用，应当足够廉价
+	template <typename Make>
+	Value getOrPut(const Key &key, const Make &make, const size_t bytes) {
+		auto &shard = shardOf(key);
+		std::unique_lock<std::mutex> lock(shard.mtx);
+		auto iter = shard.index.find(key);
+		if (iter != shard.index.end()) {
+			hits_.fetch_add(1, std::memory_order_relaxed);
+			shard.lru.splice(shard.lru.begin(), shard.lru, iter->second);
+			return iter->second->value;
+		}
+		misses_.fetch_add(1, std::memory_order_relaxed);
+		Value value = make();
+		if (bytes > shard_budget_) {
+			return value;
+		}
+		std::list<Entry> victims = insertLocked(shard, key, value, bytes);
+		lock.unlock();
+		handleEvictions(victims);
+		return value;
+	}
+
+	void erase(const Key &key) {
+		auto &shard = shardOf(key);
+		std::lock_guard<std::mutex> lock(shard.mtx);
+		eraseLocked(shard, key);
+	}
+
+	void clear() {
+		for (auto &shard : shards_) {
+			std::lock_guard<std::mutex> lock(shard.mtx);
+			shard.lru.clear();
+			shard.index.clear();
+			shard.bytes = 0;
+		}
+	}
+
+	// 应在开始使用缓存前设置
+	void setEvictionHandler(EvictionHandler handler) { eviction_handler_ = std::move(handler); }
+
+	// 修改预算不会立即淘汰条目，超出的部分会在之后的插入中被淘汰
+	void setBudget(const size_t budget) { shard_budget_ = budget / kShardCount; }
+	size_t getBudget() const { return shard_budget_ * kShardCount; }
+
+	Stats stats() const {
+		Stats result{ hits_.load(), misses_.load(), evictions_.load(), 0, 0 };
+		for (auto &shard : shards_) {
+			std::lock_guard<std::mutex> lock(shard.mtx);
+			result.bytes += shard.bytes;
+			result.entries += shard.index.size();
+		}
+		return result;
+	}
+
+private:
+	struct Entry {
+		Key key;
+		Value value;
+		size_t bytes;
+	};
+
+	struct Shard {
+		mutable std::mutex mtx;
+		std::list<Entry> lru;
+		std::unordered_map<Key, typename std::list<Entry>::iterator> index;
+		size_t bytes{ 0 };
+	};
+
+	Shard &shardOf(const Key &key) {
+		// 部分 key 的哈希低位分布很差（比如 Coord 的哈希低位是 y），先打散再取模
+		const uint64_t hash = std::hash<Key>{}(key) * 0x9E3779B97F4A7C15ULL;
+		return shards_[(hash >> 32) % kShardCount];
+	}
+
+	// 插入条目并淘汰超出预算的部分，返回被淘汰的条目，由调用方在释放锁后交给淘汰回调
+	std::list<Entry> insertLocked(Shard &shard, const Key &key, Value value, const size_t bytes) {
+		shard.lru.push_front({ key, std::move(value), bytes });
+		shard.index.emplace(key, shard.lru.begin());
+		shard.bytes += bytes;
+
+		std::list<Entry> victims;
+		while (shard.bytes > shard_budget_) {
+			auto &victim = shard.lru.back();
+			shard.bytes -= victim.bytes;
+			shard.index.erase(victim.key);
+			victims.splice(victims.end(), shard.lru, std::prev(shard.lru.end()));
+			evictions_.fetch_add(1, std::memory_order_relaxed);
+		}
+		return victims;
+	}
+
+	void handleEvictions(std::list<Entry> &victims) {
+		if (eviction_handler_) {
+			for (auto &victim : victims) {
+				eviction_handler_(victim.key, std::move(victim.value));
+			}
+		}
+	}
+
+	void eraseLocked(Shard &shard, const Key &key) {
+		auto iter = shard.index.find(key);
+		if (iter != shard.index.end()) {
+			shard.bytes -= iter->second->bytes;
+			shard.lru.erase(iter->second);
+			shard.index.erase(iter);
+		}
+	}
+
+	std::array<Shard, kShardCount> shards_;
+	EvictionHandler eviction_handler_;
+	std::atomic<size_t> shard_budget_;
+	std::atomic<uint64_t> hits_{ 0 }, misses_{ 0 }, evictions_{ 0 };
+};
+
+} //namespace pgvoxel
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "storage_backend.h"
+
+#include <array>
+#include <atomic>
+#include <map>
+#include <shared_mutex>
+#include <string>
+
+namespace pgvoxel {
+
+// 完全保存在内存中的存储，不会持久化，用于测试和对比各存储的性能
+class MemoryBackend : public StorageBackend {
+public:
+	MemoryBackend() :
+			StorageBackend("") {}
+
+	bool get(const Table table, const std::string_view key, const Reader &reader) override;
+	// 遍历期间持有数据库的共享锁，写入会被阻塞到遍历结束
+	bool scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) override;
+
+	bool putBatch(const Table table, const Batch &entries, const bool append = false) override;
+	bool del(const Table table, const std::string_view key) override;
+
+	bool openTable(const Table) override { return true; }
+	bool dropTable(const Table table) override;
+
+	bool flush() override { return true; }
+	uint64_t version() const override { return 0; }
+
+private:
+	struct Store {
+		std::shared_mutex mtx;
+		std::map<std::string, std::string, std::less<>> entries;
+	};
+
+	std::array<Store, kTableCount> stores_;
+};
+
+} //namespace pgvoxel
@@ -32,6 +32,7 @@ class PackedArray {
           data_((size * element_bit_width_ + kUnitBitWidth - 1) / kUnitBitWidth) {}
     size_type size() const { return size_; }
     ValueType elementCapacity() const { return element_capacity_; }
+    uint8_t elementBitWidth() const { return element_bit_width_; }
     bool empty() const { return size_ == 0; }
 
     void resize(const size_type size);
@@ -49,10 +50,13 @@ class PackedArray {
 
     // 序列化/反序列化
     void serialize(std::ostringstream &oss) const;
-    void deserialize(std::istringstream &iss, const uint32_t size);
+    void deserialize(std::istream &iss, const uint32_t size);
 
     std::string toString() const;
 
+    // 实际占用的堆内存大小（字节）
+    size_t memoryUsage() const { return data_.capacity() * sizeof(ValueType); }
+
     Access operator[](const int32_t index);
     ValueType operator[](const int32_t index) const;
 
@@ -205,19 +209,19 @@ inline ValueType PackedArray<ValueType>::operator[](const PackedArray<ValueType>
 
 template <typename ValueType>
 inline PackedArray<ValueType>::iterator PackedArray<ValueType>::begin() {
-    return iterator(this, 0);
+    return iterator(*this, 0);
 }
 template <typename ValueType>
 inline PackedArray<ValueType>::iterator PackedArray<ValueType>::end() {
-    return iterator(this, size_);
+    return iterator(*this, size_);
 }
 template <typename ValueType>
 inline PackedArray<ValueType>::const_iterator PackedArray<ValueType>::cbegin() const {
-    return const_iterator(this, 0);
+    return const_iterator(*this, 0);
 }
 template <typename ValueType>
 inline PackedArray<ValueType>::const_iterator PackedArray<ValueType>::cend() const {
-    return const_iterator(this, size_);
+    return const_iterator(*this, size_);
 }
 
 }  // namespace pgvoxel
@@ -1,3 +1,5 @@
+#pragma once
+
 #include "packed_array.h"
 #include "../../common/include/serialize.h"
 #include <algorithm>
@@ -37,7 +39,7 @@ ValueType PackedArray<ValueType>::get(const size_type index) const {
 	ValueType result{ static_cast<ValueType>((data_[index_in_data] >> index_in_unit) & element_capacity_) };
 	if (index_in_unit + element_bit_width_ > kUnitBitWidth) {
 		// 读取超出当前unit的位
-		result |= ((data_[index_in_data + 1] << index_in_unit) & element_capacity_);
+		result |= ((data_[index_in_data + 1] << (kUnitBitWidth - index_in_unit)) & element_capacity_);
 	}
 
 	return result;
@@ -65,6 +67,11 @@ void PackedArray<ValueType>::setRange(const size_type begin, const size_type end
 		throw std::out_of_range(std::format("PackedArray: range ({}, {}) to set out of range!", begin, end));
 	}
 
+	// 宽度为 0 时所有元素都是 0，没有需要写入的位
+	if (element_bit_width_ == 0) {
+		return;
+	}
+
 	auto [index_in_data, index_in_unit] = indexOf(begin);
 
 	for (int32_t i = 0; i < end - begin; ++i) {
@@ -89,6 +96,11 @@ void PackedArray<ValueType>::setRange(const size_type begin, const size_type end
 		throw std::out_of_range(std::format("PackedArray: range ({}, {}) to set out of range!", begin, end));
 	}
 
+	// 宽度为 0 时所有元素都是 0，没有需要写入的位
+	if (element_bit_width_ == 0) {
+		return;
+	}
+
 	auto [index_in_data, index_in_unit] = indexOf(begin);
 
 	for (int32_t i = 0; i < end - begin; ++i) {
@@ -123,8 +135,11 @@ std::vector<ValueType> PackedArray<ValueType>::getRange(const size_type begin, c
 		if (index_in_unit + element_bit_width_ >= kUnitBitWidth) {
 			ValueType buffer = (data_[index_in_data] >> index_in_unit);
 			++index_in_data;
-			buffer |= (data_[index_in_data] << (kUnitBitWidth - index_in_unit));
 			index_in_unit = element_bit_width_ + index_in_unit - kUnitBitWidth;
+			// 恰好在 unit 末尾结束时没有超出的位，下一个 unit 可能已经越界
+			if (index_in_unit != 0) {
+				buffer |= (data_[index_in_data] << (element_bit_width_ - index_in_unit));
+			}
 			result.push_back(buffer & element_capacity_);
 
 		} else {
@@ -161,6 +176,7 @@ void PackedArray<ValueType>::fit() {
 	const ValueType maximum = *std::max_element(cbegin(), cend());
 	if (maximum == 0) {
 		element_bit_width_ = 0;
+		element_capacity_ = 0;
 		data_.clear();
 		return;
 	}
@@ -179,7 +195,7 @@ void PackedArray<ValueType>::serialize(std::ostringstream &oss) const {
 }
 
 template<typename ValueType>
-void PackedArray<ValueType>::deserialize(std::istringstream &iss, const uint32_t size) {
+void PackedArray<ValueType>::deserialize(std::istream &iss, const uint32_t size) {
 	DESERIALIZE_READ(iss, size_);
 	DESERIALIZE_READ(iss, element_bit_width_);
 	element_capacity_ = (1ULL << element_bit_width_) - 1;
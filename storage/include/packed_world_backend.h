@@ -0,0 +1,102 @@
+#pragma once
+
+#include "storage_backend.h"
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+namespace pgvoxel {
+
+// 只读的打包世界，用于发布预生成的世界
+// 文件由文件头、按 key 的顺序排列的值以及各数据库的定长索引组成，打开时只需映射整个文件并校验文件头
+// 值直接指向映射的内存，读取时不复制。空间上相邻的区块在文件中也相邻
+class PackedWorldBackend : public StorageBackend {
+public:
+	// 依次写入各数据库的数据，每个数据库内需按 key 的顺序追加
+	// 索引先写入临时文件，finish 时追加到值的后面，因此写入大型世界时内存占用很小
+	class Writer {
+	public:
+		explicit Writer(const std::string &path);
+		~Writer();
+		Writer(const Writer &) = delete;
+		Writer &operator=(const Writer &) = delete;
+
+		bool beginTable(const Table table);
+		bool append(const std::string_view key, const std::string_view value);
+		// 写入索引和文件头，此后文件才是完整的
+		bool finish();
+
+	private:
+		const std::string path_;
+		const std::string index_path_;
+		std::ofstream data_;
+		std::ofstream index_;
+		// 正在写入的数据库及其条数
+		int table_{ -1 };
+		uint64_t count_{ 0 };
+		std::string last_key_;
+		std::array<uint64_t, kTableCount> counts_{};
+	};
+
+	explicit PackedWorldBackend(const std::string &path);
+	~PackedWorldBackend() override;
+
+	bool get(const Table table, const std::string_view key, const Reader &reader) override;
+	bool scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) override;
+
+	// 打包的世界是只读的，写入总是失败
+	bool putBatch(const Table table, const Batch &entries, const bool append = false) override;
+	bool del(const Table table, const std::string_view key) override;
+	bool openTable(const Table table) override;
+	bool dropTable(const Table table) override;
+
+	bool flush() override { return true; }
+	// 打包时生成的标识，同一文件总是相同
+	uint64_t version() const override;
+	bool readOnly() const override { return true; }
+
+	bool valid() const { return header_ != nullptr; }
+
+private:
+	static const uint32_t kMagic = 0x57564750; // "PGVW"
+	static const uint32_t kFormatVersion = 1;
+	static const uint8_t kMaxKeySize = 15;
+
+	struct TableIndex {
+		uint64_t offset;
+		uint64_t count;
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t format_version;
+		uint64_t build_id;
+		std::array<TableIndex, kTableCount> tables;
+	};
+
+	// 定长的索引项，可以直接在映射的内存上二分查找
+	struct IndexEntry {
+		uint8_t key_size;
+		char key[kMaxKeySize];
+		uint64_t offset;
+		uint32_t size;
+		uint32_t reserved;
+
+		std::string_view keyView() const { return { key, key_size }; }
+	};
+	static_assert(sizeof(IndexEntry) == 32);
+
+	const IndexEntry *begin(const Table table) const { return reinterpret_cast<const IndexEntry *>(map_ + header_->tables[table].offset); }
+	const IndexEntry *end(const Table table) const { return begin(table) + header_->tables[table].count; }
+	// 第一个 key 不小于 key 的索引项
+	const IndexEntry *lowerBound(const Table table, const std::string_view key) const;
+	std::string_view value(const IndexEntry &entry) const { return { map_ + entry.offset, entry.size }; }
+
+	const char *map_{ nullptr };
+	size_t size_{ 0 };
+	const Header *header_{ nullptr };
+};
+
+} //namespace pgvoxel
@@ -9,7 +9,7 @@ namespace pgvoxel {
 
 // 将离散分布的值映射到从 0 开始的连续 index，就像在数量有限的调色板格子中只存放当前所需的颜料一样
 // 注意，该类永远只会自然增长，哪怕末尾的值已被删除。如果要删除末尾的空值，需要手动调用 fit。
-// TODO: fit 函数还未实现
+// index 0 固定为空气，序列化时不会被记录
 template <typename IndexType, typename DataType, IndexType kMaxSize>
 class Palette {
 	public:
@@ -35,11 +35,21 @@ class Palette {
 
     // 序列化/反序列化
     void serialize(std::ostringstream &oss) const;
-    void deserialize(std::istringstream &iss, const uint32_t size);
+    void deserialize(std::istream &iss, const uint32_t size);
 
     std::string toString() const;
 
-    void fit();
+    // 估算占用的堆内存大小（字节），哈希表的节点按 key, value 加两个指针计算
+    size_t memoryUsage() const {
+        const size_t node_size = sizeof(DataType) + sizeof(IndexType) + 2 * sizeof(void *);
+        return index_to_data.capacity() * sizeof(DataType) +
+               (data_to_index.size() + data_to_ref.size()) * node_size +
+               (data_to_index.bucket_count() + data_to_ref.bucket_count()) * sizeof(void *);
+    }
+
+    // 移除空位，使 index 重新变得连续
+    // 返回旧 index 到新 index 的映射，调用方需要据此更新持有的 index。没有变化时返回空
+    std::vector<IndexType> fit();
 
    private:
     size_type size_{1};
@@ -54,14 +54,15 @@ IndexType Palette<IndexType, DataType, kMaxSize>::update(const DataType &new_dat
     }
 
     auto new_data_iter = data_to_ref.find(new_data);
-    if (new_data_iter != data_to_ref.end()) {
+    // ref 为 0 的数据原先的 index 可能已被其他数据占用，需要当作新数据重新插入。空气总是位于 index 0
+    if (new_data_iter != data_to_ref.end() && (new_data_iter->second != 0 || new_data == 0)) {
         // 若 new data 已存在，则简单地将 ref 加一
         ++(new_data_iter->second);
         return data_to_index.at(new_data);
     } else {
         // 若 new data 原先不存在，则要寻找新的 index 进行插入
-        size_type new_index = 0;
-        // 在已有的 index 中查找空位
+        size_type new_index = 1;
+        // 在已有的 index 中查找空位，index 0 留给空气
         // palette size 很大时，这个遍历可能会很慢，但是考虑到 palette 一般不会太大，且新增数据的频率通常不高，应该可以接受
         while (new_index < index_to_data.size() && data_to_ref[index_to_data[new_index]] != 0) {
             ++new_index;
@@ -97,7 +98,7 @@ void Palette<IndexType, DataType, kMaxSize>::serialize(std::ostringstream &oss)
 }
 
 template <typename IndexType, typename DataType, IndexType kMaxSize>
-void Palette<IndexType, DataType, kMaxSize>::deserialize(std::istringstream &iss, const uint32_t size) {
+void Palette<IndexType, DataType, kMaxSize>::deserialize(std::istream &iss, const uint32_t size) {
     clear();
     size_ = size / kEntrySize + 1;
 
@@ -139,8 +140,36 @@ std::string Palette<IndexType, DataType, kMaxSize>::toString() const {
 }
 
 template <typename IndexType, typename DataType, IndexType kMaxSize>
-void Palette<IndexType, DataType, kMaxSize>::fit() {
-    // TODO
+std::vector<IndexType> Palette<IndexType, DataType, kMaxSize>::fit() {
+    std::vector<IndexType> remap(index_to_data.size(), 0);
+    std::vector<DataType> fitted_index_to_data{0};
+    std::unordered_map<DataType, IndexType> fitted_data_to_index{{0, 0}};
+    std::unordered_map<DataType, IndexType> fitted_data_to_ref{{0, data_to_ref.at(0)}};
+
+    for (size_type i = 1; i < index_to_data.size(); ++i) {
+        const DataType &data = index_to_data[i];
+        const auto ref_iter = data_to_ref.find(data);
+        // 跳过空位，以及已被重新插入到其他 index 的旧数据
+        if (data == 0 || ref_iter == data_to_ref.end() || ref_iter->second == 0 || data_to_index.at(data) != i) {
+            continue;
+        }
+        const IndexType new_index = fitted_index_to_data.size();
+        remap[i] = new_index;
+        fitted_index_to_data.push_back(data);
+        fitted_data_to_index[data] = new_index;
+        fitted_data_to_ref[data] = ref_iter->second;
+    }
+
+    const bool unchanged = fitted_index_to_data.size() == index_to_data.size();
+    index_to_data = std::move(fitted_index_to_data);
+    data_to_index = std::move(fitted_data_to_index);
+    data_to_ref = std::move(fitted_data_to_ref);
+    size_ = index_to_data.size();
+
+    if (unchanged) {
+        return {};
+    }
+    return remap;
 }
 
 }  // namespace pgvoxel
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "forward.h"
+
+#include <atomic>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace pgvoxel {
+
+// 记录数据库中存在数据的区块竖列，用于在开启事务之前排除不存在的区块
+// 世界范围 [0, width) 内的竖列使用稠密位图，范围外的竖列使用 Bloom 过滤器
+// 只会误报存在，不会漏报，因此写入数据前必须先 insert
+class PresenceFilter {
+public:
+	explicit PresenceFilter(const CoordAxis width);
+	PresenceFilter(const PresenceFilter &) = delete;
+	PresenceFilter &operator=(const PresenceFilter &) = delete;
+
+	bool mayContain(const CoordAxis x, const CoordAxis z) const;
+	// 可以与其他 insert 和 mayContain 并发调用
+	void insert(const CoordAxis x, const CoordAxis z);
+
+	// 以原始位图的形式序列化，用于持久化到数据库旁的 sidecar 文件
+	void save(std::ostream &os) const;
+	// 读取 save 写入的数据，世界大小不一致或数据不完整时返回 false
+	bool load(std::istream &is);
+
+private:
+	// Bloom 过滤器的位数与哈希函数的个数，范围外的竖列通常很少，这一大小足够让误报率保持在很低的水平
+	static const uint64_t kBloomBits = 1 << 20;
+	static const int kBloomHashes = 3;
+
+	bool inExtent(const CoordAxis x, const CoordAxis z) const { return x < width_ && z < width_; }
+	// 第 i 个哈希函数对应的位，使用两个哈希值线性组合得到
+	static uint64_t bloomBit(const CoordAxis x, const CoordAxis z, const int i);
+
+	static bool test(const std::vector<std::atomic<uint64_t>> &bits, const uint64_t bit) {
+		return bits[bit >> 6].load(std::memory_order_relaxed) & (1ULL << (bit & 63));
+	}
+	static void set(std::vector<std::atomic<uint64_t>> &bits, const uint64_t bit) {
+		bits[bit >> 6].fetch_or(1ULL << (bit & 63), std::memory_order_relaxed);
+	}
+
+	const CoordAxis width_;
+	std::vector<std::atomic<uint64_t>> dense_;
+	std::vector<std::atomic<uint64_t>> bloom_;
+};
+
+} //namespace pgvoxel
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "storage_backend.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+namespace pgvoxel {
+
+// 以区域文件储存的存储，path 是一个目录
+// 每个数据库中 2^kRegionBits x 2^kRegionBits 个区块竖列组成一个区域，储存在名为 <数据库>.<rx>.<rz>.region 的文件中
+// 区域文件只追加写入，每条记录为 [u16 key 长度][u32 值长度][key][值]，删除时追加值长度为 kTombstone 的记录
+// 各区域的偏移表在首次访问时从 .index 文件读取，再重放其后追加的记录，flush 时重新写入 .index
+// 版本号单调递增，持久化在目录下的 version 文件中，上次 flush 之后的第一次修改前递增并写入磁盘
+// 被覆盖和删除的记录占用的空间超过阈值时，写入后会把有效记录按 key 的顺序重写到新文件中
+// 不同区域可以并行写入，一批数据只在同一区域内是原子的，WorldDB 的一批数据总是属于同一个区块
+class RegionFileBackend : public StorageBackend {
+public:
+	explicit RegionFileBackend(const std::string &path);
+	~RegionFileBackend() override;
+
+	// 值以 pread 从区域文件中读出
+	bool get(const Table table, const std::string_view key, const Reader &reader) override;
+	// 沿区域的 Morton 顺序依次遍历各区域的偏移表，与 ChunkKey 的顺序一致
+	bool scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) override;
+
+	// 按区域分组，每个区域的记录拼接后一次写入
+	bool putBatch(const Table table, const Batch &entries, const bool append = false) override;
+	bool del(const Table table, const std::string_view key) override;
+
+	bool openTable(const Table) override { return true; }
+	bool dropTable(const Table table) override;
+
+	// 将区域文件刷到磁盘并写入偏移表，下次打开时无需重放整个文件
+	bool flush() override;
+	// flush 之后没有修改时保持不变，即使修改后的文件长度恰好与之前相同，版本号也不会回到之前的值
+	uint64_t version() const override { return version_; }
+
+private:
+	// 区域边长为 2^kRegionBits 个区块竖列，区域内的 key 在 key 空间中是连续的
+	static const int kRegionBits = 5;
+	static const uint32_t kTombstone = UINT32_MAX;
+	static const uint64_t kRecordHeaderSize = sizeof(uint16_t) + sizeof(uint32_t);
+	static const mode_t kPermission = 0664;
+	inline static const char *kRegionSuffix = ".region";
+	inline static const char *kIndexSuffix = ".index";
+	inline static const char *kVersionFile = "version";
+	// 无效记录至少占区域文件的一半且不少于 4MB 时整理
+	static const uint64_t kCompactMinDeadBytes = 4 << 20;
+	static constexpr double kCompactDeadRatio = 0.5;
+	// 整理时每积累这么多数据写入一次
+	static const size_t kCompactBufferSize = 1 << 20;
+
+	struct Location {
+		uint64_t offset;
+		uint32_t size;
+	};
+
+	struct Region {
+		std::string file;
+		int fd{ -1 };
+		// 最后一条完整记录的末尾，新的记录从这里写入
+		uint64_t end{ 0 };
+		// 偏移表中的记录所占的字节数，end 与它的差即被覆盖和删除的记录占用的空间
+		uint64_t live{ 0 };
+		std::atomic<bool> loaded{ false };
+		bool dirty{ false };
+		std::map<std::string, Location, std::less<>> index;
+		std::shared_mutex mtx;
+	};
+
+	struct Store {
+		std::shared_mutex mtx;
+		// 以区域坐标的 Morton 码为 key，遍历顺序即 key 的顺序
+		std::map<uint64_t, std::unique_ptr<Region>> regions;
+	};
+
+	// key 所在区域的 Morton 码，即 ChunkKey 去掉 y 和区域内坐标后的高位
+	static uint64_t regionOf(const std::string_view key);
+	std::string regionFile(const Table table, const std::string_view key) const;
+
+	// 返回 key 所在的区域，create 为 false 且区域不存在时返回 nullptr
+	Region *findRegion(const Table table, const std::string_view key, const bool create);
+	// 首次访问时打开区域文件并恢复偏移表
+	bool ensureLoaded(Region &region);
+	bool loadIndex(Region &region, uint64_t &covered);
+	bool saveIndex(const Region &region);
+	// 在 region 的末尾追加记录，调用方需持有 region 的独占锁。值为 kDelete 的条目写入删除记录
+	bool append(Region &region, const Batch &entries);
+	static bool readValue(const Region &region, const Location &location, std::string &value);
+	static uint64_t recordSize(const size_t key_size, const uint32_t value_size) { return kRecordHeaderSize + key_size + value_size; }
+	// 无效记录过多时整理区域文件，调用方需持有 region 的独占锁
+	void compactIfNeeded(Region &region);
+	bool compact(Region &region);
+	// 在修改任何文件之前调用。自上次 flush 以来的第一次修改会先将递增后的版本号写入磁盘，
+	// 中途退出时磁盘上的版本号也已经与 flush 时的不同
+	bool bumpVersion();
+
+	std::array<Store, kTableCount> stores_;
+	std::atomic<uint64_t> version_{ 0 };
+	std::mutex version_mtx_;
+	int version_fd_{ -1 };
+	// 自上次 flush 以来是否还没有修改过，在 version_mtx_ 的保护下读写
+	bool clean_{ true };
+};
+
+} //namespace pgvoxel
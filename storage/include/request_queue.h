@@ -0,0 +1,262 @@
+#pragma once
+
+#include "core/error/error_macros.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace pgvoxel {
+
+// 带优先级的异步请求队列，由若干工作线程处理
+// 相同 key 的请求在等待或处理期间会被合并，只加载一次；每个调用方持有自己的 ticket，可以单独取消
+// 结果为 std::nullopt 表示该调用方的请求被取消，或队列在处理前被销毁
+template <typename Key, typename Result>
+class RequestQueue {
+public:
+	typedef std::function<Result(const Key &)> Loader;
+	// callback 在工作线程中调用，需要回到主线程时应由调用方自行转发。被取消的调用方不会收到 callback
+	typedef std::function<void(const Result &)> Callback;
+	typedef uint64_t Ticket;
+
+	struct Submission {
+		Ticket ticket;
+		std::shared_future<std::optional<Result>> future;
+	};
+
+	RequestQueue(Loader loader, const size_t thread_count) :
+			loader_(std::move(loader)) {
+		for (size_t i = 0; i < thread_count; ++i) {
+			threads_.emplace_back(&RequestQueue::run, this);
+		}
+	}
+	~RequestQueue();
+	RequestQueue(const RequestQueue &) = delete;
+	RequestQueue &operator=(const RequestQueue &) = delete;
+
+	// 提交请求，priority 越大越先处理
+	// 若相同 key 的请求仍在等待，则合并到该请求上，并将其优先级提升到两者中较高的一个
+	Submission request(const Key &key, const int32_t priority, Callback callback = nullptr);
+	// 修改等待中请求的优先级，请求已开始处理或不存在时返回 false
+	bool reprioritize(const Key &key, const int32_t priority);
+	// 取消 ticket 对应的调用方，其 future 以 std::nullopt 完成。ticket 已完成或不存在时返回 false
+	// 合并的请求只有在所有调用方都取消后才会从队列中移除，处理中的请求会继续为其他调用方完成
+	bool cancel(const Ticket ticket);
+
+	size_t pendingCount() const {
+		std::lock_guard<std::mutex> lock(mtx_);
+		return pending_.size();
+	}
+
+private:
+	struct Caller {
+		std::promise<std::optional<Result>> promise;
+		Callback callback;
+	};
+
+	struct Request {
+		int32_t priority;
+		uint64_t sequence;
+		std::unordered_map<Ticket, Caller> callers;
+	};
+
+	// 优先级高的在前，同优先级时先提交的在前
+	struct Order {
+		int32_t priority;
+		uint64_t sequence;
+		Key key;
+
+		bool operator<(const Order &other) const {
+			return priority != other.priority ? priority > other.priority : sequence < other.sequence;
+		}
+	};
+
+	void run();
+	// 在 mtx_ 的保护下将调用方加入请求
+	Submission addCaller(const Key &key, Request &request, Callback callback);
+	// 以结果完成各调用方，调用时不能持有 mtx_
+	static void fulfill(std::unordered_map<Ticket, Caller> &callers, const Result &result);
+	// 每个调用方得到独立的结果，Dictionary 等引用语义的类型需要复制，避免调用方之间互相修改
+	static Result copyOf(const Result &result) {
+		if constexpr (requires { result.duplicate(true); }) {
+			return result.duplicate(true);
+		} else {
+			return result;
+		}
+	}
+
+	Loader loader_;
+	mutable std::mutex mtx_;
+	std::condition_variable cv_;
+	std::unordered_map<Key, std::shared_ptr<Request>> pending_, in_flight_;
+	// 未完成的 ticket 所属请求的 key
+	std::unordered_map<Ticket, Key> tickets_;
+	std::set<Order> order_;
+	uint64_t next_sequence_{ 0 };
+	Ticket next_ticket_{ 0 };
+	bool stopping_{ false };
+	std::vector<std::thread> threads_;
+};
+
+template <typename Key, typename Result>
+RequestQueue<Key, Result>::~RequestQueue() {
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		stopping_ = true;
+	}
+	cv_.notify_all();
+	for (auto &thread : threads_) {
+		thread.join();
+	}
+	// 仍在等待的请求不会再被处理，以 std::nullopt 完成，避免等待它们的线程永远阻塞
+	for (auto &[key, request] : pending_) {
+		for (auto &[ticket, caller] : request->callers) {
+			caller.promise.set_value(std::nullopt);
+		}
+	}
+}
+
+template <typename Key, typename Result>
+typename RequestQueue<Key, Result>::Submission RequestQueue<Key, Result>::addCaller(const Key &key, Request &request, Callback callback) {
+	const Ticket ticket = next_ticket_++;
+	Caller &caller = request.callers[ticket];
+	caller.callback = std::move(callback);
+	tickets_.emplace(ticket, key);
+	return { ticket, caller.promise.get_future().share() };
+}
+
+template <typename Key, typename Result>
+typename RequestQueue<Key, Result>::Submission RequestQueue<Key, Result>::request(const Key &key, const int32_t priority, Callback callback) {
+	std::unique_lock<std::mutex> lock(mtx_);
+	if (auto iter = in_flight_.find(key); iter != in_flight_.end()) {
+		// 已在处理中，直接共享结果
+		return addCaller(key, *iter->second, std::move(callback));
+	}
+	if (auto iter = pending_.find(key); iter != pending_.end()) {
+		auto &request = *iter->second;
+		if (priority > request.priority) {
+			order_.erase({ request.priority, request.sequence, key });
+			request.priority = priority;
+			order_.insert({ request.priority, request.sequence, key });
+		}
+		return addCaller(key, request, std::move(callback));
+	}
+
+	auto request = std::make_shared<Request>();
+	request->priority = priority;
+	request->sequence = next_sequence_++;
+	Submission submission = addCaller(key, *request, std::move(callback));
+	pending_.emplace(key, request);
+	order_.insert({ request->priority, request->sequence, key });
+	lock.unlock();
+
+	cv_.notify_one();
+	return submission;
+}
+
+template <typename Key, typename Result>
+bool RequestQueue<Key, Result>::reprioritize(const Key &key, const int32_t priority) {
+	std::lock_guard<std::mutex> lock(mtx_);
+	auto iter = pending_.find(key);
+	if (iter == pending_.end()) {
+		return false;
+	}
+	auto &request = *iter->second;
+	order_.erase({ request.priority, request.sequence, key });
+	request.priority = priority;
+	order_.insert({ request.priority, request.sequence, key });
+	return true;
+}
+
+template <typename Key, typename Result>
+bool RequestQueue<Key, Result>::cancel(const Ticket ticket) {
+	Caller caller;
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		auto ticket_iter = tickets_.find(ticket);
+		if (ticket_iter == tickets_.end()) {
+			return false;
+		}
+		const Key key = ticket_iter->second;
+		tickets_.erase(ticket_iter);
+
+		auto iter = pending_.find(key);
+		const bool is_pending = iter != pending_.end();
+		if (!is_pending) {
+			// 未完成的 ticket 不在 pending_ 中就在 in_flight_ 中
+			iter = in_flight_.find(key);
+		}
+		Request &request = *iter->second;
+		auto caller_iter = request.callers.find(ticket);
+		caller = std::move(caller_iter->second);
+		request.callers.erase(caller_iter);
+		// 没有调用方的等待中请求不再需要加载
+		if (is_pending && request.callers.empty()) {
+			order_.erase({ request.priority, request.sequence, key });
+			pending_.erase(iter);
+		}
+	}
+	caller.promise.set_value(std::nullopt);
+	return true;
+}
+
+template <typename Key, typename Result>
+void RequestQueue<Key, Result>::run() {
+	while (true) {
+		Key key;
+		std::shared_ptr<Request> request;
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			cv_.wait(lock, [this]() { return stopping_ || !order_.empty(); });
+			if (stopping_) {
+				return;
+			}
+			key = order_.begin()->key;
+			order_.erase(order_.begin());
+			auto iter = pending_.find(key);
+			request = iter->second;
+			pending_.erase(iter);
+			in_flight_.emplace(key, request);
+		}
+
+		Result result{};
+		try {
+			result = loader_(key);
+		} catch (const std::exception &e) {
+			ERR_PRINT(e.what());
+		}
+
+		std::unordered_map<Ticket, Caller> callers;
+		{
+			// 从 in_flight_ 中移除后各调用方的 ticket 失效，不会再被取消
+			std::lock_guard<std::mutex> lock(mtx_);
+			in_flight_.erase(key);
+			for (const auto &[ticket, caller] : request->callers) {
+				tickets_.erase(ticket);
+			}
+			callers = std::move(request->callers);
+		}
+		fulfill(callers, result);
+	}
+}
+
+template <typename Key, typename Result>
+void RequestQueue<Key, Result>::fulfill(std::unordered_map<Ticket, Caller> &callers, const Result &result) {
+	for (auto &[ticket, caller] : callers) {
+		caller.promise.set_value(copyOf(result));
+		if (caller.callback) {
+			caller.callback(copyOf(result));
+		}
+	}
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pgvoxel {
+
+// WorldDB 使用的键值存储，key 按字节序排列
+// 各实现只负责数据的读写，缓存、分片和并发控制由 WorldDB 完成
+class StorageBackend {
+public:
+	enum Table : uint8_t {
+		kMetadataTable,
+		kTerrainTable,
+		kGenerationTable,
+		kOverlayTable,
+		kTableCount
+	};
+
+	// scan 中 visitor 的返回值，决定遍历下一步如何进行
+	enum class ScanStep {
+		kNext,
+		kSeek,
+		kStop
+	};
+
+	typedef std::vector<std::pair<std::string_view, std::string_view>> Batch;
+	typedef std::function<void(const std::string_view value)> Reader;
+	typedef std::function<ScanStep(const std::string_view key, const std::string_view value, std::string &seek)> Visitor;
+	typedef std::function<void()> Finish;
+
+	explicit StorageBackend(const std::string &path) :
+			path_(path) {}
+	virtual ~StorageBackend() = default;
+	StorageBackend(const StorageBackend &) = delete;
+	StorageBackend &operator=(const StorageBackend &) = delete;
+
+	// 读取 key 对应的值，值只在 reader 中有效。key 不存在或出错时返回 false
+	virtual bool get(const Table table, const std::string_view key, const Reader &reader) = 0;
+
+	// 从 from 开始沿 key 的顺序遍历
+	// visitor(key, value, seek) 返回 kNext 时前进到下一条，返回 kSeek 时跳到 seek 指定的 key，返回 kStop 时结束遍历
+	// 遍历结束后调用 finish，此时遍历中得到的值仍然有效。finish 为空时值只在 visitor 中有效，实现可以不再保留它们
+	virtual bool scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) = 0;
+
+	// 原子地写入多条数据。append 为 true 时调用方保证 entries 有序且都大于已有的 key，实现可以借此顺序写入
+	// 值为 kDelete 的条目删除对应的 key，key 不存在时忽略，append 为 true 时不能包含删除
+	virtual bool putBatch(const Table table, const Batch &entries, const bool append = false) = 0;
+	// 以 data() 为空与空字符串的值区分
+	static constexpr std::string_view kDelete{};
+	static bool isDelete(const std::string_view value) { return value.data() == nullptr; }
+	bool put(const Table table, const std::string_view key, const std::string_view value) { return putBatch(table, { { key, value } }); }
+	virtual bool del(const Table table, const std::string_view key) = 0;
+
+	// generation 只在生成期间打开，结束后整个删除
+	virtual bool openTable(const Table table) = 0;
+	virtual bool dropTable(const Table table) = 0;
+
+	// 将写入的数据持久化到磁盘
+	virtual bool flush() = 0;
+	// 每次写入后都会改变的版本号，可以用来判断数据是否被修改过。不持久化的实现返回 0
+	virtual uint64_t version() const = 0;
+	// 只读的实现不接受写入，WorldDB 不为它建立存在性过滤器，也不会在它旁边写入 sidecar
+	virtual bool readOnly() const { return false; }
+
+	// 各数据库的读写锁，WorldDB 用它们保证缓存与存储的一致
+	// 实现内部的锁总是在它之后获取
+	std::shared_mutex &tableMutex(const Table table) { return table_mtx_[table]; }
+	// 不持久化的实现为空
+	const std::string &path() const { return path_; }
+
+protected:
+	inline static const std::array<const char *, kTableCount> kTableNames{ "metadata", "terrain", "generation", "overlay" };
+
+private:
+	const std::string path_;
+	std::array<std::shared_mutex, kTableCount> table_mtx_;
+};
+
+} //namespace pgvoxel
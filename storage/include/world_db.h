@@ -1,11 +1,20 @@
 #pragma once
 
+#include "chunk.h"
 #include "data_chunk.h"
+#include "generation_store.h"
+#include "lmdb_environment.h"
+#include "lru_cache.h"
+#include "presence_filter.h"
+#include "storage_backend.h"
 #include "core/variant/dictionary.h"
 
-#include <lmdb.h>
+#include <array>
 #include <memory>
 #include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace pgvoxel {
 class WorldDB {
@@ -16,49 +25,181 @@ public:
 		}
 		return *instance_;
 	}
+	// 关闭模块时调用，析构时刷新各环境并保存存在性过滤器。须在 AsyncWorldDB::destroy 之后调用
+	static void destroy() {
+		delete instance_;
+	}
+
+	// 读取的区块会被缓存并在多处共享，因此是只读的
+	typedef ShardedLruCache<Coord, std::shared_ptr<const LoadedChunk>> ChunkCache;
+	// 从 ChunkCache 中淘汰的区块以序列化后的形式（各层均经过 LZ4 压缩）保存在这一级
+	typedef ShardedLruCache<Coord, std::shared_ptr<const std::string>> CompressedChunkCache;
+
+	// 区块各层相对于基础地形的差异，见 ChunkDelta
+	typedef std::array<std::string, LoadedChunk::kDataChunkNums> Overlay;
 
 	// TODO: 或许应该把这些业务逻辑拆分到其他类中
-	std::unique_ptr<LoadedChunk> loadChunk(const Coord &pos);
+	// 读取的区块是基础地形叠加 overlay 中玩家修改的结果
+	std::shared_ptr<const LoadedChunk> loadChunk(const Coord &pos);
+	// 读取区块的可修改副本，所有层均为未修改，修改后以 saveChunk 保存。区块不存在时返回 nullptr
+	std::unique_ptr<LoadedChunk> loadChunkForEdit(const Coord &pos);
+	// 保存玩家的修改。基础地形是只读的，被修改的层以相对于基础地形的差异写入 overlay
 	void saveChunk(LoadedChunk *chunk);
+	// 写入基础地形，只在生成世界时使用
+	void saveBaseChunk(LoadedChunk *chunk);
+	// 开启 batch_terrain 时以 ChunkBatch 写入同一组、同一高度的基础地形
+	void saveBaseBatch(const std::vector<LoadedChunk *> &chunks);
+	// 按 key 的顺序批量写入基础地形，只在生成世界时使用
+	// chunks 须按储存它们的 key 递增排列：按层储存时为 ChunkKey，开启 batch_terrain 时为 ChunkBatch::key 且同组的区块相邻
+	// 每个分片的数据以追加的方式写入，LMDB 借此使用 MDB_APPEND 顺序填充页，避免随机插入造成的页分裂
+	// 顺序不对或任意一个分片写入失败时返回 false，其余分片可能已经写入
+	bool bulkLoad(const std::vector<LoadedChunk *> &chunks);
+	// 在一个读事务中读取区域 [min, max) 内已存在的所有区块，只解码 layers 指定的层
+	// 用于 viewer 出生、传送等需要一次加载大量区块的场合
+	std::vector<std::shared_ptr<const LoadedChunk>> loadRegion(const Coord &min, const Coord &max, const LoadedChunk::LayerMask layers = LoadedChunk::kAllLayers);
+
+	ChunkCache::Stats chunkCacheStats() const { return chunk_cache_.stats(); }
+	void setChunkCacheBudget(const size_t budget) { chunk_cache_.setBudget(budget); }
+	CompressedChunkCache::Stats compressedChunkCacheStats() const { return compressed_chunk_cache_.stats(); }
+	void setCompressedChunkCacheBudget(const size_t budget) { compressed_chunk_cache_.setBudget(budget); }
 
-	std::unique_ptr<GenerationChunk> loadGenerationChunk(const CoordAxis x, const CoordAxis z);
-	void saveGenerationChunk(GenerationChunk *chunk);
+	// 生成期间每一层的结果以层号为版本分别储存，下一层的区块可以在相邻区块的上一层完成后立即开始，不会读到被覆盖的数据
+	std::unique_ptr<GenerationChunk> loadGenerationChunk(const CoordAxis x, const CoordAxis z, const uint16_t version);
+	// 读取到已有的 chunk 中，位置由 chunk 决定，可以复用 chunk 已分配的内存。不存在时返回 false
+	bool loadGenerationChunk(GenerationChunk &chunk, const uint16_t version);
+	// 保存失败时返回 false，生成应当中止，否则下一层会在空区块上继续生成
+	bool saveGenerationChunk(GenerationChunk *chunk, const uint16_t version);
+	// 删除不再被任何区块需要的版本
+	void dropGenerationChunk(const CoordAxis x, const CoordAxis z, const uint16_t version);
 
+	// 优先读取 overlay 中运行时写入的 metadata，不存在时回退到基础地形
 	Dictionary getMetadata(const CoordAxis x, const CoordAxis z);
+	// 基础地形是只读的，写入 overlay
 	void setMetadata(const CoordAxis x, const CoordAxis z, const Dictionary &metadata);
 
 	void beginGeneration();
-	void endGeneration();
+	// 将版本为 final_version 的生成结果切分为 LoadedChunk 写入基础地形，然后删除生成期间的数据
+	// 写入失败时返回 false 并保留生成期间的数据，调用者应当报告生成失败
+	bool endGeneration(const uint16_t final_version);
+	// 生成失败时调用，删除生成期间的数据，不改变基础地形
+	void abortGeneration();
 
+	// 将各个分片按 key 的顺序合并为 path 处的单个数据库，用于发布世界。path 处不能已有文件
+	// 合并期间会阻止对 metadata 和 terrain 的写入，只支持 LMDB 存储
+	bool mergeShards(const std::string &path);
+	size_t shardCount() const { return shards_.size(); }
+
+	// metadata 以 Godot 的二进制 Variant 格式储存，保留整数等类型，也能高效地储存 Packed*Array
+	// 也能读取旧版本的 JSON 格式，离线工具借此将其转换为二进制格式
+	static std::vector<uint8_t> encodeMetadata(const Dictionary &metadata);
+	static Dictionary decodeMetadata(const uint8_t *data, const ::size_t size);
+
+	// 直接使用给定的存储，不读取配置中的存储设置，用于测试。shards 不能为空
+	WorldDB(std::vector<std::unique_ptr<StorageBackend>> &&shards, std::unique_ptr<StorageBackend> &&overlay, const bool batch_terrain);
 	~WorldDB();
 
 private:
-	// database names
-	// #define CONSTANT_STRING(name, str) inline static const char *name = str;
-	inline static const char *kDatabaseEnv = "world.db";
-	inline static const char *kMetadataDB = "metadata";
-	inline static const char *kTerrainDB = "terrain";
-	inline static const char *kGenerationDB = "generation";
-
-	// database enviroment paramters
-	static const MDB_dbi kMaxdbs = 4;
-	static const ::size_t kMapsize = 1073741824;
-	static const mdb_mode_t kPermission = 0664;
+	// 只有一个分片时使用 world.db，否则第 i 个分片使用 world.<i>.db，使用区域文件时扩展名为 .regions，打包的世界为 world.pgw
+	inline static const char *kDatabaseEnv = "world";
+	inline static const char *kShardEnvPrefix = "world.";
+	inline static const char *kLmdbSuffix = ".db";
+	inline static const char *kRegionSuffix = ".regions";
+	inline static const char *kPackedSuffix = ".pgw";
+	// 配置中 storage_backend 的取值，为空时使用 LMDB
+	inline static const char *kLmdbBackend = "lmdb";
+	inline static const char *kMemoryBackend = "memory";
+	inline static const char *kRegionBackend = "region";
+	inline static const char *kPackedBackend = "packed";
+	// 存在性过滤器的 sidecar 文件，放在第一个环境的文件旁边
+	inline static const char *kPresenceSuffix = ".presence";
+	static const uint32_t kPresenceMagic = 0x32564750; // "PGV2"
+	// 玩家的修改储存在独立的环境中，备份时只需要复制这个文件，基础地形可以在多个服务器间共享
+	inline static const char *kOverlayEnv = "overlay";
+	// 内存存储溢出时使用的临时文件
+	inline static const char *kGenerationScratchFile = "generation.scratch";
+
+	// map size 的下限，以及估算 map size 时每个 LoadedChunk 预留的空间
+	static constexpr ::size_t kMinMapsize = 1073741824;
+	static constexpr ::size_t kMinShardMapsize = 134217728;
+	static const ::size_t kEstimatedChunkSize = 8192;
+	// 以 2^kShardRegionBits 个区块竖列为边长的区域为单位分配分片
+	// 区域足够小，并行生成时相邻的区块也能落在不同的分片上
+	static const int kShardRegionBits = 2;
+	// 写入基础地形时每批读取并写入的生成区块竖列数
+	static const ::size_t kBulkLoadColumns = 256;
+	// 合并分片时每个写事务写入的条数
+	static const ::size_t kMergeBatchSize = 1024;
+	// 未在配置中指定时两级区块缓存的预算
+	static const ::size_t kDefaultChunkCacheSize = 268435456;
+	static const ::size_t kDefaultCompressedChunkCacheSize = 268435456;
+	// 已解码 metadata 的缓存预算，按编码后的大小计算
+	static const ::size_t kMetadataCacheSize = 16777216;
+	// metadata 的格式标记，储存在值的首字节。旧版本的 JSON 格式没有标记，首字节总是 '{'
+	static const uint8_t kMetadataFormatBinary = 0x01;
 
 private:
 	WorldDB();
-	// 开始新事务
-	MDB_txn *beginTransaction(unsigned int flags);
-	// 提交事务，并释放scope_guard
-	void commitTransaction(MDB_txn *txn, auto &guard);
-	// 中断事务
-	void abortTransaction(MDB_txn *txn);
+
+	// 区块竖列 (x, z) 所在的分片
+	size_t shardIndexOf(const CoordAxis x, const CoordAxis z) const;
+	StorageBackend &shardOf(const CoordAxis x, const CoordAxis z) const { return *shards_[shardIndexOf(x, z)]; }
+	// 按配置打开基础地形的各个分片，以及 overlay 所在的存储
+	static std::vector<std::unique_ptr<StorageBackend>> openShards();
+	static std::unique_ptr<StorageBackend> openOverlay();
+	// 以 backend 指定的存储打开名为 name 的存储，mapsize 和 tables 只对 LMDB 有意义
+	static std::unique_ptr<StorageBackend> openBackend(const std::string &backend, const std::string &name, const ::size_t mapsize, const std::initializer_list<StorageBackend::Table> tables);
+	// 未在配置中指定 map size 时，依据世界的大小进行估算，得到的是所有分片的总和
+	static ::size_t estimateMapsize();
+	// 以 k 路归并将各分片中 table 的数据按 key 的顺序追加到 merged 中
+	bool mergeTable(const std::vector<LmdbEnvironment *> &shards, LmdbEnvironment &merged, const StorageBackend::Table table);
+	// 读取区域 [min, max) 内的 overlay。shard 不为空时只返回属于该分片的区块
+	std::unordered_map<Coord, Overlay> loadOverlays(const Coord &min, const Coord &max, const StorageBackend *shard);
+	// 从 generation 中按 key 的顺序读取所有生成结果，切分后以 bulkLoad 写入基础地形
+	// 缺少生成结果或写入失败时返回 false
+	bool writeBaseTerrain(const uint16_t version);
+
+	// 一组环境中各数据库的存在性过滤器，只有 tables 中的数据库会被创建。一组环境共用同一套过滤器
+	typedef std::array<std::unique_ptr<PresenceFilter>, StorageBackend::kTableCount> PresenceFilters;
+	// 优先读取 sidecar，sidecar 不存在或已过期时遍历所有环境的 key 重建
+	static PresenceFilters openPresence(const std::vector<StorageBackend *> &envs, const std::initializer_list<StorageBackend::Table> tables);
+	// sidecar 中记录了写入时各环境的版本号，任意一个与打开时的不一致则说明之后又有写入，需要重建
+	static bool loadPresence(const std::vector<StorageBackend *> &envs, const PresenceFilters &filters);
+	static void savePresence(const std::vector<StorageBackend *> &envs, const PresenceFilters &filters);
+	void savePresence();
+	std::vector<StorageBackend *> shardEnvs() const;
+	// 基础地形没有过滤器时（只读的存储）总是可能存在
+	bool mayContainBase(const StorageBackend::Table table, const CoordAxis x, const CoordAxis z) const {
+		return !base_presence_[table] || base_presence_[table]->mayContain(x, z);
+	}
+	void insertBase(const StorageBackend::Table table, const CoordAxis x, const CoordAxis z) {
+		if (base_presence_[table]) {
+			base_presence_[table]->insert(x, z);
+		}
+	}
 
 	static inline WorldDB *instance_ = nullptr;
 
-	MDB_env *env_{};
-	MDB_dbi metadata_db_{}, terrain_db_{}, generation_db_{};
-	mutable std::shared_mutex metadata_mtx, terrain_mtx, generation_mtx;
+	// 每个分片是一个独立的存储，如 LMDB 环境，各自拥有一个写者，数据按区域分散到各个分片中
+	std::vector<std::unique_ptr<StorageBackend>> shards_;
+	// 玩家修改的 overlay 和运行时写入的 metadata，写入频率低，不分片。读写 overlay 表时持有区块所在分片的 terrain 锁以保证与缓存一致
+	std::unique_ptr<StorageBackend> overlay_;
+	// 所有分片共用的存在性过滤器，以及 overlay_ 的存在性过滤器。
+	// 一个竖列只会写入所在的分片，共用不会损失精度，内存也不随分片数增长。基础地形是只读的存储时为空
+	PresenceFilters base_presence_;
+	PresenceFilters overlay_presence_;
+
+	// 两级区块缓存，均在区块所在分片的 terrain 锁的保护下填充，在 saveChunk 时失效
+	// 区块被 chunk_cache_ 淘汰时会转入 compressed_chunk_cache_，再次访问时解压并提升回 chunk_cache_
+	ChunkCache chunk_cache_{ kDefaultChunkCacheSize };
+	CompressedChunkCache compressed_chunk_cache_{ kDefaultCompressedChunkCacheSize };
+	// 以 ChunkKey 的值为 key，在 overlay_ 的 metadata 锁的保护下填充，在 setMetadata 时更新
+	ShardedLruCache<uint64_t, Dictionary> metadata_cache_{ kMetadataCacheSize };
+
+	// 基础地形是否以 ChunkBatch 储存，见配置中的 batch_terrain
+	bool batch_terrain_{ false };
+
+	// 配置了 generation_memory_budget 时，生成期间的区块保存在内存中而不是 generation 数据库
+	std::unique_ptr<GenerationStore> generation_store_;
 };
 
 } //namespace pgvoxel
@@ -0,0 +1,255 @@
+#include "lmdb_environment.h"
+
+#include "core/string/print_string.h"
+#include "core/variant/variant.h"
+
+#include <mutex>
+
+namespace pgvoxel {
+
+LmdbEnvironment::LmdbEnvironment(const std::string &path, const size_t mapsize, const std::initializer_list<Table> tables) :
+		StorageBackend(path), mapsize_(mapsize) {
+	MDB_CALL(, mdb_env_create, &env_);
+	MDB_CALL(, mdb_env_set_maxdbs, env_, kMaxdbs);
+	MDB_CALL(, mdb_env_set_mapsize, env_, mapsize_);
+	MDB_CALL(, mdb_env_open, env_, path.c_str(), MDB_NOSUBDIR, kPermission);
+
+	// 已有的数据库可能比给定的值更大，以实际的 map size 为准
+	MDB_envinfo info;
+	MDB_CALL(, mdb_env_info, env_, &info);
+	mapsize_ = info.me_mapsize;
+
+	MDB_txn *txn;
+	MDB_CALL(, mdb_txn_begin, env_, nullptr, 0, &txn);
+	for (const auto table : tables) {
+		if (const int err = mdb_dbi_open(txn, kTableNames[table], MDB_CREATE, &dbis_[table])) {
+			ERR_PRINT(mdb_strerror(err));
+			mdb_txn_abort(txn);
+			return;
+		}
+	}
+	MDB_CALL(, mdb_txn_commit, txn);
+}
+
+LmdbEnvironment::~LmdbEnvironment() {
+	mdb_env_close(env_);
+}
+
+bool LmdbEnvironment::get(const Table table, const std::string_view key, const Reader &reader) {
+	std::shared_lock<std::shared_mutex> envLock(env_mtx_);
+	MDB_txn *txn;
+	MDB_CALL(false, mdb_txn_begin, env_, nullptr, MDB_RDONLY, &txn);
+	MDB_val mdb_key = toVal(key), mdb_value;
+	const int err = mdb_get(txn, dbis_[table], &mdb_key, &mdb_value);
+	if (err == MDB_SUCCESS) {
+		reader(toView(mdb_value));
+	} else if (err != MDB_NOTFOUND) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err));
+	}
+	mdb_txn_abort(txn);
+	return err == MDB_SUCCESS;
+}
+
+bool LmdbEnvironment::scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) {
+	std::shared_lock<std::shared_mutex> envLock(env_mtx_);
+	MDB_txn *txn;
+	MDB_CALL(false, mdb_txn_begin, env_, nullptr, MDB_RDONLY, &txn);
+	MDB_cursor *cursor;
+	if (const int err = mdb_cursor_open(txn, dbis_[table], &cursor)) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return false;
+	}
+
+	std::string seek{ from };
+	MDB_val key = toVal(seek), value;
+	int err = mdb_cursor_get(cursor, &key, &value, MDB_SET_RANGE);
+	while (err == MDB_SUCCESS) {
+		const ScanStep step = visitor(toView(key), toView(value), seek);
+		if (step == ScanStep::kNext) {
+			err = mdb_cursor_get(cursor, &key, &value, MDB_NEXT);
+		} else if (step == ScanStep::kSeek) {
+			key = toVal(seek);
+			err = mdb_cursor_get(cursor, &key, &value, MDB_SET_RANGE);
+		} else {
+			break;
+		}
+	}
+	if (err != MDB_SUCCESS && err != MDB_NOTFOUND) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err));
+	}
+
+	if (finish) {
+		finish();
+	}
+	mdb_cursor_close(cursor);
+	mdb_txn_abort(txn);
+	return err == MDB_SUCCESS || err == MDB_NOTFOUND;
+}
+
+bool LmdbEnvironment::putBatch(const Table table, const Batch &entries, const bool append) {
+	unsigned int flags = append ? MDB_APPEND : 0;
+	while (true) {
+		int err;
+		size_t observed_mapsize;
+		{
+			std::shared_lock<std::shared_mutex> envLock(env_mtx_);
+			observed_mapsize = mapsize_;
+			MDB_txn *txn;
+			MDB_CALL(false, mdb_txn_begin, env_, nullptr, MDB_NOSYNC, &txn);
+			err = MDB_SUCCESS;
+			for (const auto &[key, value] : entries) {
+				MDB_val mdb_key = toVal(key), mdb_value = toVal(value);
+				if (isDelete(value)) {
+					if ((err = mdb_del(txn, dbis_[table], &mdb_key, nullptr)) == MDB_NOTFOUND) {
+						err = MDB_SUCCESS;
+					}
+				} else {
+					err = mdb_put(txn, dbis_[table], &mdb_key, &mdb_value, flags);
+				}
+				if (err) {
+					break;
+				}
+			}
+			if (err == MDB_SUCCESS) {
+				// 无论成功与否，commit 后事务都已被释放
+				err = mdb_txn_commit(txn);
+			} else {
+				mdb_txn_abort(txn);
+			}
+		}
+
+		if (err == MDB_SUCCESS) [[likely]] {
+			return true;
+		}
+		if (err == MDB_KEYEXIST && (flags & MDB_APPEND)) {
+			// 数据库中已有更大的 key，如重新生成世界时，整批退回普通的写入
+			flags = 0;
+			continue;
+		}
+		if (err != MDB_MAP_FULL) {
+			ERR_PRINT(mdb_strerror(err));
+			return false;
+		}
+		// map 已满，此时已不持有任何事务，扩容后重试
+		if (!growMapsize(observed_mapsize)) {
+			return false;
+		}
+	}
+}
+
+bool LmdbEnvironment::del(const Table table, const std::string_view key) {
+	std::shared_lock<std::shared_mutex> envLock(env_mtx_);
+	MDB_txn *txn;
+	MDB_CALL(false, mdb_txn_begin, env_, nullptr, MDB_NOSYNC, &txn);
+	MDB_val mdb_key = toVal(key);
+	const int err = mdb_del(txn, dbis_[table], &mdb_key, nullptr);
+	if (err != MDB_SUCCESS && err != MDB_NOTFOUND) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return false;
+	}
+	MDB_CALL(false, mdb_txn_commit, txn);
+	return true;
+}
+
+bool LmdbEnvironment::openTable(const Table table) {
+	std::shared_lock<std::shared_mutex> envLock(env_mtx_);
+	MDB_txn *txn;
+	MDB_CALL(false, mdb_txn_begin, env_, nullptr, MDB_NOSYNC, &txn);
+	if (const int err = mdb_dbi_open(txn, kTableNames[table], MDB_CREATE, &dbis_[table])) {
+		ERR_PRINT(mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return false;
+	}
+	MDB_CALL(false, mdb_txn_commit, txn);
+	return true;
+}
+
+bool LmdbEnvironment::dropTable(const Table table) {
+	std::shared_lock<std::shared_mutex> envLock(env_mtx_);
+	MDB_txn *txn;
+	MDB_CALL(false, mdb_txn_begin, env_, nullptr, MDB_NOSYNC, &txn);
+	if (const int err = mdb_drop(txn, dbis_[table], 1)) {
+		ERR_PRINT(mdb_strerror(err));
+		mdb_txn_abort(txn);
+		return false;
+	}
+	MDB_CALL(false, mdb_txn_commit, txn);
+	return true;
+}
+
+bool LmdbEnvironment::stat(const Table table, MDB_stat &result) {
+	std::shared_lock<std::shared_mutex> envLock(env_mtx_);
+	MDB_txn *txn;
+	MDB_CALL(false, mdb_txn_begin, env_, nullptr, MDB_RDONLY, &txn);
+	const int err = mdb_stat(txn, dbis_[table], &result);
+	mdb_txn_abort(txn);
+	if (err != MDB_SUCCESS) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err));
+		return false;
+	}
+	return true;
+}
+
+bool LmdbEnvironment::flush() {
+	MDB_CALL(false, mdb_env_sync, env_, 1);
+	return true;
+}
+
+uint64_t LmdbEnvironment::version() const {
+	MDB_envinfo info;
+	MDB_CALL(0, mdb_env_info, env_, &info);
+	return info.me_last_txnid;
+}
+
+LmdbEnvironment::Cursor::Cursor(LmdbEnvironment &env, const Table table) :
+		env_lock_(env.env_mtx_) {
+	if ((err_ = mdb_txn_begin(env.env_, nullptr, MDB_RDONLY, &txn_))) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err_));
+		txn_ = nullptr;
+		return;
+	}
+	if ((err_ = mdb_cursor_open(txn_, env.dbis_[table], &cursor_))) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err_));
+		cursor_ = nullptr;
+		return;
+	}
+	err_ = mdb_cursor_get(cursor_, &key_, &value_, MDB_FIRST);
+	if (!ok()) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err_));
+	}
+}
+
+LmdbEnvironment::Cursor::~Cursor() {
+	if (cursor_) {
+		mdb_cursor_close(cursor_);
+	}
+	if (txn_) {
+		mdb_txn_abort(txn_);
+	}
+}
+
+void LmdbEnvironment::Cursor::next() {
+	ERR_FAIL_COND(!valid());
+	err_ = mdb_cursor_get(cursor_, &key_, &value_, MDB_NEXT);
+	if (!ok()) [[unlikely]] {
+		ERR_PRINT(mdb_strerror(err_));
+	}
+}
+
+bool LmdbEnvironment::growMapsize(const size_t current) {
+	// 独占 env_mtx_ 以等待其他线程的事务全部结束，LMDB 要求调整 map size 时进程内没有活动的事务
+	std::unique_lock<std::shared_mutex> envLock(env_mtx_);
+	if (mapsize_ != current) {
+		// 其他线程已经扩容过了
+		return true;
+	}
+	const size_t new_mapsize = current * kMapsizeGrowthFactor;
+	MDB_CALL(false, mdb_env_set_mapsize, env_, new_mapsize);
+	mapsize_ = new_mapsize;
+	print_verbose(String("Database {0} map size grown to {1} bytes.").format(varray(path().c_str(), static_cast<uint64_t>(new_mapsize))));
+	return true;
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,75 @@
+#include "memory_backend.h"
+
+#include <mutex>
+
+namespace pgvoxel {
+
+bool MemoryBackend::get(const Table table, const std::string_view key, const Reader &reader) {
+	Store &store = stores_[table];
+	std::shared_lock<std::shared_mutex> readLock(store.mtx);
+	const auto iter = store.entries.find(key);
+	if (iter == store.entries.end()) {
+		return false;
+	}
+	reader(iter->second);
+	return true;
+}
+
+bool MemoryBackend::scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) {
+	Store &store = stores_[table];
+	std::shared_lock<std::shared_mutex> readLock(store.mtx);
+	std::string seek;
+	auto iter = store.entries.lower_bound(from);
+	while (iter != store.entries.end()) {
+		const ScanStep step = visitor(iter->first, iter->second, seek);
+		if (step == ScanStep::kNext) {
+			++iter;
+		} else if (step == ScanStep::kSeek) {
+			iter = store.entries.lower_bound(seek);
+		} else {
+			break;
+		}
+	}
+	if (finish) {
+		finish();
+	}
+	return true;
+}
+
+bool MemoryBackend::putBatch(const Table table, const Batch &entries, const bool append) {
+	Store &store = stores_[table];
+	std::unique_lock<std::shared_mutex> writeLock(store.mtx);
+	// 有序追加时每次都插入到末尾，以 end() 作为提示可以省去查找
+	for (const auto &[key, value] : entries) {
+		if (isDelete(value)) {
+			const auto iter = store.entries.find(key);
+			if (iter != store.entries.end()) {
+				store.entries.erase(iter);
+			}
+		} else if (append) {
+			store.entries.emplace_hint(store.entries.end(), key, value);
+		} else {
+			store.entries.insert_or_assign(std::string{ key }, std::string{ value });
+		}
+	}
+	return true;
+}
+
+bool MemoryBackend::del(const Table table, const std::string_view key) {
+	Store &store = stores_[table];
+	std::unique_lock<std::shared_mutex> writeLock(store.mtx);
+	const auto iter = store.entries.find(key);
+	if (iter != store.entries.end()) {
+		store.entries.erase(iter);
+	}
+	return true;
+}
+
+bool MemoryBackend::dropTable(const Table table) {
+	Store &store = stores_[table];
+	std::unique_lock<std::shared_mutex> writeLock(store.mtx);
+	store.entries.clear();
+	return true;
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,181 @@
+#include "packed_world_backend.h"
+
+#include "core/error/error_macros.h"
+#include "core/string/print_string.h"
+#include "core/variant/variant.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+
+namespace pgvoxel {
+
+PackedWorldBackend::Writer::Writer(const std::string &path) :
+		path_(path), index_path_(path + ".index.tmp"), data_(path, std::ios::binary | std::ios::trunc), index_(index_path_, std::ios::binary | std::ios::trunc) {
+	// 先占住文件头的位置，finish 时再写入
+	const Header header{};
+	data_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+}
+
+PackedWorldBackend::Writer::~Writer() {
+	index_.close();
+	std::error_code ec;
+	std::filesystem::remove(index_path_, ec);
+}
+
+bool PackedWorldBackend::Writer::beginTable(const Table table) {
+	ERR_FAIL_COND_V_MSG(static_cast<int>(table) <= table_, false, "Tables must be packed in order.");
+	if (table_ >= 0) {
+		counts_[table_] = count_;
+	}
+	table_ = table;
+	count_ = 0;
+	last_key_.clear();
+	return true;
+}
+
+bool PackedWorldBackend::Writer::append(const std::string_view key, const std::string_view value) {
+	ERR_FAIL_COND_V(table_ < 0, false);
+	ERR_FAIL_COND_V_MSG(key.size() > kMaxKeySize, false, "Key is too long to be packed.");
+	ERR_FAIL_COND_V_MSG(count_ != 0 && key <= last_key_, false, "Keys must be packed in order.");
+
+	IndexEntry entry{};
+	entry.key_size = key.size();
+	std::memcpy(entry.key, key.data(), key.size());
+	entry.offset = data_.tellp();
+	entry.size = value.size();
+	data_.write(value.data(), value.size());
+	index_.write(reinterpret_cast<const char *>(&entry), sizeof(entry));
+	last_key_ = key;
+	++count_;
+	return data_.good() && index_.good();
+}
+
+bool PackedWorldBackend::Writer::finish() {
+	if (table_ >= 0) {
+		counts_[table_] = count_;
+	}
+	index_.close();
+	ERR_FAIL_COND_V(!data_.good() || index_.fail(), false);
+
+	// 索引项按 8 字节对齐，以便在映射的内存上直接访问
+	static const char kPadding[sizeof(uint64_t)]{};
+	data_.write(kPadding, (sizeof(uint64_t) - data_.tellp() % sizeof(uint64_t)) % sizeof(uint64_t));
+	Header header{};
+	header.magic = kMagic;
+	header.format_version = kFormatVersion;
+	header.build_id = std::chrono::system_clock::now().time_since_epoch().count();
+	const uint64_t index_offset = data_.tellp();
+	uint64_t offset = index_offset;
+	for (uint8_t table = 0; table < kTableCount; ++table) {
+		header.tables[table] = { offset, counts_[table] };
+		offset += counts_[table] * sizeof(IndexEntry);
+	}
+
+	// 没有任何数据时索引为空，插入空的 rdbuf 会让流进入失败状态
+	if (offset != index_offset) {
+		std::ifstream index(index_path_, std::ios::binary);
+		data_ << index.rdbuf();
+	}
+	data_.seekp(0);
+	data_.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	data_.close();
+	return !data_.fail() && static_cast<uint64_t>(std::filesystem::file_size(path_)) == offset;
+}
+
+PackedWorldBackend::PackedWorldBackend(const std::string &path) :
+		StorageBackend(path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	ERR_FAIL_COND_MSG(fd < 0, String("Failed to open packed world {0}.").format(varray(path.c_str())));
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(Header)) [[unlikely]] {
+		close(fd);
+		ERR_FAIL_MSG("Invalid packed world.");
+	}
+	size_ = st.st_size;
+	void *map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+	// 映射建立后文件描述符就不再需要了
+	close(fd);
+	ERR_FAIL_COND_MSG(map == MAP_FAILED, "Failed to map packed world.");
+	map_ = static_cast<const char *>(map);
+
+	// 只校验文件头和索引的范围，值在读取时才会被换入
+	const Header *header = reinterpret_cast<const Header *>(map_);
+	ERR_FAIL_COND_MSG(header->magic != kMagic || header->format_version != kFormatVersion, "Invalid packed world.");
+	for (const TableIndex &table : header->tables) {
+		ERR_FAIL_COND_MSG(table.offset % sizeof(uint64_t) != 0 || table.offset > size_ || table.count > (size_ - table.offset) / sizeof(IndexEntry), "Corrupted packed world index.");
+	}
+	header_ = header;
+	print_verbose(String("Opened packed world {0}.").format(varray(path.c_str())));
+}
+
+PackedWorldBackend::~PackedWorldBackend() {
+	if (map_) {
+		munmap(const_cast<char *>(map_), size_);
+	}
+}
+
+bool PackedWorldBackend::get(const Table table, const std::string_view key, const Reader &reader) {
+	if (!header_) [[unlikely]] {
+		return false;
+	}
+	const IndexEntry *entry = lowerBound(table, key);
+	if (entry == end(table) || entry->keyView() != key) {
+		return false;
+	}
+	reader(value(*entry));
+	return true;
+}
+
+bool PackedWorldBackend::scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) {
+	ERR_FAIL_COND_V(!header_, false);
+	// 值指向映射的内存，在整个生命周期内都有效
+	std::string seek;
+	const IndexEntry *entry = lowerBound(table, from);
+	while (entry != end(table)) {
+		const ScanStep step = visitor(entry->keyView(), value(*entry), seek);
+		if (step == ScanStep::kNext) {
+			++entry;
+		} else if (step == ScanStep::kSeek) {
+			entry = lowerBound(table, seek);
+		} else {
+			break;
+		}
+	}
+	if (finish) {
+		finish();
+	}
+	return true;
+}
+
+bool PackedWorldBackend::putBatch(const Table, const Batch &, const bool) {
+	ERR_FAIL_V_MSG(false, "Packed world is read-only.");
+}
+
+bool PackedWorldBackend::del(const Table, const std::string_view) {
+	ERR_FAIL_V_MSG(false, "Packed world is read-only.");
+}
+
+bool PackedWorldBackend::openTable(const Table) {
+	ERR_FAIL_V_MSG(false, "Packed world is read-only.");
+}
+
+bool PackedWorldBackend::dropTable(const Table) {
+	ERR_FAIL_V_MSG(false, "Packed world is read-only.");
+}
+
+uint64_t PackedWorldBackend::version() const {
+	return header_ ? header_->build_id : 0;
+}
+
+const PackedWorldBackend::IndexEntry *PackedWorldBackend::lowerBound(const Table table, const std::string_view key) const {
+	return std::lower_bound(begin(table), end(table), key, [](const IndexEntry &entry, const std::string_view key) { return entry.keyView() < key; });
+}
+
+} //namespace pgvoxel
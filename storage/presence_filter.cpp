@@ -0,0 +1,63 @@
+#include "presence_filter.h"
+
+namespace pgvoxel {
+
+PresenceFilter::PresenceFilter(const CoordAxis width) :
+		width_(width), dense_((width * width + 63) / 64), bloom_(kBloomBits / 64) {}
+
+bool PresenceFilter::mayContain(const CoordAxis x, const CoordAxis z) const {
+	if (inExtent(x, z)) [[likely]] {
+		return test(dense_, x * width_ + z);
+	}
+	for (int i = 0; i < kBloomHashes; ++i) {
+		if (!test(bloom_, bloomBit(x, z, i))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void PresenceFilter::insert(const CoordAxis x, const CoordAxis z) {
+	if (inExtent(x, z)) [[likely]] {
+		set(dense_, x * width_ + z);
+		return;
+	}
+	for (int i = 0; i < kBloomHashes; ++i) {
+		set(bloom_, bloomBit(x, z, i));
+	}
+}
+
+uint64_t PresenceFilter::bloomBit(const CoordAxis x, const CoordAxis z, const int i) {
+	uint64_t h1 = x * 0x9E3779B97F4A7C15ULL ^ z * 0xC2B2AE3D27D4EB4FULL;
+	h1 ^= h1 >> 29;
+	const uint64_t h2 = (h1 * 0xBF58476D1CE4E5B9ULL) | 1;
+	return (h1 + i * h2) % kBloomBits;
+}
+
+void PresenceFilter::save(std::ostream &os) const {
+	os.write(reinterpret_cast<const char *>(&width_), sizeof(width_));
+	for (const auto *bits : { &dense_, &bloom_ }) {
+		for (const auto &word : *bits) {
+			const uint64_t value = word.load(std::memory_order_relaxed);
+			os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+		}
+	}
+}
+
+bool PresenceFilter::load(std::istream &is) {
+	CoordAxis width;
+	is.read(reinterpret_cast<char *>(&width), sizeof(width));
+	if (!is || width != width_) {
+		return false;
+	}
+	for (auto *bits : { &dense_, &bloom_ }) {
+		for (auto &word : *bits) {
+			uint64_t value;
+			is.read(reinterpret_cast<char *>(&value), sizeof(value));
+			word.store(value, std::memory_order_relaxed);
+		}
+	}
+	return static_cast<bool>(is);
+}
+
+} //namespace pgvoxel
@@ -0,0 +1,536 @@
+#include "region_file_backend.h"
+#include "chunk_key.h"
+#include "serialize.h"
+
+#include "core/error/error_macros.h"
+#include "core/string/print_string.h"
+#include "core/variant/variant.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace pgvoxel {
+
+RegionFileBackend::RegionFileBackend(const std::string &path) :
+		StorageBackend(path) {
+	std::error_code ec;
+	std::filesystem::create_directories(path, ec);
+	ERR_FAIL_COND_MSG(ec, "Failed to create region directory.");
+
+	const std::string version_file = (std::filesystem::path(path) / kVersionFile).string();
+	version_fd_ = open(version_file.c_str(), O_RDWR | O_CREAT, kPermission);
+	ERR_FAIL_COND_MSG(version_fd_ < 0, "Failed to open region version file.");
+	uint64_t version = 0;
+	if (pread(version_fd_, &version, sizeof(version), 0) == sizeof(version)) {
+		version_ = version;
+	}
+
+	// 只登记已有的区域文件，打开和读取偏移表推迟到首次访问
+	for (const auto &entry : std::filesystem::directory_iterator(path, ec)) {
+		const std::string name = entry.path().filename().string();
+		if (entry.path().extension() != kRegionSuffix) {
+			continue;
+		}
+		const size_t first_dot = name.find('.');
+		const auto table_name = std::find(kTableNames.begin(), kTableNames.end(), name.substr(0, first_dot));
+		CoordAxis rx, rz;
+		if (table_name == kTableNames.end() || std::sscanf(name.c_str() + first_dot, ".%lu.%lu", &rx, &rz) != 2) [[unlikely]] {
+			continue;
+		}
+		const std::string key{ ChunkKey(rx << kRegionBits, 0, rz << kRegionBits).bytes() };
+		auto region = std::make_unique<Region>();
+		region->file = entry.path().string();
+		stores_[table_name - kTableNames.begin()].regions.emplace(regionOf(key), std::move(region));
+	}
+	print_verbose(String("Opened region storage {0}.").format(varray(path.c_str())));
+}
+
+RegionFileBackend::~RegionFileBackend() {
+	flush();
+	for (Store &store : stores_) {
+		for (const auto &[id, region] : store.regions) {
+			if (region->fd >= 0) {
+				close(region->fd);
+			}
+		}
+	}
+	if (version_fd_ >= 0) {
+		close(version_fd_);
+	}
+}
+
+bool RegionFileBackend::get(const Table table, const std::string_view key, const Reader &reader) {
+	Region *region = findRegion(table, key, false);
+	if (!region) {
+		return false;
+	}
+	ERR_FAIL_COND_V(!ensureLoaded(*region), false);
+
+	// 读取期间持有区域的共享锁，以免写入改变偏移表
+	thread_local std::string value;
+	{
+		std::shared_lock<std::shared_mutex> regionLock(region->mtx);
+		const auto iter = region->index.find(key);
+		if (iter == region->index.end()) {
+			return false;
+		}
+		ERR_FAIL_COND_V(!readValue(*region, iter->second, value), false);
+	}
+	reader(value);
+	return true;
+}
+
+bool RegionFileBackend::scan(const Table table, const std::string_view from, const Visitor &visitor, const Finish &finish) {
+	Store &store = stores_[table];
+	// 有 finish 时遍历中得到的 key 和值在 finish 前都要保持有效，区域的锁在离开区域时就会释放，因此复制出来
+	// 否则值只需在 visitor 中有效，复用同一个缓冲区，内存占用与遍历的范围无关
+	const bool retain = static_cast<bool>(finish);
+	std::deque<std::pair<std::string, std::string>> retained;
+	std::string buffer;
+	std::string seek{ from };
+	bool ok = true, stop = false;
+
+	std::shared_lock<std::shared_mutex> storeLock(store.mtx);
+	auto region_iter = store.regions.lower_bound(regionOf(seek));
+	while (!stop && region_iter != store.regions.end()) {
+		Region &region = *region_iter->second;
+		if (!ensureLoaded(region)) [[unlikely]] {
+			ok = false;
+			break;
+		}
+		bool moved = false;
+		{
+			std::shared_lock<std::shared_mutex> regionLock(region.mtx);
+			auto iter = region.index.lower_bound(seek);
+			while (iter != region.index.end()) {
+				std::string &value = retain ? retained.emplace_back(iter->first, std::string{}).second : buffer;
+				if (!readValue(region, iter->second, value)) [[unlikely]] {
+					ok = false;
+					stop = true;
+					break;
+				}
+				const ScanStep step = visitor(retain ? std::string_view{ retained.back().first } : std::string_view{ iter->first }, value, seek);
+				if (step == ScanStep::kNext) {
+					++iter;
+				} else if (step == ScanStep::kSeek) {
+					// 跳到其他区域时重新查找区域
+					if (regionOf(seek) != region_iter->first) {
+						moved = true;
+						break;
+					}
+					iter = region.index.lower_bound(seek);
+				} else {
+					stop = true;
+					break;
+				}
+			}
+		}
+		if (moved) {
+			region_iter = store.regions.lower_bound(regionOf(seek));
+		} else {
+			++region_iter;
+		}
+	}
+
+	if (finish) {
+		finish();
+	}
+	return ok;
+}
+
+bool RegionFileBackend::putBatch(const Table table, const Batch &entries, const bool) {
+	// 区域文件总是追加写入，有序与否都一样
+	std::unordered_map<uint64_t, Batch> groups;
+	for (const auto &entry : entries) {
+		groups[regionOf(entry.first)].push_back(entry);
+	}
+	for (const auto &[id, group] : groups) {
+		// 只有删除时不必创建区域
+		const bool create = std::any_of(group.begin(), group.end(), [](const auto &entry) { return !isDelete(entry.second); });
+		Region *region = findRegion(table, group.front().first, create);
+		if (!region) {
+			ERR_FAIL_COND_V(create, false);
+			continue;
+		}
+		ERR_FAIL_COND_V(!ensureLoaded(*region), false);
+		std::unique_lock<std::shared_mutex> regionLock(region->mtx);
+		if (!append(*region, group)) [[unlikely]] {
+			return false;
+		}
+		compactIfNeeded(*region);
+	}
+	return true;
+}
+
+bool RegionFileBackend::del(const Table table, const std::string_view key) {
+	Region *region = findRegion(table, key, false);
+	if (!region) {
+		return true;
+	}
+	ERR_FAIL_COND_V(!ensureLoaded(*region), false);
+	std::unique_lock<std::shared_mutex> regionLock(region->mtx);
+	if (!append(*region, { { key, kDelete } })) [[unlikely]] {
+		return false;
+	}
+	compactIfNeeded(*region);
+	return true;
+}
+
+bool RegionFileBackend::dropTable(const Table table) {
+	ERR_FAIL_COND_V(!bumpVersion(), false);
+	Store &store = stores_[table];
+	std::unique_lock<std::shared_mutex> storeLock(store.mtx);
+	std::error_code ec;
+	for (const auto &[id, region] : store.regions) {
+		std::unique_lock<std::shared_mutex> regionLock(region->mtx);
+		if (region->fd >= 0) {
+			close(region->fd);
+		}
+		std::filesystem::remove(region->file, ec);
+		std::filesystem::remove(region->file + kIndexSuffix, ec);
+	}
+	store.regions.clear();
+	return true;
+}
+
+bool RegionFileBackend::flush() {
+	// 在写出之前标记，flush 期间开始的修改会再次递增版本号
+	{
+		std::lock_guard<std::mutex> lock(version_mtx_);
+		clean_ = true;
+	}
+	bool ok = true;
+	for (Store &store : stores_) {
+		std::shared_lock<std::shared_mutex> storeLock(store.mtx);
+		for (const auto &[id, region] : store.regions) {
+			std::unique_lock<std::shared_mutex> regionLock(region->mtx);
+			if (!region->dirty) {
+				continue;
+			}
+			if (fdatasync(region->fd) != 0 || !saveIndex(*region)) [[unlikely]] {
+				ERR_PRINT(String("Failed to flush region file {0}.").format(varray(region->file.c_str())));
+				ok = false;
+				continue;
+			}
+			region->dirty = false;
+		}
+	}
+	return ok;
+}
+
+uint64_t RegionFileBackend::regionOf(const std::string_view key) {
+	// 长度不足的 key 只会作为遍历的起点出现，补零后不影响顺序
+	std::array<char, ChunkKey::kSize> bytes{};
+	std::copy_n(key.begin(), std::min<size_t>(key.size(), ChunkKey::kSize), bytes.begin());
+	return ChunkKey::fromBytes(bytes.data()).value() >> (ChunkKey::kHeightBits + kRegionBits * 2);
+}
+
+std::string RegionFileBackend::regionFile(const Table table, const std::string_view key) const {
+	const Coord pos = ChunkKey::fromBytes(key.data()).position();
+	return (std::filesystem::path(path()) / (std::string(kTableNames[table]) + "." + std::to_string(pos.x >> kRegionBits) + "." + std::to_string(pos.z >> kRegionBits) + kRegionSuffix)).string();
+}
+
+RegionFileBackend::Region *RegionFileBackend::findRegion(const Table table, const std::string_view key, const bool create) {
+	Store &store = stores_[table];
+	const uint64_t id = regionOf(key);
+	{
+		std::shared_lock<std::shared_mutex> storeLock(store.mtx);
+		const auto iter = store.regions.find(id);
+		if (iter != store.regions.end()) {
+			return iter->second.get();
+		}
+	}
+	if (!create) {
+		return nullptr;
+	}
+	std::unique_lock<std::shared_mutex> storeLock(store.mtx);
+	auto &region = store.regions[id];
+	if (!region) {
+		region = std::make_unique<Region>();
+		region->file = regionFile(table, key);
+	}
+	return region.get();
+}
+
+bool RegionFileBackend::ensureLoaded(Region &region) {
+	if (region.loaded.load(std::memory_order_acquire)) [[likely]] {
+		return true;
+	}
+	std::unique_lock<std::shared_mutex> regionLock(region.mtx);
+	if (region.loaded.load(std::memory_order_relaxed)) {
+		return true;
+	}
+
+	region.fd = open(region.file.c_str(), O_RDWR | O_CREAT, kPermission);
+	ERR_FAIL_COND_V_MSG(region.fd < 0, false, String("Failed to open region file {0}.").format(varray(region.file.c_str())));
+	const off_t size = lseek(region.fd, 0, SEEK_END);
+	ERR_FAIL_COND_V(size < 0, false);
+
+	uint64_t offset = 0;
+	if (!loadIndex(region, offset) || offset > static_cast<uint64_t>(size)) {
+		region.index.clear();
+		offset = 0;
+	}
+	// 重放偏移表之后追加的记录，只需读取记录头和 key
+	std::string key;
+	while (offset + kRecordHeaderSize <= static_cast<uint64_t>(size)) {
+		char header[kRecordHeaderSize];
+		if (pread(region.fd, header, kRecordHeaderSize, offset) != kRecordHeaderSize) [[unlikely]] {
+			break;
+		}
+		uint16_t key_size;
+		uint32_t value_size;
+		std::memcpy(&key_size, header, sizeof(key_size));
+		std::memcpy(&value_size, header + sizeof(key_size), sizeof(value_size));
+		const uint64_t record_size = kRecordHeaderSize + key_size + (value_size == kTombstone ? 0 : value_size);
+		if (offset + record_size > static_cast<uint64_t>(size)) {
+			break;
+		}
+		key.resize(key_size);
+		if (pread(region.fd, key.data(), key_size, offset + kRecordHeaderSize) != key_size) [[unlikely]] {
+			break;
+		}
+		if (value_size == kTombstone) {
+			region.index.erase(key);
+		} else {
+			region.index.insert_or_assign(key, Location{ offset + kRecordHeaderSize + key_size, value_size });
+		}
+		offset += record_size;
+	}
+	// 末尾不完整的记录来自中断的写入，截断后从这里继续追加
+	if (offset != static_cast<uint64_t>(size)) {
+		print_line(String("Truncated incomplete records in region file {0}.").format(varray(region.file.c_str())));
+		ERR_FAIL_COND_V(!bumpVersion() || ftruncate(region.fd, offset) != 0, false);
+	}
+	region.end = offset;
+	region.live = 0;
+	for (const auto &[key, location] : region.index) {
+		region.live += recordSize(key.size(), location.size);
+	}
+	region.loaded.store(true, std::memory_order_release);
+	return true;
+}
+
+bool RegionFileBackend::loadIndex(Region &region, uint64_t &covered) {
+	std::ifstream ifs(region.file + kIndexSuffix, std::ios::binary);
+	if (!ifs) {
+		return false;
+	}
+	uint64_t count;
+	DESERIALIZE_READ(ifs, covered);
+	DESERIALIZE_READ(ifs, count);
+	std::string key;
+	for (uint64_t i = 0; i < count && ifs; ++i) {
+		uint16_t key_size;
+		Location location;
+		DESERIALIZE_READ(ifs, key_size);
+		key.resize(key_size);
+		ifs.read(key.data(), key_size);
+		DESERIALIZE_READ(ifs, location.offset);
+		DESERIALIZE_READ(ifs, location.size);
+		region.index.emplace_hint(region.index.end(), key, location);
+	}
+	return static_cast<bool>(ifs);
+}
+
+bool RegionFileBackend::saveIndex(const Region &region) {
+	const std::string path = region.file + kIndexSuffix;
+	const std::string temp_path = path + ".tmp";
+	{
+		std::ofstream ofs(temp_path, std::ios::binary | std::ios::trunc);
+		ERR_FAIL_COND_V(!ofs, false);
+		const uint64_t count = region.index.size();
+		SERIALIZE_WRITE(ofs, region.end);
+		SERIALIZE_WRITE(ofs, count);
+		for (const auto &[key, location] : region.index) {
+			const uint16_t key_size = key.size();
+			SERIALIZE_WRITE(ofs, key_size);
+			ofs.write(key.data(), key_size);
+			SERIALIZE_WRITE(ofs, location.offset);
+			SERIALIZE_WRITE(ofs, location.size);
+		}
+		ERR_FAIL_COND_V(!ofs, false);
+	}
+	std::error_code ec;
+	std::filesystem::rename(temp_path, path, ec);
+	return !ec;
+}
+
+bool RegionFileBackend::append(Region &region, const Batch &entries) {
+	std::string buffer;
+	std::vector<Location> locations;
+	locations.reserve(entries.size());
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const auto &[key, value] = entries[i];
+		ERR_FAIL_COND_V(key.size() < ChunkKey::kSize || key.size() > UINT16_MAX || value.size() >= kTombstone, false);
+		const bool tombstone = isDelete(value);
+		// 删除不存在的 key 时不写入记录，除非它在同一批中刚被写入
+		if (tombstone && !region.index.contains(key) &&
+				std::none_of(entries.begin(), entries.begin() + i, [&](const auto &entry) { return entry.first == key; })) {
+			locations.push_back({ 0, kTombstone });
+			continue;
+		}
+		const uint16_t key_size = key.size();
+		const uint32_t value_size = tombstone ? kTombstone : value.size();
+		buffer.append(reinterpret_cast<const char *>(&key_size), sizeof(key_size));
+		buffer.append(reinterpret_cast<const char *>(&value_size), sizeof(value_size));
+		buffer.append(key);
+		locations.push_back({ region.end + buffer.size(), static_cast<uint32_t>(value.size()) });
+		if (!tombstone) {
+			buffer.append(value);
+		}
+	}
+	if (buffer.empty()) {
+		return true;
+	}
+
+	ERR_FAIL_COND_V(!bumpVersion(), false);
+	for (size_t written = 0; written < buffer.size();) {
+		const ssize_t result = pwrite(region.fd, buffer.data() + written, buffer.size() - written, region.end + written);
+		if (result < 0) [[unlikely]] {
+			ERR_PRINT(String("Failed to write region file {0}: {1}.").format(varray(region.file.c_str(), strerror(errno))));
+			// region.end 没有前进，写入了一部分的记录会被之后的写入覆盖
+			return false;
+		}
+		written += result;
+	}
+
+	// 被覆盖或删除的旧记录和删除记录本身都不再计入 live
+	for (size_t i = 0; i < entries.size(); ++i) {
+		const auto iter = region.index.find(entries[i].first);
+		if (iter != region.index.end()) {
+			region.live -= recordSize(iter->first.size(), iter->second.size);
+		}
+		if (isDelete(entries[i].second)) {
+			if (iter != region.index.end()) {
+				region.index.erase(iter);
+			}
+		} else {
+			region.live += recordSize(entries[i].first.size(), locations[i].size);
+			if (iter != region.index.end()) {
+				iter->second = locations[i];
+			} else {
+				region.index.emplace(entries[i].first, locations[i]);
+			}
+		}
+	}
+	region.end += buffer.size();
+	region.dirty = true;
+	return true;
+}
+
+void RegionFileBackend::compactIfNeeded(Region &region) {
+	const uint64_t dead = region.end - region.live;
+	if (dead < kCompactMinDeadBytes || dead < region.end * kCompactDeadRatio) {
+		return;
+	}
+	// 整理失败时原文件保持不变，只是暂时不回收空间
+	if (!compact(region)) [[unlikely]] {
+		ERR_PRINT(String("Failed to compact region file {0}.").format(varray(region.file.c_str())));
+	}
+}
+
+bool RegionFileBackend::compact(Region &region) {
+	ERR_FAIL_COND_V(!bumpVersion(), false);
+	// 按 key 的顺序把仍然有效的记录写入临时文件，再替换原文件
+	const std::string temp_path = region.file + ".tmp";
+	const int fd = open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, kPermission);
+	ERR_FAIL_COND_V(fd < 0, false);
+	const auto fail = [&]() {
+		close(fd);
+		std::error_code ec;
+		std::filesystem::remove(temp_path, ec);
+		return false;
+	};
+
+	std::map<std::string, Location, std::less<>> index;
+	std::string buffer, value;
+	uint64_t end = 0;
+	const auto flushBuffer = [&]() {
+		for (size_t written = 0; written < buffer.size();) {
+			const ssize_t result = pwrite(fd, buffer.data() + written, buffer.size() - written, end + written);
+			if (result < 0) [[unlikely]] {
+				return false;
+			}
+			written += result;
+		}
+		end += buffer.size();
+		buffer.clear();
+		return true;
+	};
+	for (const auto &[key, location] : region.index) {
+		if (!readValue(region, location, value)) [[unlikely]] {
+			return fail();
+		}
+		const uint16_t key_size = key.size();
+		const uint32_t value_size = value.size();
+		buffer.append(reinterpret_cast<const char *>(&key_size), sizeof(key_size));
+		buffer.append(reinterpret_cast<const char *>(&value_size), sizeof(value_size));
+		buffer.append(key);
+		index.emplace_hint(index.end(), key, Location{ end + buffer.size(), value_size });
+		buffer.append(value);
+		if (buffer.size() >= kCompactBufferSize && !flushBuffer()) [[unlikely]] {
+			return fail();
+		}
+	}
+	if (!flushBuffer() || fdatasync(fd) != 0) [[unlikely]] {
+		return fail();
+	}
+
+	// 先删除旧的偏移表，替换后中途退出时会从头重放新文件，而不是使用指向旧文件的偏移
+	std::error_code ec;
+	std::filesystem::remove(region.file + kIndexSuffix, ec);
+	std::filesystem::rename(temp_path, region.file, ec);
+	if (ec) [[unlikely]] {
+		return fail();
+	}
+	close(region.fd);
+	region.fd = fd;
+	region.end = end;
+	region.live = end;
+	region.index = std::move(index);
+	region.dirty = !saveIndex(region);
+	print_verbose(String("Compacted region file {0}.").format(varray(region.file.c_str())));
+	return true;
+}
+
+bool RegionFileBackend::bumpVersion() {
+	std::lock_guard<std::mutex> lock(version_mtx_);
+	if (!clean_) {
+		return true;
+	}
+	// 先持久化再修改文件，之后无论是否正常关闭，磁盘上的版本号都不会等于 flush 时的值
+	const uint64_t version = version_ + 1;
+	if (version_fd_ < 0 || pwrite(version_fd_, &version, sizeof(version), 0) != sizeof(version) || fdatasync(version_fd_) != 0) [[unlikely]] {
+		ERR_PRINT(String("Failed to update region version file in {0}.").format(varray(path().c_str())));
+		return false;
+	}
+	version_ = version;
+	clean_ = false;
+	return true;
+}
+
+bool RegionFileBackend::readValue(const Region &region, const Location &location, std::string &value) {
+	value.resize(location.size);
+	for (size_t read = 0; read < location.size;) {
+		const ssize_t result = pread(region.fd, value.data() + read, location.size - read, location.offset + read);
+		if (result <= 0) [[unlikely]] {
+			ERR_PRINT(String("Failed to read region file {0}.").format(varray(region.file.c_str())));
+			return false;
+		}
+		read += result;
+	}
+	return true;
+}
+
+} //namespace pgvoxel
@@ -1,185 +1,1106 @@
 #include "world_db.h"
 #include "chunk.inl"
+#include "chunk_batch.h"
+#include "chunk_delta.h"
+#include "chunk_key.h"
+#include "lmdb_environment.h"
+#include "memory_backend.h"
+#include "packed_world_backend.h"
+#include "region_file_backend.h"
 
 #include "core/variant/dictionary.h"
 #include "core/variant/variant.h"
 #include "forward.h"
-#include "scope_guard.h"
 #include "core/error/error_macros.h"
 #include "core/string/print_string.h"
 #include "core/io/json.h"
+#include "core/io/marshalls.h"
 
 #include "serialize.h"
+#include "world_config.h"
 
-#define MDB_CALL(ERR_RETVAL, MDB_FUNC, ...)           \
-	do {                                              \
-		if (const auto err = MDB_FUNC(__VA_ARGS__)) { \
-			ERR_PRINT(mdb_strerror(err));             \
-			return ERR_RETVAL;                        \
-		}                                             \
-	} while (false)
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <queue>
+#include <string>
+#include <string_view>
 
 namespace pgvoxel{
 
-WorldDB::WorldDB() {
-    // 打开数据库环境
-    // const auto &config = WorldConfig::instance().data;
-    MDB_CALL(, mdb_env_create, &env_);
-    MDB_CALL(, mdb_env_set_maxdbs, env_, kMaxdbs);
-    MDB_CALL(, mdb_env_set_mapsize, env_, kMapsize);
-    MDB_CALL(, mdb_env_open, env_, kDatabaseEnv, MDB_NOSUBDIR, kPermission);
-
-    // 打开各个数据库
-    auto txn = beginTransaction(0);
-    MDB_CALL(, mdb_dbi_open, txn, kMetadataDB, MDB_CREATE, &metadata_db_);
-    MDB_CALL(, mdb_dbi_open, txn, kTerrainDB, MDB_CREATE, &terrain_db_);
-    MDB_CALL(, mdb_txn_commit, txn);
-
-    print_verbose("Succeed opening database.")
-}
-
-std::unique_ptr<LoadedChunk> WorldDB::loadChunk(const Coord &pos) {
-    // 依据chunk坐标构造指向地形数据的key，获取key所在位置的地形数据，反序列化数据
-    MDB_val key, data;
-    uint32_t key_data = global_pos_to_index(pos);
-    key.mv_size = sizeof(key_data);
-    key.mv_data = &key_data;
-
-    std::shared_lock<std::shared_mutex> readLock(terrain_mtx);
-    auto txn = beginTransaction(MDB_RDONLY);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(nullptr, mdb_get, txn, terrain_db_, &key, &data);
-    std::istringstream iss(std::string{static_cast<char *>(data.mv_data), data.mv_size});
+// 从压缩缓存或旧版本的数据库值中解码出整个区块，数据库中的值只在事务有效期间可用
+static std::unique_ptr<LoadedChunk> decodeChunk(const Coord &pos, const std::string_view data, const LoadedChunk::LayerMask layers) {
+    ViewStream iss(data);
     auto chunk = LoadedChunk::create(pos);
-    iss >> *chunk;
-    commitTransaction(txn, guard);
+    uint32_t size;
+    DESERIALIZE_READ(iss, size);
+    chunk->deserialize(iss, size, layers);
+    return chunk;
+}
+
+// terrain 中一个区块的各条数据
+// 区块按层储存在 ChunkKey::layerKey 下，只有被修改过的层会被重写；没有写入过的层为空
+// 旧版本把整个区块储存在 ChunkKey 下，仍然可以读取，同时存在时以各层的数据为准
+// 开启 batch_terrain 时基础地形储存在所在组的 ChunkBatch 中
+struct StoredChunk {
+    Coord pos;
+    std::string_view batch;
+    std::string_view legacy;
+    std::array<std::string_view, LoadedChunk::kDataChunkNums> layers;
+    // 叠加在基础地形上的玩家修改，可以为空
+    const WorldDB::Overlay *overlay{};
+};
+
+// 将 terrain 中的一条数据归入 stored，key 不属于 stored 所指的区块时返回 false
+static bool collectStoredChunk(StoredChunk &stored, const std::string_view key, const std::string_view data) {
+    if (key.size() == ChunkKey::kSize) {
+        stored.legacy = data;
+    } else if (key.size() == ChunkKey::kSize + 1 && static_cast<uint8_t>(key.back()) < LoadedChunk::kDataChunkNums) {
+        stored.layers[static_cast<uint8_t>(key.back())] = data;
+    } else [[unlikely]] {
+        return false;
+    }
+    return true;
+}
+
+static std::unique_ptr<LoadedChunk> decodeStoredChunk(const StoredChunk &stored, const LoadedChunk::LayerMask layers) {
+    auto chunk = stored.legacy.empty() ? LoadedChunk::create(stored.pos) : decodeChunk(stored.pos, stored.legacy, layers);
+    if (!stored.batch.empty()) {
+        ChunkBatch::decode(stored.batch, *chunk, layers);
+    }
+    for (uint8_t i = 0; i < LoadedChunk::kDataChunkNums; ++i) {
+        if ((layers & (1 << i)) && !stored.layers[i].empty()) {
+            ViewStream iss(stored.layers[i]);
+            chunk->deserializeLayer(iss, i);
+        }
+    }
+    if (stored.overlay) {
+        for (uint8_t i = 0; i < LoadedChunk::kDataChunkNums; ++i) {
+            if ((layers & (1 << i)) && !(*stored.overlay)[i].empty()) {
+                ChunkDelta::apply(*chunk, i, (*stored.overlay)[i]);
+            }
+        }
+    }
+    chunk->clearDirty();
+    return chunk;
+}
+
+// 读取区块的基础地形并叠加 overlay，两者都不存在时返回 nullptr
+// batched 为 true 时基础地形储存在 ChunkBatch 中
+static std::unique_ptr<LoadedChunk> readChunk(StorageBackend &shard, const Coord &pos, const LoadedChunk::LayerMask layers, const WorldDB::Overlay *overlay, const bool batched) {
+    const ChunkKey chunk_key(pos);
+    StoredChunk stored{pos};
+    stored.overlay = overlay;
+    bool found = false;
+    std::unique_ptr<LoadedChunk> chunk;
+    if (batched) {
+        // 值只在 reader 中有效，因此在其中解码。同组的其他区块存在而该区块不存在时，只有 overlay
+        shard.get(StorageBackend::kTerrainTable, ChunkBatch::key(pos), [&](const std::string_view value) {
+            if (ChunkBatch::contains(value, pos)) {
+                stored.batch = value;
+                chunk = decodeStoredChunk(stored, layers);
+            }
+        });
+        if (!chunk && overlay) {
+            chunk = decodeStoredChunk(stored, layers);
+        }
+        return chunk;
+    }
+
+    const auto visitor = [&](const std::string_view key, const std::string_view data, std::string &) {
+        if (!key.starts_with(chunk_key.bytes()) || !collectStoredChunk(stored, key, data)) {
+            return StorageBackend::ScanStep::kStop;
+        }
+        found = true;
+        return StorageBackend::ScanStep::kNext;
+    };
+    // 数据只在事务有效期间可用，因此在事务结束前解码
+    const auto finish = [&]() {
+        if (found || overlay) {
+            chunk = decodeStoredChunk(stored, layers);
+        }
+    };
+    shard.scan(StorageBackend::kTerrainTable, chunk_key.bytes(), visitor, finish);
+    return chunk;
+}
+
+// 当前线程以共享方式持有的 terrain 锁。区块只会在持有某个分片的 terrain 锁时被放入缓存并引发淘汰，
+// 淘汰回调据此判断被淘汰区块所在分片的锁是否已被本线程持有，避免重复加锁
+static thread_local const std::shared_mutex *held_terrain_mtx = nullptr;
+
+// 以共享方式持有分片的 terrain 锁，并记录在 held_terrain_mtx 中
+class TerrainReadLock {
+public:
+    explicit TerrainReadLock(std::shared_mutex &mtx) :
+            lock_(mtx), previous_(held_terrain_mtx) {
+        held_terrain_mtx = &mtx;
+    }
+    ~TerrainReadLock() { held_terrain_mtx = previous_; }
+
+private:
+    std::shared_lock<std::shared_mutex> lock_;
+    const std::shared_mutex *previous_;
+};
+
+WorldDB::WorldDB() :
+        WorldDB(openShards(), openOverlay(), WorldConfig::loaded() && WorldConfig::singleton().data.batch_terrain) {
+}
+
+WorldDB::WorldDB(std::vector<std::unique_ptr<StorageBackend>> &&shards, std::unique_ptr<StorageBackend> &&overlay, const bool batch_terrain) :
+        shards_(std::move(shards)), overlay_(std::move(overlay)), batch_terrain_(batch_terrain) {
+    // 只读的存储（打包的世界）在映射的索引上二分查找，查找本身已经足够便宜，不使用过滤器，启动时也就不必遍历整个索引来重建
+    const bool read_only = std::all_of(shards_.begin(), shards_.end(), [](const auto &shard) { return shard->readOnly(); });
+    if (!read_only) {
+        base_presence_ = openPresence(shardEnvs(), { StorageBackend::kMetadataTable, StorageBackend::kTerrainTable });
+    }
+    overlay_presence_ = openPresence({ overlay_.get() }, { StorageBackend::kOverlayTable, StorageBackend::kMetadataTable });
+
+    if (WorldConfig::loaded() && WorldConfig::singleton().data.chunk_cache_size != 0) {
+        chunk_cache_.setBudget(WorldConfig::singleton().data.chunk_cache_size);
+    }
+    if (WorldConfig::loaded() && WorldConfig::singleton().data.compressed_chunk_cache_size != 0) {
+        compressed_chunk_cache_.setBudget(WorldConfig::singleton().data.compressed_chunk_cache_size);
+    }
+    // 被淘汰的区块重新序列化后转入压缩缓存
+    // 被淘汰的区块可能属于另一个分片，只有持有其所在分片的 terrain 锁才能保证不与它的 saveChunk 交错，拿不到锁时直接丢弃
+    chunk_cache_.setEvictionHandler([this](const Coord &pos, std::shared_ptr<const LoadedChunk> &&chunk) {
+        std::shared_mutex &mtx = shardOf(pos.x, pos.z).tableMutex(StorageBackend::kTerrainTable);
+        std::shared_lock<std::shared_mutex> readLock(mtx, std::defer_lock);
+        if (&mtx != held_terrain_mtx && !readLock.try_lock()) {
+            return;
+        }
+        std::ostringstream oss;
+        oss << *chunk;
+        auto compressed = std::make_shared<const std::string>(oss.str());
+        const size_t bytes = compressed->capacity() + sizeof(std::string);
+        compressed_chunk_cache_.put(pos, std::move(compressed), bytes);
+    });
+
+    print_verbose(String("Succeed opening database with {0} shard(s).").format(varray(shards_.size())));
+}
+
+std::vector<std::unique_ptr<StorageBackend>> WorldDB::openShards() {
+    const std::string backend = WorldConfig::loaded() ? WorldConfig::singleton().data.storage_backend : "";
+    // 打包的世界是单个文件，不分片
+    uint32_t shard_count = WorldConfig::loaded() ? std::max<uint32_t>(WorldConfig::singleton().data.shards, 1) : 1;
+    if (backend == kPackedBackend && shard_count != 1) {
+        print_line("Packed world is not sharded, ignoring shards in config.");
+        shard_count = 1;
+    }
+
+    // 打开各个分片，估算的 map size 平均分给各分片，不够时各分片会自行扩容
+    const ::size_t mapsize = std::max<::size_t>(estimateMapsize() / shard_count, kMinShardMapsize);
+    std::vector<std::unique_ptr<StorageBackend>> shards;
+    if (shard_count == 1) {
+        shards.push_back(openBackend(backend, kDatabaseEnv, mapsize, { StorageBackend::kMetadataTable, StorageBackend::kTerrainTable }));
+    } else {
+        for (uint32_t i = 0; i < shard_count; ++i) {
+            shards.push_back(openBackend(backend, kShardEnvPrefix + std::to_string(i), mapsize, { StorageBackend::kMetadataTable, StorageBackend::kTerrainTable }));
+        }
+    }
+    return shards;
+}
+
+std::unique_ptr<StorageBackend> WorldDB::openOverlay() {
+    const std::string backend = WorldConfig::loaded() ? WorldConfig::singleton().data.storage_backend : "";
+    // 打包的世界是只读的，玩家的修改和运行时写入的 metadata 仍然写入 LMDB
+    return openBackend(backend == kPackedBackend ? kLmdbBackend : backend, kOverlayEnv, kMinShardMapsize, { StorageBackend::kOverlayTable, StorageBackend::kMetadataTable });
+}
+
+std::shared_ptr<const LoadedChunk> WorldDB::loadChunk(const Coord &pos) {
+    // 从未生成或修改过的区块无需访问数据库，在世界边缘和未探索的区域中很常见
+    const size_t shard_index = shardIndexOf(pos.x, pos.z);
+    const bool in_base = mayContainBase(StorageBackend::kTerrainTable, pos.x, pos.z);
+    const bool in_overlay = overlay_presence_[StorageBackend::kOverlayTable]->mayContain(pos.x, pos.z);
+    if (!in_base && !in_overlay) {
+        return nullptr;
+    }
+
+    if (auto cached = chunk_cache_.get(pos)) {
+        return *cached;
+    }
+
+    StorageBackend &shard = *shards_[shard_index];
+    TerrainReadLock readLock(shard.tableMutex(StorageBackend::kTerrainTable));
+    if (auto compressed = compressed_chunk_cache_.get(pos)) {
+        // 从内存中解压要比访问数据库便宜得多，解压后提升回 chunk_cache_
+        std::shared_ptr<const LoadedChunk> chunk = decodeChunk(pos, **compressed, LoadedChunk::kAllLayers);
+        compressed_chunk_cache_.erase(pos);
+        chunk_cache_.put(pos, chunk, chunk->memoryUsage());
+        return chunk;
+    }
+
+    // 依据chunk坐标读取该区块的基础地形和玩家的修改，反序列化数据
+    std::unordered_map<Coord, Overlay> overlays;
+    if (in_overlay) {
+        overlays = loadOverlays(pos, pos + Coord(1), nullptr);
+    }
+    const Overlay *overlay = overlays.empty() ? nullptr : &overlays.begin()->second;
+    std::shared_ptr<const LoadedChunk> chunk;
+    if (in_base) {
+        chunk = readChunk(shard, pos, LoadedChunk::kAllLayers, overlay, batch_terrain_);
+    } else if (overlay) {
+        StoredChunk stored{pos};
+        stored.overlay = overlay;
+        chunk = decodeStoredChunk(stored, LoadedChunk::kAllLayers);
+    }
+    // 区块不存在不算错误，读取出错时存储已经报告过
+    if (!chunk) {
+        return nullptr;
+    }
+    // 在持有 terrain 锁时放入缓存，保证不会覆盖掉 saveChunk 写入的新数据
+    chunk_cache_.put(pos, chunk, chunk->memoryUsage());
 
     // print_verbose(String("Succeed loading chunk {0}.").format(varray(toVector3i(chunk->position_))));
     return chunk;
 }
 
+std::unique_ptr<LoadedChunk> WorldDB::loadChunkForEdit(const Coord &pos) {
+    // 缓存中的区块在多处共享，复制一份再交给调用者修改
+    const std::shared_ptr<const LoadedChunk> chunk = loadChunk(pos);
+    if (!chunk) {
+        return nullptr;
+    }
+    auto copy = chunk->clone();
+    copy->clearDirty();
+    return copy;
+}
+
 void WorldDB::saveChunk(LoadedChunk *chunk) {
-    // 依据chunk坐标构造指向地形数据的key，序列化地形数据，写入key所在位置
-    MDB_val key, data;
-    uint32_t key_data = global_pos_to_index(chunk->getPosition());
-    key.mv_size = sizeof(key_data);
-    key.mv_data = &key_data;
-    std::ostringstream oss;
-    oss << *chunk;
-    std::string_view buffer{oss.view()};
-    data.mv_size = buffer.size();
-    data.mv_data = const_cast<char *>(buffer.data());
-
-    std::unique_lock<std::shared_mutex> writeLock(terrain_mtx);
-    auto txn = beginTransaction(MDB_WRITEMAP | MDB_NOSYNC);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(, mdb_put, txn, terrain_db_, &key, &data, 0);
-    commitTransaction(txn, guard);
+    // 没有被修改过的区块与数据库中的一致，无需写入
+    const LoadedChunk::LayerMask dirty = chunk->dirtyLayers();
+    if (dirty == 0) {
+        return;
+    }
+
+    // 基础地形在生成后不再改变，无需加锁即可读取被修改的层，与之比较得到差异
+    const Coord &pos = chunk->getPosition();
+    const ChunkKey chunk_key(pos);
+    const size_t shard_index = shardIndexOf(pos.x, pos.z);
+    StorageBackend &shard = *shards_[shard_index];
+    std::unique_ptr<LoadedChunk> base;
+    if (mayContainBase(StorageBackend::kTerrainTable, pos.x, pos.z)) {
+        base = readChunk(shard, pos, dirty, nullptr, batch_terrain_);
+    }
+    if (!base) {
+        // 基础地形中不存在的区块，相当于与空区块比较
+        base = LoadedChunk::create(pos);
+    }
+
+    // 没有差异的层说明修改已被撤销，在同一批中删除其 overlay
+    std::vector<std::string> keys, values;
+    bool written = false;
+    for (uint8_t i = 0; i < LoadedChunk::kDataChunkNums; ++i) {
+        if (dirty & (1 << i)) {
+            keys.push_back(chunk_key.layerKey(i));
+            values.push_back(ChunkDelta::diff(*base, *chunk, i));
+            written |= !values.back().empty();
+        }
+    }
+    StorageBackend::Batch batch;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        batch.emplace_back(keys[i], values[i].empty() ? StorageBackend::kDelete : std::string_view(values[i]));
+    }
+
+    std::unique_lock<std::shared_mutex> writeLock(shard.tableMutex(StorageBackend::kTerrainTable));
+    chunk_cache_.erase(pos);
+    compressed_chunk_cache_.erase(pos);
+    // 先记入存在性过滤器再写入，过滤器中的内容总是数据库的超集
+    if (written) {
+        overlay_presence_[StorageBackend::kOverlayTable]->insert(pos.x, pos.z);
+    }
+    ERR_FAIL_COND_MSG(!batch.empty() && !overlay_->putBatch(StorageBackend::kOverlayTable, batch), "Failed to save chunk.");
+    chunk->clearDirty();
     // print_verbose(String("Succeed saving chunk {0}.").format(varray(toVector3i(chunk->position_))));
 }
 
-std::unique_ptr<GenerationChunk> WorldDB::loadGenerationChunk(const CoordAxis x, const CoordAxis z) {
-    // 逻辑和loadChunk一样，只是操作的数据库是generation而不是terrain
-    MDB_val key, data;
-    uint32_t key_data = x << 16 | z;
-    key.mv_size = sizeof(key_data);
-    key.mv_data = &key_data;
+void WorldDB::saveBaseChunk(LoadedChunk *chunk) {
+    // 依据chunk坐标构造指向地形数据的key，序列化所有层，写入各层的key所在位置
+    const Coord &pos = chunk->getPosition();
+    const ChunkKey chunk_key(pos);
+    std::vector<std::string> keys, values;
+    for (uint8_t i = 0; i < LoadedChunk::kDataChunkNums; ++i) {
+        std::ostringstream oss;
+        chunk->serializeLayer(oss, i);
+        keys.push_back(chunk_key.layerKey(i));
+        values.push_back(std::move(oss).str());
+    }
+    StorageBackend::Batch batch;
+    for (size_t i = 0; i < keys.size(); ++i) {
+        batch.emplace_back(keys[i], values[i]);
+    }
+
+    const size_t shard_index = shardIndexOf(pos.x, pos.z);
+    StorageBackend &shard = *shards_[shard_index];
+    std::unique_lock<std::shared_mutex> writeLock(shard.tableMutex(StorageBackend::kTerrainTable));
+    chunk_cache_.erase(pos);
+    compressed_chunk_cache_.erase(pos);
+    insertBase(StorageBackend::kTerrainTable, pos.x, pos.z);
+    ERR_FAIL_COND_MSG(!shard.putBatch(StorageBackend::kTerrainTable, batch), "Failed to save base chunk.");
+    chunk->clearDirty();
+}
+
+void WorldDB::saveBaseBatch(const std::vector<LoadedChunk *> &chunks) {
+    if (chunks.empty()) [[unlikely]] {
+        return;
+    }
+    const std::vector<const LoadedChunk *> members(chunks.begin(), chunks.end());
+    const std::string value = ChunkBatch::encode(members);
+    const Coord &pos = chunks.front()->getPosition();
+
+    // 同组的区块属于同一个分片区域
+    static_assert((1 << kShardRegionBits) % ChunkBatch::kWidth == 0, "ChunkBatch must not span shard regions.");
+    const size_t shard_index = shardIndexOf(pos.x, pos.z);
+    StorageBackend &shard = *shards_[shard_index];
+    std::unique_lock<std::shared_mutex> writeLock(shard.tableMutex(StorageBackend::kTerrainTable));
+    for (LoadedChunk *chunk : chunks) {
+        const Coord &member = chunk->getPosition();
+        chunk_cache_.erase(member);
+        compressed_chunk_cache_.erase(member);
+        insertBase(StorageBackend::kTerrainTable, member.x, member.z);
+    }
+    ERR_FAIL_COND_MSG(!shard.put(StorageBackend::kTerrainTable, ChunkBatch::key(pos), value), "Failed to save base chunk batch.");
+    for (LoadedChunk *chunk : chunks) {
+        chunk->clearDirty();
+    }
+}
+
+std::vector<std::shared_ptr<const LoadedChunk>> WorldDB::loadRegion(const Coord &min, const Coord &max, const LoadedChunk::LayerMask layers) {
+    std::vector<std::shared_ptr<const LoadedChunk>> result;
+    // ChunkBatch 储存在组的角落，角落可能在区域之外，因此遍历对齐到组的区域
+    const Coord scan_min = batch_terrain_ ? ChunkBatch::corner(min) : min;
+    const Coord scan_max = batch_terrain_ ? ChunkBatch::corner(max + Coord(ChunkBatch::kWidth - 1, 0, ChunkBatch::kWidth - 1)) : max;
+    uint64_t first;
+    if (!ChunkKey::nextInRegion(0, scan_min, scan_max, first)) {
+        return result;
+    }
+    const ChunkKey from(first);
+
+    // 区域内的区块分散在各个分片中，逐个分片在一个读事务中读取
+    for (const auto &shard : shards_) {
+        TerrainReadLock readLock(shard->tableMutex(StorageBackend::kTerrainTable));
+        // 属于该分片的玩家修改，叠加到读出的基础地形上
+        auto overlays = loadOverlays(min, max, shard.get());
+
+        // 先沿 key 的顺序遍历，收集区域内的数据。区域外的 key 通过 nextInRegion 直接跳过
+        // 同一区块的各层相邻，归入同一个 StoredChunk
+        std::vector<StoredChunk> values;
+        // 来自压缩缓存的数据需要在解码完成前保持有效
+        std::vector<std::pair<Coord, std::shared_ptr<const std::string>>> compressed_values;
+        // 基础地形中存在的区块，其余的 overlay 属于基础地形中不存在的区块
+        std::vector<Coord> visited;
+        uint64_t collecting = UINT64_MAX;
+        size_t decoded_begin = 0;
+        // 已缓存的区块直接加入结果，否则新建一个待解码的 StoredChunk，此时返回 true
+        const auto visitChunk = [&](const Coord &pos) {
+            visited.push_back(pos);
+            // 缓存中的区块已经叠加过 overlay
+            if (auto cached = chunk_cache_.get(pos)) {
+                result.push_back(std::move(*cached));
+                return false;
+            }
+            if (auto compressed = compressed_chunk_cache_.get(pos)) {
+                compressed_values.emplace_back(pos, std::move(*compressed));
+                return false;
+            }
+            values.push_back({pos});
+            const auto overlay = overlays.find(pos);
+            if (overlay != overlays.end()) {
+                values.back().overlay = &overlay->second;
+            }
+            return true;
+        };
+        const auto visitor = [&](const std::string_view key, const std::string_view data, std::string &seek) {
+            const uint64_t current = ChunkKey::fromBytes(key.data()).value();
+            if (current == collecting) {
+                collectStoredChunk(values.back(), key, data);
+                return StorageBackend::ScanStep::kNext;
+            }
+            uint64_t next;
+            if (!ChunkKey::nextInRegion(current, scan_min, scan_max, next)) {
+                return StorageBackend::ScanStep::kStop;
+            }
+            if (next != current) {
+                seek = ChunkKey(next).bytes();
+                return StorageBackend::ScanStep::kSeek;
+            }
+            if (batch_terrain_) {
+                // 组中只有落在区域内的区块会被解码
+                if (ChunkBatch::isBatchKey(key)) {
+                    for (const Coord &pos : ChunkBatch::positions(data, ChunkKey(current).position())) {
+                        if (pos.x >= min.x && pos.x < max.x && pos.z >= min.z && pos.z < max.z && visitChunk(pos)) {
+                            values.back().batch = data;
+                        }
+                    }
+                }
+                return StorageBackend::ScanStep::kNext;
+            }
+            if (visitChunk(ChunkKey(current).position())) {
+                collectStoredChunk(values.back(), key, data);
+                collecting = current;
+                return StorageBackend::ScanStep::kNext;
+            }
+            // 已缓存的区块无需再解码，直接跳过该区块的其余各层
+            collecting = UINT64_MAX;
+            seek = ChunkKey(current + 1).bytes();
+            return StorageBackend::ScanStep::kSeek;
+        };
+        // 数据指向的内存在事务结束前一直有效，因此在事务结束前并行解码
+        const auto finish = [&]() {
+            decoded_begin = result.size();
+            const size_t total = values.size() + compressed_values.size();
+            result.resize(decoded_begin + total);
+            // 此时持有读事务和表锁，隔离后等待的线程不会窃取其他任务，
+            // 避免在同一线程上嵌套执行另一个需要事务或锁的任务
+            tbb::this_task_arena::isolate([&]() {
+                tbb::parallel_for(tbb::blocked_range<size_t>(0, total), [&](const tbb::blocked_range<size_t> &range) {
+                    for (size_t i = range.begin(); i != range.end(); ++i) {
+                        if (i < values.size()) {
+                            result[decoded_begin + i] = decodeStoredChunk(values[i], layers);
+                        } else {
+                            const auto &[pos, compressed] = compressed_values[i - values.size()];
+                            result[decoded_begin + i] = decodeChunk(pos, *compressed, layers);
+                        }
+                    }
+                });
+            });
+        };
+        if (!shard->scan(StorageBackend::kTerrainTable, from.bytes(), visitor, finish)) [[unlikely]] {
+            return result;
+        }
+
+        // 只存在于 overlay 中的区块，基础地形为空
+        for (const Coord &pos : visited) {
+            overlays.erase(pos);
+        }
+        for (const auto &[pos, overlay] : overlays) {
+            StoredChunk stored{pos};
+            stored.overlay = &overlay;
+            result.push_back(decodeStoredChunk(stored, layers));
+        }
 
-    std::shared_lock<std::shared_mutex> readLock(generation_mtx);
-    auto txn = beginTransaction(MDB_RDONLY);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(nullptr, mdb_get, txn, generation_db_, &key, &data);
-    commitTransaction(txn, guard);
+        // 只解码了部分层的区块不能放入缓存
+        if (layers == LoadedChunk::kAllLayers) {
+            for (size_t i = decoded_begin; i < result.size(); ++i) {
+                compressed_chunk_cache_.erase(result[i]->getPosition());
+                chunk_cache_.put(result[i]->getPosition(), result[i], result[i]->memoryUsage());
+            }
+        }
+    }
 
-    std::istringstream iss(std::string{static_cast<char *>(data.mv_data), data.mv_size});
+    return result;
+}
+
+std::unique_ptr<GenerationChunk> WorldDB::loadGenerationChunk(const CoordAxis x, const CoordAxis z, const uint16_t version) {
     auto chunk = GenerationChunk::create({x, 0, z});
-    iss >> *chunk;
-    // print_verbose(String("Succeed loading generation chunk {0}.").format(varray(toVector3i(chunk->position_))))
+    if (!loadGenerationChunk(*chunk, version)) [[unlikely]] {
+        return nullptr;
+    }
     return chunk;
 }
-void WorldDB::saveGenerationChunk(GenerationChunk *chunk) {
+
+bool WorldDB::loadGenerationChunk(GenerationChunk &chunk, const uint16_t version) {
+    if (generation_store_) {
+        return generation_store_->load(chunk, version);
+    }
+
+    // 逻辑和loadChunk一样，只是操作的数据库是generation而不是terrain，版本储存在 key 的 y 中
+    const CoordAxis x = chunk.getPosition().x, z = chunk.getPosition().z;
+    const ChunkKey chunk_key(x, version, z);
+    StorageBackend &shard = shardOf(x, z);
+    // 各线程复用的缓冲区，生成期间每个区块每层都要读取一次
+    thread_local std::string data;
+    {
+        std::shared_lock<std::shared_mutex> readLock(shard.tableMutex(StorageBackend::kGenerationTable));
+        // 值只在事务有效期间可用，需要复制出来
+        const bool found = shard.get(StorageBackend::kGenerationTable, chunk_key.bytes(), [&](const std::string_view value) {
+            data.assign(value);
+        });
+        ERR_FAIL_COND_V_MSG(!found, false, "Failed to load generation chunk.");
+    }
+
+    std::istringstream iss(std::move(data));
+    iss >> chunk;
+    data = std::move(iss).str();
+    // print_verbose(String("Succeed loading generation chunk {0}.").format(varray(toVector3i(chunk->position_))))
+    return true;
+}
+bool WorldDB::saveGenerationChunk(GenerationChunk *chunk, const uint16_t version) {
+    // 每一层的结果都以新的版本写入，即使从上一层读取后没有被修改过
+    if (generation_store_) {
+        return generation_store_->save(chunk, version);
+    }
+
     chunk->fit();
     // 逻辑和saveChunk一样，只是操作的数据库是generation而不是terrain
-    MDB_val key, data;
-    uint32_t key_data = chunk->getPosition().x << 16 | chunk->getPosition().z;
-    key.mv_size = sizeof(key_data);
-    key.mv_data = &key_data;
-    std::ostringstream oss;
+    const CoordAxis x = chunk->getPosition().x, z = chunk->getPosition().z;
+    const ChunkKey chunk_key(x, version, z);
+    // 在各线程复用的缓冲区中序列化，清空后交给 oss 以保留已分配的容量
+    thread_local std::string buffer;
+    buffer.clear();
+    std::ostringstream oss(std::move(buffer));
     oss << *chunk;
-    std::string_view buffer{oss.view()};
-    data.mv_size = buffer.size();
-    data.mv_data = const_cast<char *>(buffer.data());
-
-    std::unique_lock<std::shared_mutex> writeLock(generation_mtx);
-    auto txn = beginTransaction(MDB_WRITEMAP | MDB_NOSYNC);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(, mdb_put, txn, generation_db_, &key, &data, 0);
-    commitTransaction(txn, guard);
+
+    StorageBackend &shard = shardOf(x, z);
+    {
+        std::unique_lock<std::shared_mutex> writeLock(shard.tableMutex(StorageBackend::kGenerationTable));
+        ERR_FAIL_COND_V_MSG(!shard.put(StorageBackend::kGenerationTable, chunk_key.bytes(), oss.view()), false, "Failed to save generation chunk.");
+    }
+    buffer = std::move(oss).str();
     // print_verbose(String("Succeed saving generation chunk {0}.").format(varray(toVector3i(chunk->position_))))
+    return true;
+}
+
+void WorldDB::dropGenerationChunk(const CoordAxis x, const CoordAxis z, const uint16_t version) {
+    if (generation_store_) {
+        generation_store_->erase(x, z, version);
+        return;
+    }
+
+    StorageBackend &shard = shardOf(x, z);
+    std::unique_lock<std::shared_mutex> writeLock(shard.tableMutex(StorageBackend::kGenerationTable));
+    ERR_FAIL_COND_MSG(!shard.del(StorageBackend::kGenerationTable, ChunkKey(x, version, z).bytes()), "Failed to drop generation chunk.");
 }
 
 Dictionary WorldDB::getMetadata(const CoordAxis x, const CoordAxis z) {
-    MDB_val key, data;
-    uint32_t key_data = x << 16 | z;
-    key.mv_size = sizeof(key_data);
-    key.mv_data = &key_data;
-
-    std::shared_lock<std::shared_mutex> readLock(metadata_mtx);
-    auto txn = beginTransaction(MDB_RDONLY);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(Dictionary(), mdb_get, txn, metadata_db_, &key, &data);
-    Dictionary result = JSON::parse_string(String(static_cast<char *>(data.mv_data), data.mv_size));
-    commitTransaction(txn, guard);
+    const ChunkKey chunk_key(x, 0, z);
+    // 返回副本，避免调用方修改缓存中的 Dictionary
+    if (auto cached = metadata_cache_.get(chunk_key.value())) {
+        return cached->duplicate(true);
+    }
 
-    return result;
+    // 整个读取过程持有 overlay 的 metadata 锁，回退到基础地形时也不会与 setMetadata 交错而把旧值写入缓存
+    std::shared_lock<std::shared_mutex> overlayLock(overlay_->tableMutex(StorageBackend::kMetadataTable));
+    Dictionary result;
+    ::size_t size = 0;
+    const auto decode = [&](const std::string_view data) {
+        result = decodeMetadata(reinterpret_cast<const uint8_t *>(data.data()), data.size());
+        size = data.size();
+    };
+    // 运行时写入的 metadata 覆盖基础地形中的
+    bool found = overlay_presence_[StorageBackend::kMetadataTable]->mayContain(x, z) &&
+            overlay_->get(StorageBackend::kMetadataTable, chunk_key.bytes(), decode);
+    if (!found) {
+        const size_t shard_index = shardIndexOf(x, z);
+        if (!mayContainBase(StorageBackend::kMetadataTable, x, z)) {
+            return Dictionary();
+        }
+        StorageBackend &shard = *shards_[shard_index];
+        std::shared_lock<std::shared_mutex> readLock(shard.tableMutex(StorageBackend::kMetadataTable));
+        found = shard.get(StorageBackend::kMetadataTable, chunk_key.bytes(), decode);
+    }
+    // 过滤器误报时 key 并不存在，与未写入过 metadata 的竖列一样返回空的 Dictionary
+    if (!found) {
+        return Dictionary();
+    }
+
+    metadata_cache_.put(chunk_key.value(), result, size);
+    return result.duplicate(true);
 }
 
 void WorldDB::setMetadata(const CoordAxis x, const CoordAxis z, const Dictionary &metadata) {
-    MDB_val key, data;
-    uint32_t key_data = x << 16 | z;
-    key.mv_size = sizeof(key_data);
-    key.mv_data = &key_data;
-    CharString stringfied_metadata = JSON::stringify(metadata).ascii();
-    data.mv_size = stringfied_metadata.size();
-    data.mv_data = (void *)stringfied_metadata.get_data();
+    const ChunkKey chunk_key(x, 0, z);
+    const std::vector<uint8_t> encoded_metadata = encodeMetadata(metadata);
+    ERR_FAIL_COND_MSG(encoded_metadata.empty(), "Failed to encode metadata.");
+    const std::string_view data{ reinterpret_cast<const char *>(encoded_metadata.data()), encoded_metadata.size() };
+
+    // 基础地形是只读的，运行时的 metadata 与玩家的修改一样写入 overlay
+    std::unique_lock<std::shared_mutex> writeLock(overlay_->tableMutex(StorageBackend::kMetadataTable));
+    metadata_cache_.erase(chunk_key.value());
+    overlay_presence_[StorageBackend::kMetadataTable]->insert(x, z);
+    ERR_FAIL_COND_MSG(!overlay_->put(StorageBackend::kMetadataTable, chunk_key.bytes(), data), "Failed to save metadata.");
+    metadata_cache_.put(chunk_key.value(), metadata.duplicate(true), encoded_metadata.size());
+}
+
+std::vector<uint8_t> WorldDB::encodeMetadata(const Dictionary &metadata) {
+    // 先计算所需的长度，再写入，首字节为格式标记
+    int length;
+    ERR_FAIL_COND_V(encode_variant(metadata, nullptr, length) != OK, {});
+    std::vector<uint8_t> result(length + 1);
+    result[0] = kMetadataFormatBinary;
+    ERR_FAIL_COND_V(encode_variant(metadata, result.data() + 1, length) != OK, {});
+    return result;
+}
 
-    std::unique_lock<std::shared_mutex> writeLock(metadata_mtx);
-    auto txn = beginTransaction(MDB_WRITEMAP | MDB_NOSYNC);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(, mdb_put, txn, metadata_db_, &key, &data, 0);
-    commitTransaction(txn, guard);
+Dictionary WorldDB::decodeMetadata(const uint8_t *data, const ::size_t size) {
+    if (size == 0) [[unlikely]] {
+        return Dictionary();
+    }
+    if (data[0] == kMetadataFormatBinary) {
+        Variant result;
+        ERR_FAIL_COND_V(decode_variant(result, data + 1, size - 1) != OK, Dictionary());
+        return result;
+    }
+    // 旧版本以 JSON 字符串储存，首字节总是 '{'
+    return JSON::parse_string(String(reinterpret_cast<const char *>(data), size));
 }
 
 void WorldDB::beginGeneration() {
-    auto txn = beginTransaction(MDB_WRITEMAP | MDB_NOSYNC);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(, mdb_dbi_open, txn, kGenerationDB, MDB_CREATE, &generation_db_);
-    commitTransaction(txn, guard);
+    if (WorldConfig::loaded() && WorldConfig::singleton().data.generation_memory_budget != 0) {
+        generation_store_ = std::make_unique<GenerationStore>(WorldConfig::singleton().data.generation_memory_budget, kGenerationScratchFile);
+        return;
+    }
+
+    for (const auto &shard : shards_) {
+        ERR_FAIL_COND_MSG(!shard->openTable(StorageBackend::kGenerationTable), "Failed to open generation database.");
+    }
+}
+
+bool WorldDB::endGeneration(const uint16_t final_version) {
+    // 写入失败时保留生成期间的数据，基础地形中可能只写入了一部分
+    ERR_FAIL_COND_V_MSG(!writeBaseTerrain(final_version), false, "Failed to write base terrain, generation data is kept.");
+
+    if (generation_store_) {
+        // 临时文件会在析构时删除
+        generation_store_.reset();
+    } else {
+        // 基础地形已经完整写入，删除失败只是多占用一些空间
+        for (const auto &shard : shards_) {
+            if (!shard->dropTable(StorageBackend::kGenerationTable)) [[unlikely]] {
+                ERR_PRINT("Failed to drop generation database.");
+            }
+        }
+    }
+
+    // 生成结束后基础地形不再变化，及时刷到磁盘并持久化过滤器，下次打开时不必遍历重建
+    for (const auto &shard : shards_) {
+        ERR_FAIL_COND_V_MSG(!shard->flush(), false, "Failed to flush base terrain.");
+    }
+    savePresence();
+    return true;
+}
+
+void WorldDB::abortGeneration() {
+    if (generation_store_) {
+        generation_store_.reset();
+        return;
+    }
+    for (const auto &shard : shards_) {
+        ERR_FAIL_COND_MSG(!shard->dropTable(StorageBackend::kGenerationTable), "Failed to drop generation database.");
+    }
+}
+
+bool WorldDB::writeBaseTerrain(const uint16_t version) {
+    GET_WORLD_CONFIG(false, config);
+    // 每个生成区块竖列切分为 height / kLoadedChunkHeight 个 LoadedChunk
+    const int slices = std::min<CoordAxis>((config.height + kLoadedChunkHeight - 1) / kLoadedChunkHeight, kGeneratingChunkHeight / kLoadedChunkHeight);
+    // 开启 batch_terrain 时以 ChunkBatch 的组为单位读取，否则每个竖列单独成组
+    const CoordAxis group_width = batch_terrain_ ? ChunkBatch::kWidth : 1;
+    const CoordAxis groups = (config.width + group_width - 1) / group_width;
+    // 组的角落按 key 的顺序排列，依次写出的区块的 key 就是递增的
+    std::vector<Coord> corners;
+    corners.reserve(groups * groups);
+    for (CoordAxis x = 0; x < groups; ++x) {
+        for (CoordAxis z = 0; z < groups; ++z) {
+            corners.push_back({ x * group_width, 0, z * group_width });
+        }
+    }
+    std::sort(corners.begin(), corners.end(), [](const Coord &a, const Coord &b) { return ChunkKey(a).value() < ChunkKey(b).value(); });
+
+    // 每次并行读取并切分一段组，再按顺序批量写入
+    const ::size_t window = std::max<::size_t>(kBulkLoadColumns / (group_width * group_width), 1);
+    std::atomic<bool> missing{ false };
+    for (::size_t begin = 0; begin < corners.size(); begin += window) {
+        const ::size_t end = std::min(begin + window, corners.size());
+        std::vector<std::vector<std::unique_ptr<LoadedChunk>>> sliced(end - begin);
+        tbb::parallel_for(tbb::blocked_range<::size_t>(begin, end), [&](const tbb::blocked_range<::size_t> &range) {
+            for (::size_t i = range.begin(); i != range.end(); ++i) {
+                const Coord &corner = corners[i];
+                std::vector<std::unique_ptr<GenerationChunk>> columns;
+                for (CoordAxis x = corner.x; x < std::min<CoordAxis>(corner.x + group_width, config.width); ++x) {
+                    for (CoordAxis z = corner.z; z < std::min<CoordAxis>(corner.z + group_width, config.width); ++z) {
+                        // 缺少的竖列会在基础地形中留下空洞
+                        auto generation_chunk = loadGenerationChunk(x, z, version);
+                        if (!generation_chunk) [[unlikely]] {
+                            missing = true;
+                            return;
+                        }
+                        columns.push_back(std::move(generation_chunk));
+                    }
+                }
+                // 先按高度再按竖列排列，同一组同一高度的区块相邻
+                for (int index = 0; index < slices; ++index) {
+                    for (const auto &column : columns) {
+                        sliced[i - begin].push_back(slice(column.get(), index));
+                    }
+                }
+            }
+        });
+        ERR_FAIL_COND_V_MSG(missing, false, "Failed to load generation chunk for base terrain.");
+
+        std::vector<LoadedChunk *> chunks;
+        for (const auto &group : sliced) {
+            for (const auto &chunk : group) {
+                chunks.push_back(chunk.get());
+            }
+        }
+        if (!bulkLoad(chunks)) {
+            return false;
+        }
+    }
+    print_verbose("Succeed writing base terrain.");
+    return true;
 }
 
-void WorldDB::endGeneration() {
-    auto txn = beginTransaction(MDB_WRITEMAP | MDB_NOSYNC);
-    auto guard = scope_guard(&WorldDB::abortTransaction, this, txn);
-    MDB_CALL(, mdb_drop, txn, generation_db_, 1);
-    commitTransaction(txn, guard);
+bool WorldDB::bulkLoad(const std::vector<LoadedChunk *> &chunks) {
+    // 储存在同一个 key 下的区块，按层储存时每个区块单独一组
+    std::vector<std::pair<::size_t, ::size_t>> groups;
+    for (::size_t begin = 0, end; begin < chunks.size(); begin = end) {
+        end = begin + 1;
+        if (batch_terrain_) {
+            const std::string key = ChunkBatch::key(chunks[begin]->getPosition());
+            while (end < chunks.size() && ChunkBatch::key(chunks[end]->getPosition()) == key) {
+                ++end;
+            }
+        }
+        groups.emplace_back(begin, end);
+    }
+
+    // 并行编码，得到的数据与 chunks 的顺序一致
+    std::vector<std::vector<std::pair<std::string, std::string>>> encoded(groups.size());
+    tbb::parallel_for(tbb::blocked_range<::size_t>(0, groups.size()), [&](const tbb::blocked_range<::size_t> &range) {
+        for (::size_t i = range.begin(); i != range.end(); ++i) {
+            const auto [begin, end] = groups[i];
+            const Coord &pos = chunks[begin]->getPosition();
+            if (batch_terrain_) {
+                encoded[i].emplace_back(ChunkBatch::key(pos), ChunkBatch::encode({ chunks.begin() + begin, chunks.begin() + end }));
+                continue;
+            }
+            const ChunkKey chunk_key(pos);
+            for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+                std::ostringstream oss;
+                chunks[begin]->serializeLayer(oss, layer);
+                encoded[i].emplace_back(chunk_key.layerKey(layer), std::move(oss).str());
+            }
+        }
+    });
+
+    // 按分片整理，每个分片得到的数据仍然有序
+    std::vector<StorageBackend::Batch> batches(shards_.size());
+    std::vector<std::vector<const LoadedChunk *>> members(shards_.size());
+    for (::size_t i = 0; i < groups.size(); ++i) {
+        const Coord &pos = chunks[groups[i].first]->getPosition();
+        const size_t shard_index = shardIndexOf(pos.x, pos.z);
+        StorageBackend::Batch &batch = batches[shard_index];
+        for (const auto &[key, value] : encoded[i]) {
+            ERR_FAIL_COND_V_MSG(!batch.empty() && key <= batch.back().first, false, "Bulk loaded chunks must be sorted by key.");
+            batch.emplace_back(key, value);
+        }
+        for (::size_t j = groups[i].first; j < groups[i].second; ++j) {
+            members[shard_index].push_back(chunks[j]);
+        }
+    }
+
+    // 各分片有独立的写者，并行写入。一个分片失败不影响其他分片写完，最后统一报告
+    std::atomic<bool> failed{ false };
+    tbb::parallel_for(tbb::blocked_range<::size_t>(0, shards_.size()), [&](const tbb::blocked_range<::size_t> &range) {
+        for (::size_t shard_index = range.begin(); shard_index != range.end(); ++shard_index) {
+            if (batches[shard_index].empty()) {
+                continue;
+            }
+            StorageBackend &shard = *shards_[shard_index];
+            std::unique_lock<std::shared_mutex> writeLock(shard.tableMutex(StorageBackend::kTerrainTable));
+            for (const LoadedChunk *chunk : members[shard_index]) {
+                const Coord &pos = chunk->getPosition();
+                chunk_cache_.erase(pos);
+                compressed_chunk_cache_.erase(pos);
+                insertBase(StorageBackend::kTerrainTable, pos.x, pos.z);
+            }
+            if (!shard.putBatch(StorageBackend::kTerrainTable, batches[shard_index], true)) [[unlikely]] {
+                ERR_PRINT("Failed to bulk load base terrain.");
+                failed = true;
+            }
+        }
+    });
+    if (failed) {
+        return false;
+    }
+    for (LoadedChunk *chunk : chunks) {
+        chunk->clearDirty();
+    }
+    return true;
+}
+
+std::unordered_map<Coord, WorldDB::Overlay> WorldDB::loadOverlays(const Coord &min, const Coord &max, const StorageBackend *shard) {
+    std::unordered_map<Coord, Overlay> result;
+    uint64_t first;
+    if (!ChunkKey::nextInRegion(0, min, max, first)) {
+        return result;
+    }
+
+    // 与 loadRegion 相同，沿 key 的顺序遍历并跳过区域外的 key。overlay 中只有被修改过的区块，通常很少
+    const auto visitor = [&](const std::string_view key, const std::string_view data, std::string &seek) {
+        const uint64_t current = ChunkKey::fromBytes(key.data()).value();
+        uint64_t next;
+        if (!ChunkKey::nextInRegion(current, min, max, next)) {
+            return StorageBackend::ScanStep::kStop;
+        }
+        if (next != current) {
+            seek = ChunkKey(next).bytes();
+            return StorageBackend::ScanStep::kSeek;
+        }
+        const Coord pos = ChunkKey(current).position();
+        const uint8_t layer = static_cast<uint8_t>(key.back());
+        if (key.size() == ChunkKey::kSize + 1 && layer < LoadedChunk::kDataChunkNums && (!shard || &shardOf(pos.x, pos.z) == shard)) {
+            result[pos][layer] = data;
+        }
+        return StorageBackend::ScanStep::kNext;
+    };
+    overlay_->scan(StorageBackend::kOverlayTable, ChunkKey(first).bytes(), visitor, nullptr);
+    return result;
+}
+
+bool WorldDB::mergeShards(const std::string &path) {
+    ERR_FAIL_COND_V_MSG(std::filesystem::exists(path), false, "The merge target already exists.");
+
+    // 合并依赖 LMDB 的游标同时遍历各分片
+    std::vector<LmdbEnvironment *> shards;
+    ::size_t mapsize = 0;
+    for (const auto &shard : shards_) {
+        shards.push_back(dynamic_cast<LmdbEnvironment *>(shard.get()));
+        ERR_FAIL_COND_V_MSG(!shards.back(), false, "Merging shards is only supported by the LMDB storage backend.");
+        mapsize += shards.back()->mapsize();
+    }
+    LmdbEnvironment merged(path, mapsize);
+    for (const auto table : { StorageBackend::kMetadataTable, StorageBackend::kTerrainTable }) {
+        ERR_FAIL_COND_V_MSG(!mergeTable(shards, merged, table), false, "Failed to merge shards.");
+    }
+    print_verbose(String("Succeed merging {0} shard(s) into {1}.").format(varray(static_cast<uint64_t>(shards_.size()), path.c_str())));
+    return true;
+}
+
+bool WorldDB::mergeTable(const std::vector<LmdbEnvironment *> &shards, LmdbEnvironment &merged, const StorageBackend::Table table) {
+    // 持有各分片的共享锁以阻止写入，读取不受影响
+    std::vector<std::shared_lock<std::shared_mutex>> locks;
+    std::vector<std::unique_ptr<LmdbEnvironment::Cursor>> cursors;
+    for (LmdbEnvironment *shard : shards) {
+        locks.emplace_back(shard->tableMutex(table));
+        cursors.push_back(std::make_unique<LmdbEnvironment::Cursor>(*shard, table));
+        if (!cursors.back()->ok()) [[unlikely]] {
+            return false;
+        }
+    }
+
+    // 各分片内部已按 key 有序，且 key 互不重叠，归并后即可用 MDB_APPEND 顺序写入
+    const auto greater = [&](const size_t lhs, const size_t rhs) { return cursors[rhs]->key() < cursors[lhs]->key(); };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heap(greater);
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        if (cursors[i]->valid()) {
+            heap.push(i);
+        }
+    }
+
+    // 游标读到的数据在读事务结束前一直有效，批量写入时无需复制
+    StorageBackend::Batch batch;
+    batch.reserve(kMergeBatchSize);
+    while (!heap.empty()) {
+        const size_t i = heap.top();
+        heap.pop();
+        batch.emplace_back(cursors[i]->key(), cursors[i]->value());
+        if (batch.size() == kMergeBatchSize) {
+            if (!merged.putBatch(table, batch, true)) [[unlikely]] {
+                return false;
+            }
+            batch.clear();
+        }
+        cursors[i]->next();
+        if (cursors[i]->valid()) {
+            heap.push(i);
+        } else if (!cursors[i]->ok()) [[unlikely]] {
+            return false;
+        }
+    }
+    return batch.empty() || merged.putBatch(table, batch, true);
 }
 
 WorldDB::~WorldDB() {
-    mdb_env_close(env_);
-    delete instance_;
+    for (const auto &shard : shards_) {
+        shard->flush();
+    }
+    overlay_->flush();
+    savePresence();
+    // 测试中直接构造的实例不是单例
+    if (instance_ == this) {
+        instance_ = nullptr;
+    }
+}
+
+std::unique_ptr<StorageBackend> WorldDB::openBackend(const std::string &backend, const std::string &name, const ::size_t mapsize, const std::initializer_list<StorageBackend::Table> tables) {
+    if (backend == kMemoryBackend) {
+        return std::make_unique<MemoryBackend>();
+    }
+    if (backend == kRegionBackend) {
+        return std::make_unique<RegionFileBackend>(name + kRegionSuffix);
+    }
+    if (backend == kPackedBackend) {
+        return std::make_unique<PackedWorldBackend>(name + kPackedSuffix);
+    }
+    if (!backend.empty() && backend != kLmdbBackend) [[unlikely]] {
+        ERR_PRINT("Unknown storage backend, falling back to LMDB.");
+    }
+    return std::make_unique<LmdbEnvironment>(name + kLmdbSuffix, mapsize, tables);
 }
 
-MDB_txn *WorldDB::beginTransaction(unsigned int flags) {
-    MDB_txn *txn;
-    MDB_CALL(nullptr, mdb_txn_begin, env_, nullptr, flags, &txn);
-    return txn;
+WorldDB::PresenceFilters WorldDB::openPresence(const std::vector<StorageBackend *> &envs, const std::initializer_list<StorageBackend::Table> tables) {
+    const CoordAxis width = WorldConfig::loaded() ? WorldConfig::singleton().data.width : 0;
+    PresenceFilters filters;
+    for (const auto table : tables) {
+        filters[table] = std::make_unique<PresenceFilter>(width);
+    }
+    if (loadPresence(envs, filters)) {
+        return filters;
+    }
+
+    // 同一竖列的所有 key 在 key 空间中是连续的，每个竖列只需访问一条，随后直接跳到下一个竖列
+    for (const auto table : tables) {
+        filters[table] = std::make_unique<PresenceFilter>(width);
+        PresenceFilter &filter = *filters[table];
+        // ChunkBatch 中的区块分属多个竖列，而且各高度的组包含的竖列不一定相同，需要逐条读取
+        const auto visitor = [&](const std::string_view key, const std::string_view value, std::string &seek) {
+            const ChunkKey chunk_key = ChunkKey::fromBytes(key.data());
+            const Coord pos = chunk_key.position();
+            if (ChunkBatch::isBatchKey(key)) {
+                for (const Coord &member : ChunkBatch::positions(value, pos)) {
+                    filter.insert(member.x, member.z);
+                }
+                return StorageBackend::ScanStep::kNext;
+            }
+            filter.insert(pos.x, pos.z);
+            const uint64_t next_column = (chunk_key.value() >> ChunkKey::kHeightBits) + 1;
+            if (next_column >> (ChunkKey::kAxisBits * 2)) {
+                return StorageBackend::ScanStep::kStop;
+            }
+            seek = ChunkKey(next_column << ChunkKey::kHeightBits).bytes();
+            return StorageBackend::ScanStep::kSeek;
+        };
+        for (StorageBackend *env : envs) {
+            std::shared_lock<std::shared_mutex> readLock(env->tableMutex(table));
+            env->scan(table, ChunkKey(0).bytes(), visitor, nullptr);
+        }
+    }
+    print_verbose(String("Rebuilt presence filter of {0}.").format(varray(envs.front()->path().c_str())));
+    return filters;
 }
 
-void WorldDB::commitTransaction(MDB_txn *txn, auto &guard) {
-    MDB_CALL(, mdb_txn_commit, txn);
-    guard.release();
+bool WorldDB::loadPresence(const std::vector<StorageBackend *> &envs, const PresenceFilters &filters) {
+    if (envs.front()->path().empty()) {
+        return false;
+    }
+    std::ifstream ifs(envs.front()->path() + kPresenceSuffix, std::ios::binary);
+    if (!ifs) {
+        return false;
+    }
+    uint32_t magic;
+    uint32_t env_count;
+    DESERIALIZE_READ(ifs, magic);
+    DESERIALIZE_READ(ifs, env_count);
+    if (!ifs || magic != kPresenceMagic || env_count != envs.size()) {
+        return false;
+    }
+    for (StorageBackend *env : envs) {
+        uint64_t version;
+        DESERIALIZE_READ(ifs, version);
+        if (!ifs || version != env->version()) {
+            return false;
+        }
+    }
+    uint8_t count;
+    DESERIALIZE_READ(ifs, count);
+    if (!ifs) {
+        return false;
+    }
+    uint8_t loaded = 0;
+    for (uint8_t i = 0; i < count; ++i) {
+        uint8_t table;
+        DESERIALIZE_READ(ifs, table);
+        if (!ifs || table >= StorageBackend::kTableCount || !filters[table] || !filters[table]->load(ifs)) {
+            return false;
+        }
+        ++loaded;
+    }
+    // sidecar 中必须包含所有需要的过滤器
+    return loaded == std::count_if(filters.begin(), filters.end(), [](const auto &filter) { return filter != nullptr; });
 }
 
-void WorldDB::abortTransaction(MDB_txn *txn) { mdb_txn_abort(txn); }
+void WorldDB::savePresence(const std::vector<StorageBackend *> &envs, const PresenceFilters &filters) {
+    // 不持久化或只读的存储无需保存
+    if (envs.front()->path().empty() || envs.front()->readOnly()) {
+        return;
+    }
+    // 先写入临时文件再替换，写入中途退出也不会留下损坏的 sidecar
+    const std::string path = envs.front()->path() + kPresenceSuffix;
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream ofs(temp_path, std::ios::binary | std::ios::trunc);
+        ERR_FAIL_COND_MSG(!ofs, "Failed to save presence filter.");
+        const uint32_t magic = kPresenceMagic;
+        const uint32_t env_count = envs.size();
+        const uint8_t count = std::count_if(filters.begin(), filters.end(), [](const auto &filter) { return filter != nullptr; });
+        SERIALIZE_WRITE(ofs, magic);
+        SERIALIZE_WRITE(ofs, env_count);
+        for (StorageBackend *env : envs) {
+            const uint64_t version = env->version();
+            SERIALIZE_WRITE(ofs, version);
+        }
+        SERIALIZE_WRITE(ofs, count);
+        for (uint8_t table = 0; table < StorageBackend::kTableCount; ++table) {
+            if (filters[table]) {
+                SERIALIZE_WRITE(ofs, table);
+                filters[table]->save(ofs);
+            }
+        }
+        ERR_FAIL_COND_MSG(!ofs, "Failed to save presence filter.");
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    ERR_FAIL_COND_MSG(ec, "Failed to save presence filter.");
+}
+
+void WorldDB::savePresence() {
+    savePresence(shardEnvs(), base_presence_);
+    savePresence({ overlay_.get() }, overlay_presence_);
+}
+
+std::vector<StorageBackend *> WorldDB::shardEnvs() const {
+    std::vector<StorageBackend *> envs;
+    envs.reserve(shards_.size());
+    for (const auto &shard : shards_) {
+        envs.push_back(shard.get());
+    }
+    return envs;
+}
+
+size_t WorldDB::shardIndexOf(const CoordAxis x, const CoordAxis z) const {
+    if (shards_.size() == 1) [[likely]] {
+        return 0;
+    }
+    // 以区域坐标的哈希选择分片，混合后取高位，避免规则的坐标集中到少数分片上
+    const uint64_t region_x = static_cast<uint32_t>(x >> kShardRegionBits);
+    const uint64_t region_z = static_cast<uint32_t>(z >> kShardRegionBits);
+    const uint64_t hash = region_x * 0x9E3779B97F4A7C15ULL ^ region_z * 0xC2B2AE3D27D4EB4FULL;
+    return (hash >> 32) % shards_.size();
+}
+
+::size_t WorldDB::estimateMapsize() {
+    const auto &config = WorldConfig::singleton().data;
+    if (!WorldConfig::loaded()) [[unlikely]] {
+        return kMinMapsize;
+    }
+    if (config.map_size != 0) {
+        return std::max<::size_t>(config.map_size, kMinMapsize);
+    }
+    // 得到的是所有分片的总和，由构造函数平均分给各个分片
+    // 世界中每个区块竖列由 height / kLoadedChunkHeight 个 LoadedChunk 组成
+    // 生成期间 generation 数据库还会占用与 terrain 相近的空间，因此预留两倍
+    const ::size_t columns = config.width * config.width;
+    const ::size_t chunks_per_column = std::max<::size_t>((config.height + kLoadedChunkHeight - 1) / kLoadedChunkHeight, 1);
+    return std::max<::size_t>(columns * chunks_per_column * kEstimatedChunkSize * 2, kMinMapsize);
+}
 
 }  // namespace pgvoxel
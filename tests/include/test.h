@@ -2,6 +2,32 @@
 #include "core/object/class_db.h"
 #include "core/object/object.h"
 
+#include "chunk.h"
+#include "chunk.inl"
+#include "chunk_batch.h"
+#include "chunk_delta.h"
+#include "chunk_key.h"
+#include "deferred_edit_queue.h"
+#include "generation_store.h"
+#include "generator_program.h"
+#include "lmdb_environment.h"
+#include "lru_cache.h"
+#include "memory_backend.h"
+#include "presence_filter.h"
+#include "region_file_backend.h"
+#include "request_queue.h"
+#include "world_db.h"
+
+#include <filesystem>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
 namespace pgvoxel {
 
 #define TEST(x)                                                     \
@@ -21,12 +47,655 @@ class VoxelTest : public Object {
 	GDCLASS(VoxelTest, Object)
 public:
 	static void run(const PackedStringArray &targets) {
+		TEST(chunk_key_next_in_region)
+		TEST(chunk_delta)
+		TEST(save_dirty_layers)
+		TEST(chunk_batch)
+		TEST(presence_filter)
+		TEST(storage_backends)
+		TEST(region_file_version)
+		TEST(deferred_edit_queue)
+		TEST(generator_program)
+		TEST(request_queue)
+		TEST(lru_cache)
+		TEST(chunk_cache_invalidation)
+		TEST(lru_cache_eviction_handler)
+		TEST(generation_store)
+		TEST(metadata_codec)
 	}
 
 private:
 	static void _bind_methods() {
 		ClassDB::bind_static_method("VoxelTest", D_METHOD("run", "targets"), &VoxelTest::run);
 	}
+
+	// 以固定的种子在区块的每一层随机写入若干竖列
+	static void fillRandom(LoadedChunk &chunk, const uint32_t seed) {
+		std::mt19937 rng(seed);
+		for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+			for (int i = 0; i < 64; ++i) {
+				const CoordAxis x = rng() % LoadedChunk::kWidth, z = rng() % LoadedChunk::kWidth;
+				const CoordAxis buttom = rng() % LoadedChunk::kHeight;
+				const CoordAxis top = buttom + 1 + rng() % (LoadedChunk::kHeight - buttom);
+				chunk.setBar(x, z, buttom, top, rng() % 16, layer);
+			}
+		}
+	}
+
+	template <typename ChunkType>
+	static bool sameLayer(const ChunkType &a, const ChunkType &b, const uint8_t layer) {
+		for (CoordAxis x = 0; x < ChunkType::kWidth; ++x) {
+			for (CoordAxis z = 0; z < ChunkType::kWidth; ++z) {
+				if (a.getBar(x, z, 0, ChunkType::kHeight, layer) != b.getBar(x, z, 0, ChunkType::kHeight, layer)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	template <typename ChunkType>
+	static bool sameChunk(const ChunkType &a, const ChunkType &b) {
+		for (uint8_t layer = 0; layer < ChunkType::kDataChunkNums; ++layer) {
+			if (!sameLayer(a, b, layer)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// 与逐个检查区域内所有 key 的结果一致
+	static bool test_chunk_key_next_in_region() {
+		std::mt19937 rng(1);
+		for (int round = 0; round < 200; ++round) {
+			Coord min{ rng() % 12, rng() % 6, rng() % 12 };
+			const Coord max{ min.x + rng() % 6, min.y + rng() % 4, min.z + rng() % 6 };
+			std::vector<uint64_t> keys;
+			for (CoordAxis x = min.x; x < max.x; ++x) {
+				for (CoordAxis y = min.y; y < max.y; ++y) {
+					for (CoordAxis z = min.z; z < max.z; ++z) {
+						keys.push_back(ChunkKey::encode(x, y, z));
+					}
+				}
+			}
+			for (int i = 0; i < 50; ++i) {
+				const uint64_t key = ChunkKey::encode(rng() % 20, rng() % 12, rng() % 20);
+				bool expected_found = false;
+				uint64_t expected = UINT64_MAX;
+				for (const uint64_t candidate : keys) {
+					if (candidate >= key && candidate < expected) {
+						expected = candidate;
+						expected_found = true;
+					}
+				}
+				uint64_t next;
+				const bool found = ChunkKey::nextInRegion(key, min, max, next);
+				if (found != expected_found || (found && next != expected)) {
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	// 差异应用到基础地形上后与修改后的区块一致，没有修改的层差异为空
+	// 改写整层时差异不大于整层，也不大于整层不经压缩的大小
+	static bool test_chunk_delta() {
+		auto base = LoadedChunk::create({ 0, 0, 0 });
+		auto chunk = LoadedChunk::create({ 0, 0, 0 });
+		fillRandom(*base, 1);
+		fillRandom(*chunk, 1);
+		chunk->setBar(3, 4, 2, 20, 99, 1);
+		chunk->setVoxel({ 31, 31, 31 }, 7, 1);
+		chunk->setBar(0, 0, 0, LoadedChunk::kHeight, 0, 5);
+		// 整层都被改写时以整层储存，同样能还原，每个格子都与上下不同时游程最多
+		for (CoordAxis x = 0; x < LoadedChunk::kWidth; ++x) {
+			for (CoordAxis z = 0; z < LoadedChunk::kWidth; ++z) {
+				for (CoordAxis y = 0; y < LoadedChunk::kHeight; ++y) {
+					chunk->setVoxel({ x, y, z }, 20 + (x + y + z) % 3, 6);
+				}
+			}
+		}
+
+		for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+			const std::string delta = ChunkDelta::diff(*base, *chunk, layer);
+			if (sameLayer(*base, *chunk, layer) != delta.empty()) {
+				return false;
+			}
+			if (layer == 6) {
+				std::ostringstream oss;
+				chunk->serializeLayer(oss, layer);
+				if (delta.size() > oss.str().size() + 1 || delta.size() > chunk->getDataChunk(layer).packedSize()) {
+					return false;
+				}
+			}
+			if (!delta.empty()) {
+				ChunkDelta::apply(*base, layer, delta);
+			}
+		}
+		return sameChunk(*base, *chunk);
+	}
+
+	// 读取出的可修改副本没有被修改的层，只修改一层后保存只写入这一层的 overlay
+	static bool test_save_dirty_layers() {
+		std::vector<std::unique_ptr<StorageBackend>> shards;
+		shards.push_back(std::make_unique<MemoryBackend>());
+		auto overlay = std::make_unique<MemoryBackend>();
+		MemoryBackend &overlay_env = *overlay;
+		WorldDB db(std::move(shards), std::move(overlay), false);
+		const auto overlayKeys = [&]() {
+			std::vector<std::string> keys;
+			overlay_env.scan(StorageBackend::kOverlayTable, ChunkKey(0).bytes(), [&](const std::string_view key, const std::string_view, std::string &) {
+				keys.emplace_back(key);
+				return StorageBackend::ScanStep::kNext;
+			}, nullptr);
+			return keys;
+		};
+
+		const Coord pos{ 2, 0, 3 };
+		auto base = LoadedChunk::create(pos);
+		fillRandom(*base, 3);
+		db.saveBaseChunk(base.get());
+
+		auto chunk = db.loadChunkForEdit(pos);
+		if (!chunk || chunk->dirtyLayers() != 0 || !sameChunk(*chunk, *base)) {
+			return false;
+		}
+		// 没有修改过的区块不会写入
+		db.saveChunk(chunk.get());
+		if (!overlayKeys().empty()) {
+			return false;
+		}
+
+		chunk->setBar(5, 6, 0, 40, 77, 2);
+		if (chunk->dirtyLayers() != 1 << 2) {
+			return false;
+		}
+		db.saveChunk(chunk.get());
+		if (overlayKeys() != std::vector<std::string>{ ChunkKey(pos).layerKey(2) } || chunk->dirtyLayers() != 0) {
+			return false;
+		}
+		// 缓存在保存时失效，再次读取得到修改后的区块
+		const auto loaded = db.loadChunk(pos);
+		return loaded && sameChunk(*loaded, *chunk);
+	}
+
+	// 组中不是第一个的区块以第一个区块为字典，也能单独解码
+	static bool test_chunk_batch() {
+		std::vector<std::unique_ptr<LoadedChunk>> chunks;
+		std::vector<const LoadedChunk *> members;
+		for (CoordAxis x = 4; x < 4 + ChunkBatch::kWidth; ++x) {
+			for (CoordAxis z = 8; z < 8 + ChunkBatch::kWidth; z += 2) {
+				chunks.push_back(LoadedChunk::create({ x, 3, z }));
+				fillRandom(*chunks.back(), x * 16 + z);
+				members.push_back(chunks.back().get());
+			}
+		}
+		const std::string batch = ChunkBatch::encode(members);
+		if (ChunkBatch::positions(batch, ChunkBatch::corner(members.front()->getPosition())).size() != members.size()) {
+			return false;
+		}
+		for (size_t i = 1; i < members.size(); ++i) {
+			auto decoded = LoadedChunk::create(members[i]->getPosition());
+			if (!ChunkBatch::decode(batch, *decoded, LoadedChunk::kAllLayers) || !sameChunk(*decoded, *members[i])) {
+				return false;
+			}
+		}
+		// 只解码部分层时其余层保持为空
+		auto partial = LoadedChunk::create(members.back()->getPosition());
+		auto empty = LoadedChunk::create(members.back()->getPosition());
+		if (!ChunkBatch::decode(batch, *partial, 1 << 2) || !sameLayer(*partial, *members.back(), 2) || !sameLayer(*partial, *empty, 3)) {
+			return false;
+		}
+		// 组内不存在的区块
+		auto missing = LoadedChunk::create({ 4, 3, 9 });
+		return !ChunkBatch::contains(batch, { 4, 3, 9 }) && !ChunkBatch::decode(batch, *missing, LoadedChunk::kAllLayers);
+	}
+
+	// 保存后读取的过滤器包含所有插入过的竖列，世界大小不一致时拒绝读取
+	static bool test_presence_filter() {
+		const CoordAxis width = 100;
+		PresenceFilter filter(width);
+		const std::vector<std::pair<CoordAxis, CoordAxis>> inserted{ { 0, 0 }, { 99, 1 }, { 42, 77 }, { 100, 0 }, { 12345, 678 } };
+		for (const auto &[x, z] : inserted) {
+			filter.insert(x, z);
+		}
+		std::stringstream ss;
+		filter.save(ss);
+
+		PresenceFilter loaded(width);
+		if (!loaded.load(ss)) {
+			return false;
+		}
+		for (const auto &[x, z] : inserted) {
+			if (!loaded.mayContain(x, z)) {
+				return false;
+			}
+		}
+		// 范围内使用稠密位图，不会误报
+		if (loaded.mayContain(1, 1) || loaded.mayContain(98, 99)) {
+			return false;
+		}
+		ss.clear();
+		ss.seekg(0);
+		PresenceFilter mismatched(width * 2);
+		return !mismatched.load(ss);
+	}
+
+	// 写入相同数据后，各存储的 get 与带 seek 的 scan 结果相同
+	static bool test_storage_backends() {
+		const std::filesystem::path dir = std::filesystem::temp_directory_path() / "pgvoxel_test_storage";
+		std::filesystem::remove_all(dir);
+		std::filesystem::create_directories(dir);
+
+		std::vector<std::unique_ptr<StorageBackend>> backends;
+		backends.push_back(std::make_unique<MemoryBackend>());
+		backends.push_back(std::make_unique<RegionFileBackend>((dir / "world.regions").string()));
+		backends.push_back(std::make_unique<LmdbEnvironment>((dir / "world.db").string(), 1 << 26));
+
+		// 跨越多个区域的区块，每个区块若干层，其中一部分随后被覆盖或删除
+		std::mt19937 rng(7);
+		std::vector<std::pair<std::string, std::string>> entries;
+		for (int i = 0; i < 300; ++i) {
+			const ChunkKey chunk_key(rng() % 80, rng() % 4, rng() % 80);
+			entries.emplace_back(chunk_key.layerKey(rng() % LoadedChunk::kDataChunkNums), std::to_string(rng()));
+		}
+		for (auto &backend : backends) {
+			for (const auto &[key, value] : entries) {
+				if (!backend->put(StorageBackend::kTerrainTable, key, value)) {
+					return false;
+				}
+			}
+			for (size_t i = 0; i < entries.size(); i += 7) {
+				if (!backend->put(StorageBackend::kTerrainTable, entries[i].first, "overwritten") ||
+						!backend->del(StorageBackend::kTerrainTable, entries[i + 3].first)) {
+					return false;
+				}
+			}
+			// 同一批中的写入与删除
+			for (size_t i = 0; i + 5 < entries.size(); i += 11) {
+				const StorageBackend::Batch batch{ { entries[i + 5].first, StorageBackend::kDelete }, { entries[i + 1].first, "batched" } };
+				if (!backend->putBatch(StorageBackend::kTerrainTable, batch)) {
+					return false;
+				}
+			}
+		}
+
+		const Coord min{ 10, 1, 20 }, max{ 50, 3, 70 };
+		const auto collect = [&](StorageBackend &backend) {
+			std::vector<std::pair<std::string, std::string>> result;
+			const auto visitor = [&](const std::string_view key, const std::string_view value, std::string &seek) {
+				const uint64_t current = ChunkKey::fromBytes(key.data()).value();
+				uint64_t next;
+				if (!ChunkKey::nextInRegion(current, min, max, next)) {
+					return StorageBackend::ScanStep::kStop;
+				}
+				if (next != current) {
+					seek = ChunkKey(next).bytes();
+					return StorageBackend::ScanStep::kSeek;
+				}
+				result.emplace_back(key, value);
+				return StorageBackend::ScanStep::kNext;
+			};
+			backend.scan(StorageBackend::kTerrainTable, ChunkKey(min).bytes(), visitor, nullptr);
+			return result;
+		};
+		const auto expected = collect(*backends.front());
+		if (expected.empty()) {
+			return false;
+		}
+		for (size_t i = 1; i < backends.size(); ++i) {
+			if (collect(*backends[i]) != expected) {
+				return false;
+			}
+		}
+		for (const auto &[key, value] : entries) {
+			std::vector<std::pair<bool, std::string>> values;
+			for (auto &backend : backends) {
+				std::string result;
+				const bool found = backend->get(StorageBackend::kTerrainTable, key, [&](const std::string_view data) { result = data; });
+				values.emplace_back(found, result);
+			}
+			if (values[1] != values[0] || values[2] != values[0]) {
+				return false;
+			}
+		}
+
+		backends.clear();
+		std::filesystem::remove_all(dir);
+		return true;
+	}
+
+	// flush 之后的修改总会让版本号变大，重新打开后也不会回到 flush 时的值
+	static bool test_region_file_version() {
+		const std::filesystem::path dir = std::filesystem::temp_directory_path() / "pgvoxel_test_region_version";
+		std::filesystem::remove_all(dir);
+		const std::string key = ChunkKey(1, 0, 1).layerKey(0);
+		uint64_t flushed;
+		{
+			RegionFileBackend backend(dir.string());
+			if (!backend.put(StorageBackend::kTerrainTable, key, "abcd") || !backend.flush()) {
+				return false;
+			}
+			flushed = backend.version();
+			// 没有修改时版本号不变
+			std::string value;
+			backend.get(StorageBackend::kTerrainTable, key, [&](const std::string_view data) { value = data; });
+			if (value != "abcd" || backend.version() != flushed) {
+				return false;
+			}
+			// 删除整个数据库后写入同样长度的另一个值，文件长度与 flush 时相同，版本号仍然改变
+			if (!backend.dropTable(StorageBackend::kTerrainTable) || !backend.put(StorageBackend::kTerrainTable, key, "wxyz") ||
+					backend.version() <= flushed) {
+				return false;
+			}
+		}
+		RegionFileBackend reopened(dir.string());
+		const bool changed = reopened.version() > flushed;
+		std::filesystem::remove_all(dir);
+		return changed;
+	}
+
+	// 多次提交的修改合并到一起，取出时按层、竖列、来源排列，与提交的顺序无关
+	static bool test_deferred_edit_queue() {
+		using Edit = DeferredEditQueue::Edit;
+		DeferredEditQueue queue;
+		const uint64_t target = ChunkKey::encode(3, 0, 4);
+		queue.push(target, { Edit{ 1, 1, 0, 4, 7, 0, 20, 1 }, Edit{ 1, 1, 0, 4, 8, 0, 20, 0 } });
+		queue.push(ChunkKey::encode(9, 0, 9), { Edit{ 0, 0, 0, 1, 1, 0, 20, 0 } });
+		queue.push(target, { Edit{ 1, 1, 2, 6, 9, 0, 10, 0 }, Edit{ 0, 5, 0, 1, 3, 1, 10, 1 }, Edit{ 0, 2, 0, 1, 2, 0, 30, 0 } });
+
+		const std::vector<Edit> edits = queue.take(target);
+		if (edits.size() != 5) {
+			return false;
+		}
+		const auto order = [](const Edit &edit) { return std::make_tuple(edit.layer, edit.x, edit.z, edit.source, edit.sequence); };
+		for (size_t i = 1; i < edits.size(); ++i) {
+			if (!(order(edits[i - 1]) < order(edits[i]))) {
+				return false;
+			}
+		}
+		// 同一竖列上来源较大的修改排在后面，应用时生效
+		if (edits[1].data != 9 || edits[2].data != 8 || edits[3].data != 7 || edits.back().layer != 1) {
+			return false;
+		}
+		// 取出后清空，不影响其他区块
+		return queue.take(target).empty() && queue.take(ChunkKey::encode(9, 0, 9)).size() == 1;
+	}
+
+	// 常量运算被折叠，不影响写入的节点和噪声被丢弃，寄存器在最后一次使用后复用
+	static bool test_generator_program() {
+		using Op = GeneratorProgram::Op;
+		using Node = GeneratorProgram::Node;
+		std::vector<Node> nodes;
+		const auto add = [&](Node node) {
+			nodes.push_back(std::move(node));
+			return static_cast<int>(nodes.size()) - 1;
+		};
+		const int noise = add({ Op::kNoise2d, {}, 0, 0, 0 });
+		const int two = add({ Op::kConstant, {}, 2 });
+		const int ten = add({ Op::kConstant, {}, 10 });
+		const int twenty = add({ Op::kMul, { two, ten } });
+		const int offset = add({ Op::kConstant, {}, 44 });
+		const int amplitude = add({ Op::kAdd, { twenty, offset } });
+		const int height = add({ Op::kMul, { noise, amplitude } });
+		const int y = add({ Op::kY, {} });
+		const int below = add({ Op::kSub, { height, y } });
+		add({ Op::kSetBlock, { below }, 0, 0, 0, 1, 0 });
+		const int unused = add({ Op::kNoise3d, {}, 0, 0, 1 });
+		add({ Op::kAdd, { unused, unused } });
+
+		std::vector<GeneratorProgram::Field> fields{ { GradientNoise(1, {}), false, 1 }, { GradientNoise(2, {}), true, 4 } };
+		const auto program = GeneratorProgram::compile(nodes, fields);
+		// noise, 折叠后的 64, mul, y, sub, set_block
+		if (!program || program->instructionCount() != 6 || program->registerCount() != 2) {
+			return false;
+		}
+
+		// 引用之后的节点或维度不匹配的图不合法
+		if (GeneratorProgram::compile({ Node{ Op::kAdd, { 0, 1 } } }, {}) ||
+				GeneratorProgram::compile({ Node{ Op::kNoise3d, {}, 0, 0, 0 } }, { { GradientNoise(1, {}), false, 1 } })) {
+			return false;
+		}
+		return true;
+	}
+
+	// 相同 key 的请求只加载一次，取消只影响各自的调用方，提升优先级后先被处理
+	static bool test_request_queue() {
+		// 唯一的工作线程先被 key 0 阻塞，其余请求在此期间排队
+		std::promise<void> started, gate;
+		std::shared_future<void> gate_future = gate.get_future().share();
+		std::mutex mtx;
+		std::vector<int> loaded;
+		RequestQueue<int, int> queue([&](const int &key) {
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				loaded.push_back(key);
+			}
+			if (key == 0) {
+				started.set_value();
+				gate_future.wait();
+			}
+			return key * 10;
+		}, 1);
+		const auto blocker = queue.request(0, 0);
+		started.get_future().wait();
+
+		const auto first = queue.request(1, 0);
+		const auto second = queue.request(1, 0);
+		const auto low = queue.request(2, 0);
+		const auto bumped = queue.request(3, 0);
+		const auto dropped = queue.request(4, 0);
+		if (queue.pendingCount() != 4) {
+			return false;
+		}
+		// 取消合并请求中的一个调用方，另一个仍会得到结果；所有调用方都取消的请求从队列中移除
+		if (!queue.cancel(first.ticket) || queue.cancel(first.ticket) || first.future.get() != std::nullopt ||
+				!queue.cancel(dropped.ticket) || queue.pendingCount() != 3) {
+			return false;
+		}
+		// 合并时提升到较高的优先级，reprioritize 直接修改
+		const auto merged = queue.request(2, 5);
+		if (!queue.reprioritize(3, 10) || queue.reprioritize(4, 10)) {
+			return false;
+		}
+		gate.set_value();
+
+		if (blocker.future.get() != 0 || second.future.get() != 10 || low.future.get() != 20 || merged.future.get() != 20 ||
+				bumped.future.get() != 30) {
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mtx);
+		return loaded == std::vector<int>{ 0, 3, 2, 1 };
+	}
+
+	// 超出预算时淘汰最久未使用的条目，超过单个 shard 预算的条目不会被缓存
+	static bool test_lru_cache() {
+		ShardedLruCache<int, int, 1> cache(100);
+		for (int i = 0; i < 3; ++i) {
+			cache.put(i, i, 30);
+		}
+		// 访问 0 后 1 成为最久未使用的条目
+		if (cache.get(0) != 0) {
+			return false;
+		}
+		cache.put(3, 3, 30);
+		if (cache.get(1) || cache.get(0) != 0 || cache.get(2) != 2 || cache.get(3) != 3) {
+			return false;
+		}
+		// 替换条目时按新的大小记账
+		cache.put(2, 20, 10);
+		cache.put(4, 4, 200);
+		if (cache.get(4) || cache.get(2) != 20) {
+			return false;
+		}
+		const auto stats = cache.stats();
+		if (stats.entries != 3 || stats.bytes != 70 || stats.evictions != 1) {
+			return false;
+		}
+		cache.erase(0);
+		return !cache.get(0) && cache.stats().bytes == 40;
+	}
+
+	// 预算内的区块留在内存中，超出时溢出到临时文件，删除或覆盖后的空间被之后溢出的区块复用
+	// 相邻的空闲区间会合并，位于末尾的空闲空间直接归还
+	static bool test_generation_store() {
+		const std::filesystem::path dir = std::filesystem::temp_directory_path() / "pgvoxel_test_generation";
+		std::filesystem::remove_all(dir);
+		std::filesystem::create_directories(dir);
+
+		// 各层分别压缩，只写入第 0 层与第 1 层的区块 a、b 的大小之和大于同时写入两层的区块 both
+		const auto create = [](const CoordAxis x, const bool first, const bool second) {
+			auto chunk = GenerationChunk::create({ x, 0, 0 });
+			for (uint8_t layer = 0; layer < 2; ++layer) {
+				if (layer == 0 ? !first : !second) {
+					continue;
+				}
+				std::mt19937 rng(layer + 1);
+				for (int i = 0; i < 256; ++i) {
+					const CoordAxis bar_x = rng() % GenerationChunk::kWidth, bar_z = rng() % GenerationChunk::kWidth;
+					const CoordAxis buttom = rng() % GenerationChunk::kHeight;
+					chunk->setBar(bar_x, bar_z, buttom, buttom + 1 + rng() % (GenerationChunk::kHeight - buttom), rng() % 64, layer);
+				}
+			}
+			return chunk;
+		};
+		const auto stored = [](GenerationStore &store, const GenerationChunk &expected) {
+			auto chunk = store.load(expected.getPosition().x, expected.getPosition().z, 0);
+			return chunk && sameChunk(*chunk, expected);
+		};
+
+		GenerationStore memory(1ULL << 30, (dir / "memory.scratch").string());
+		auto a = create(0, true, false);
+		if (!memory.save(a.get(), 0) || memory.memoryUsage() == 0 || memory.spilledSize() != 0 || !stored(memory, *a)) {
+			return false;
+		}
+		memory.erase(0, 0, 0);
+		if (memory.memoryUsage() != 0 || memory.load(0, 0, 0)) {
+			return false;
+		}
+
+		// 最后溢出的区块使 a、b 释放后的空间不在末尾
+		GenerationStore spilled(0, (dir / "spilled.scratch").string());
+		auto b = create(1, false, true);
+		auto last = create(4, false, true);
+		if (!spilled.save(a.get(), 0) || !spilled.save(b.get(), 0) || !spilled.save(last.get(), 0) || spilled.memoryUsage() != 0) {
+			return false;
+		}
+		const size_t size = spilled.spilledSize();
+		if (size == 0 || !stored(spilled, *a) || !stored(spilled, *b)) {
+			return false;
+		}
+		// 与 a 大小相同的区块复用 a 的空间
+		spilled.erase(0, 0, 0);
+		auto copy = create(2, true, false);
+		if (!spilled.save(copy.get(), 0) || spilled.spilledSize() != size || !stored(spilled, *copy)) {
+			return false;
+		}
+		// both 只能放进 a、b 合并后的空间
+		spilled.erase(1, 0, 0);
+		spilled.erase(2, 0, 0);
+		auto both = create(3, true, true);
+		if (!spilled.save(both.get(), 0) || spilled.spilledSize() != size || !stored(spilled, *both)) {
+			return false;
+		}
+		// 覆盖时先写入新的数据再释放旧的空间，之后同样大小的区块复用它
+		auto replaced = create(3, false, true);
+		if (!spilled.save(replaced.get(), 0) || !stored(spilled, *replaced)) {
+			return false;
+		}
+		const size_t replaced_size = spilled.spilledSize();
+		auto reused = create(5, true, true);
+		if (!spilled.save(reused.get(), 0) || spilled.spilledSize() != replaced_size || !stored(spilled, *reused) || !stored(spilled, *last)) {
+			return false;
+		}
+		for (CoordAxis x = 3; x <= 5; ++x) {
+			spilled.erase(x, 0, 0);
+		}
+		return spilled.spilledSize() == 0;
+	}
+
+	// 二进制格式保留整数和 Packed*Array 的类型，也能读取旧版本的 JSON 格式
+	// 经过 WorldDB 读写后不变，读取到的是独立的副本，修改它不影响缓存
+	static bool test_metadata_codec() {
+		Dictionary nested;
+		nested["name"] = "cave";
+		PackedInt32Array heights;
+		heights.push_back(12);
+		heights.push_back(-4);
+		Dictionary metadata;
+		metadata["biome"] = 3;
+		metadata["temperature"] = 0.25;
+		metadata["heights"] = heights;
+		metadata["nested"] = nested;
+
+		const std::vector<uint8_t> encoded = WorldDB::encodeMetadata(metadata);
+		const Dictionary decoded = WorldDB::decodeMetadata(encoded.data(), encoded.size());
+		if (!decoded.recursive_equal(metadata, 0) || decoded["biome"].get_type() != Variant::INT ||
+				decoded["heights"].get_type() != Variant::PACKED_INT32_ARRAY) {
+			return false;
+		}
+		const std::string json = R"({"biome": 3, "label": "forest"})";
+		const Dictionary legacy = WorldDB::decodeMetadata(reinterpret_cast<const uint8_t *>(json.data()), json.size());
+		if (static_cast<int>(legacy["biome"]) != 3 || String(legacy["label"]) != "forest") {
+			return false;
+		}
+
+		std::vector<std::unique_ptr<StorageBackend>> shards;
+		shards.push_back(std::make_unique<MemoryBackend>());
+		WorldDB db(std::move(shards), std::make_unique<MemoryBackend>(), false);
+		db.setMetadata(2, 3, metadata);
+		Dictionary loaded = db.getMetadata(2, 3);
+		loaded["biome"] = 7;
+		return db.getMetadata(2, 3).recursive_equal(metadata, 0) && db.getMetadata(5, 5).is_empty();
+	}
+
+	// 只有超出预算被淘汰的条目交给淘汰回调，像压缩缓存一样转移到下一级后仍能找到，删除和替换不会触发
+	static bool test_lru_cache_eviction_handler() {
+		ShardedLruCache<int, int, 1> hot(100), cold(1000);
+		std::vector<int> evicted;
+		hot.setEvictionHandler([&](const int &key, int &&value) {
+			evicted.push_back(key);
+			cold.put(key, value * 10, 10);
+		});
+		for (int i = 0; i < 5; ++i) {
+			hot.put(i, i, 40);
+		}
+		hot.erase(4);
+		hot.put(3, 30, 40);
+		if (evicted != std::vector<int>{ 0, 1, 2 }) {
+			return false;
+		}
+		for (int i = 0; i < 3; ++i) {
+			if (hot.get(i) || cold.get(i) != i * 10) {
+				return false;
+			}
+		}
+		return hot.get(3) == 30 && !cold.get(3);
+	}
+
+	// 已读取的区块被缓存，保存修改后缓存失效，之后读取到修改后的区块，之前读取的区块不受影响
+	static bool test_chunk_cache_invalidation() {
+		std::vector<std::unique_ptr<StorageBackend>> shards;
+		shards.push_back(std::make_unique<MemoryBackend>());
+		WorldDB db(std::move(shards), std::make_unique<MemoryBackend>(), false);
+
+		const Coord pos{ 1, 0, 4 };
+		auto base = LoadedChunk::create(pos);
+		fillRandom(*base, 5);
+		db.saveBaseChunk(base.get());
+
+		const auto cached = db.loadChunk(pos);
+		if (!cached || db.loadChunk(pos) != cached || !sameChunk(*cached, *base)) {
+			return false;
+		}
+		auto chunk = db.loadChunkForEdit(pos);
+		chunk->setBar(7, 8, 0, 20, 42, 3);
+		db.saveChunk(chunk.get());
+
+		const auto reloaded = db.loadChunk(pos);
+		return reloaded && reloaded != cached && sameChunk(*reloaded, *chunk) && sameChunk(*cached, *base);
+	}
 };
 
 } //namespace pgvoxel
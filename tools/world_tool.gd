@@ -0,0 +1,91 @@
+extends SceneTree
+
+# 离线维护世界数据库的命令行工具，需要在没有打开世界的情况下运行，例如：
+#   godot --headless -s tools/world_tool.gd -- compact world.db world.compact.db
+#   godot --headless -s tools/world_tool.gd -- pack world.db world.pgw 0 0 64 64
+#   godot --headless -s tools/world_tool.gd -- inspect world.db 0 0 0
+#   godot --headless -s tools/world_tool.gd -- stats world.db
+#   godot --headless -s tools/world_tool.gd -- benchmark world.db 100000
+# 分片的世界可以对每个分片分别运行，或先用 VoxelWorld.merge_shards 合并
+
+
+func _init() -> void:
+	var args := OS.get_cmdline_user_args()
+	if args.is_empty():
+		_usage()
+		quit(1)
+		return
+
+	match args[0]:
+		"compact":
+			if args.size() != 3:
+				_usage()
+				quit(1)
+				return
+			var report := VoxelWorldTool.compact(args[1], args[2])
+			if report.is_empty():
+				quit(1)
+				return
+			print(JSON.stringify(report, "  "))
+			quit(0)
+		"pack":
+			# 可选的 x z width depth 指定不压缩的热区，单位为区块竖列
+			if args.size() != 3 and args.size() != 7:
+				_usage()
+				quit(1)
+				return
+			var hot_region := Rect2i()
+			if args.size() == 7:
+				hot_region = Rect2i(int(args[3]), int(args[4]), int(args[5]), int(args[6]))
+			var report := VoxelWorldTool.pack(args[1], args[2], hot_region)
+			if report.is_empty():
+				quit(1)
+				return
+			print(JSON.stringify(report, "  "))
+			quit(0)
+		"inspect":
+			# 区块坐标与 ChunkKey 一致，y 为区块底部的高度
+			if args.size() != 5:
+				_usage()
+				quit(1)
+				return
+			var position := Vector3i(int(args[2]), int(args[3]), int(args[4]))
+			var report := VoxelWorldTool.inspect(args[1], position)
+			if report.is_empty():
+				quit(1)
+				return
+			print(JSON.stringify(report, "  "))
+			quit(0)
+		"stats":
+			if args.size() != 2:
+				_usage()
+				quit(1)
+				return
+			var report := VoxelWorldTool.stats(args[1])
+			if report.is_empty():
+				quit(1)
+				return
+			print(JSON.stringify(report, "  "))
+			quit(0)
+		"benchmark":
+			if args.size() != 2 and args.size() != 3:
+				_usage()
+				quit(1)
+				return
+			var report := VoxelWorldTool.benchmark(args[1]) if args.size() == 2 else VoxelWorldTool.benchmark(args[1], int(args[2]))
+			if report.is_empty():
+				quit(1)
+				return
+			print(JSON.stringify(report, "  "))
+			quit(0)
+		_:
+			_usage()
+			quit(1)
+
+
+func _usage() -> void:
+	printerr("usage: godot --headless -s tools/world_tool.gd -- compact <source.db> <target.db>")
+	printerr("       godot --headless -s tools/world_tool.gd -- pack <source.db> <target.pgw> [x z width depth]")
+	printerr("       godot --headless -s tools/world_tool.gd -- inspect <source.db> <x> <y> <z>")
+	printerr("       godot --headless -s tools/world_tool.gd -- stats <source.db>")
+	printerr("       godot --headless -s tools/world_tool.gd -- benchmark <source.db> [reads]")
@@ -2,6 +2,7 @@
 
 #include "forward.h"
 
+#include "core/variant/callable.h"
 #include "core/variant/dictionary.h"
 #include "core/object/class_db.h"
 
@@ -14,6 +15,26 @@ public:
 	static Dictionary getMetadata(int32_t x, int32_t z);
 	static void setMetadata(int32_t x, int32_t z, const Dictionary &metadata);
 
+	// 异步读取 metadata，读取完成后在主线程中以 metadata 为参数调用 callback
+	// 返回的 ticket 用于取消这一次请求，被取消的请求不会调用 callback，也不影响同一竖列的其他请求
+	static int64_t requestMetadata(int32_t x, int32_t z, int32_t priority, const Callable &callback);
+	static bool reprioritizeMetadata(int32_t x, int32_t z, int32_t priority);
+	static bool cancelMetadataRequest(int64_t ticket);
+
+	// 异步读取区块的第 layer 层，读取完成后在主线程中以 (position, VoxelBuffer) 为参数调用 callback，区块不存在时 VoxelBuffer 为 null
+	// 转换为 VoxelBuffer 的工作在 I/O 线程中完成。返回的 ticket 与 requestMetadata 的用法相同，参数不合法时返回 -1
+	static int64_t requestChunk(const Vector3i &position, int32_t layer, int32_t priority, const Callable &callback);
+	static bool reprioritizeChunk(const Vector3i &position, int32_t priority);
+	static bool cancelChunkRequest(int64_t ticket);
+
+	// 区块缓存的命中率等统计信息，用于调整缓存预算
+	static Dictionary getChunkCacheStats();
+	static void setChunkCacheBudget(int64_t budget);
+	static void setCompressedChunkCacheBudget(int64_t budget);
+
+	// 将数据库的各个分片合并为 path 处的单个文件，用于发布世界
+	static bool mergeShards(const String &path);
+
 private:
 	static void _bind_methods();
 };
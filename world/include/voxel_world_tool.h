@@ -0,0 +1,40 @@
+#pragma once
+
+#include "core/object/class_db.h"
+#include "core/math/rect2i.h"
+#include "core/math/vector3i.h"
+#include "core/variant/dictionary.h"
+
+namespace pgvoxel {
+
+// 离线维护世界数据库的工具，通过 tools/world_tool.gd 在 headless 模式下运行
+// 同一进程中不能重复打开同一个 LMDB 环境，因此不能在 WorldDB 已打开 source 的进程中使用
+class VoxelWorldTool : public Object {
+	GDCLASS(VoxelWorldTool, Object)
+public:
+	// 将 source 中的数据逐条解码、fit 后以 LZ4HC 重新编码，按 key 的顺序追加到新建的 target 中
+	// generation 只在生成期间存在，不会被复制
+	// 返回 metadata 和 terrain 各自的条数以及压缩前后的大小，失败时返回空 Dictionary
+	static Dictionary compact(const String &source, const String &target);
+	// 将 source 导出为只读的打包世界 target，供 storage_backend 为 packed 时使用
+	// hot_region 内的区块竖列以不压缩的格式储存，读取时无需解压，适合出生点附近等经常访问的区域
+	// 返回 metadata 和 terrain 各自的条数和大小，失败时返回空 Dictionary
+	static Dictionary pack(const String &source, const String &target, const Rect2i &hot_region);
+
+	// 以下只读取 source，用于调整存储格式和参数
+	// 列出 position 处区块在 terrain 中的各条数据及其头部，并解码统计各层的调色板、位宽和各种值的数量
+	// position 与 ChunkKey 一致，y 为区块底部的高度。区块不存在时返回空 Dictionary
+	static Dictionary inspect(const String &source, const Vector3i &position);
+	// 统计各数据库的条数和值的大小分布，以及 terrain 各层的调色板大小、位宽分布、空层数和压缩率
+	static Dictionary stats(const String &source);
+	// 计时顺序遍历 terrain，以及 reads 次随机读取和随机读取并解码，返回吞吐量和平均延迟
+	static Dictionary benchmark(const String &source, const int reads);
+
+private:
+	static const int kDefaultBenchmarkReads = 100000;
+
+
+	static void _bind_methods();
+};
+
+} //namespace pgvoxel
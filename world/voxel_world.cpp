@@ -1,4 +1,7 @@
 #include "voxel_world.h"
+#include "async_world_db.h"
+#include "chunk.inl"
+#include "voxel_buffer.h"
 #include "world_db.h"
 
 namespace pgvoxel {
@@ -11,9 +14,87 @@ void VoxelWorld::setMetadata(int32_t x, int32_t z, const Dictionary &data) {
 	WorldDB::singleton().setMetadata(x, z, data);
 }
 
+int64_t VoxelWorld::requestMetadata(int32_t x, int32_t z, int32_t priority, const Callable &callback) {
+	return AsyncWorldDB::singleton().requestMetadata(x, z, priority, [callback](const Dictionary &metadata) {
+		// 回调在 I/O 线程中触发，转发到主线程
+		callback.call_deferred(metadata);
+	}).ticket;
+}
+
+bool VoxelWorld::reprioritizeMetadata(int32_t x, int32_t z, int32_t priority) {
+	return AsyncWorldDB::singleton().reprioritizeMetadata(x, z, priority);
+}
+
+bool VoxelWorld::cancelMetadataRequest(int64_t ticket) {
+	return AsyncWorldDB::singleton().cancelMetadata(ticket);
+}
+
+int64_t VoxelWorld::requestChunk(const Vector3i &position, int32_t layer, int32_t priority, const Callable &callback) {
+	ERR_FAIL_INDEX_V(layer, LoadedChunk::kDataChunkNums, -1);
+	return AsyncWorldDB::singleton().requestChunk(toCoord(position), priority, [position, layer, callback](const AsyncWorldDB::ChunkResult &chunk) {
+		Ref<VoxelBuffer> buffer;
+		if (chunk) {
+			buffer.instantiate();
+			buffer->data() = chunk->getBlock({ 0, 0, 0 }, { LoadedChunk::kWidth, LoadedChunk::kHeight, LoadedChunk::kWidth }, layer);
+		}
+		// 回调在 I/O 线程中触发，转发到主线程
+		callback.call_deferred(position, buffer);
+	}).ticket;
+}
+
+bool VoxelWorld::reprioritizeChunk(const Vector3i &position, int32_t priority) {
+	return AsyncWorldDB::singleton().reprioritizeChunk(toCoord(position), priority);
+}
+
+bool VoxelWorld::cancelChunkRequest(int64_t ticket) {
+	return AsyncWorldDB::singleton().cancelChunk(ticket);
+}
+
+Dictionary VoxelWorld::getChunkCacheStats() {
+	const auto stats = WorldDB::singleton().chunkCacheStats();
+	Dictionary result;
+	result["hits"] = stats.hits;
+	result["misses"] = stats.misses;
+	result["evictions"] = stats.evictions;
+	result["bytes"] = stats.bytes;
+	result["entries"] = stats.entries;
+
+	const auto compressed_stats = WorldDB::singleton().compressedChunkCacheStats();
+	result["compressed_hits"] = compressed_stats.hits;
+	result["compressed_misses"] = compressed_stats.misses;
+	result["compressed_evictions"] = compressed_stats.evictions;
+	result["compressed_bytes"] = compressed_stats.bytes;
+	result["compressed_entries"] = compressed_stats.entries;
+	return result;
+}
+
+void VoxelWorld::setChunkCacheBudget(int64_t budget) {
+	WorldDB::singleton().setChunkCacheBudget(budget);
+}
+
+void VoxelWorld::setCompressedChunkCacheBudget(int64_t budget) {
+	WorldDB::singleton().setCompressedChunkCacheBudget(budget);
+}
+
+bool VoxelWorld::mergeShards(const String &path) {
+	return WorldDB::singleton().mergeShards(path.utf8().get_data());
+}
+
 void VoxelWorld::_bind_methods() {
 	ClassDB::bind_static_method("VoxelWorld", D_METHOD("get_metadata", "x", "z"), &VoxelWorld::getMetadata);
 	ClassDB::bind_static_method("VoxelWorld", D_METHOD("set_metadata", "x", "z", "metadata"), &VoxelWorld::setMetadata);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("request_metadata", "x", "z", "priority", "callback"), &VoxelWorld::requestMetadata);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("reprioritize_metadata", "x", "z", "priority"), &VoxelWorld::reprioritizeMetadata);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("cancel_metadata_request", "ticket"), &VoxelWorld::cancelMetadataRequest);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("request_chunk", "position", "layer", "priority", "callback"), &VoxelWorld::requestChunk);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("reprioritize_chunk", "position", "priority"), &VoxelWorld::reprioritizeChunk);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("cancel_chunk_request", "ticket"), &VoxelWorld::cancelChunkRequest);
+
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("get_chunk_cache_stats"), &VoxelWorld::getChunkCacheStats);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("set_chunk_cache_budget", "budget"), &VoxelWorld::setChunkCacheBudget);
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("set_compressed_chunk_cache_budget", "budget"), &VoxelWorld::setCompressedChunkCacheBudget);
+
+	ClassDB::bind_static_method("VoxelWorld", D_METHOD("merge_shards", "path"), &VoxelWorld::mergeShards);
 }
 
 }
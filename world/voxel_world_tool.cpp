@@ -0,0 +1,602 @@
+#include "voxel_world_tool.h"
+#include "chunk.inl"
+#include "chunk_batch.h"
+#include "chunk_key.h"
+#include "lmdb_environment.h"
+#include "packed_world_backend.h"
+#include "world_db.h"
+
+#include "core/error/error_macros.h"
+#include "core/string/print_string.h"
+
+#include <lz4hc.h>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace pgvoxel {
+
+// 每批重新编码并写入的条数，同一批中的值并行编码
+static const size_t kCompactBatchSize = 256;
+// 随机读取测试所用的随机数种子，固定以便对比
+static const uint64_t kBenchmarkSeed = 722;
+
+// 将数据库中的一个值重新编码
+typedef std::string (*Recoder)(const std::string_view key, const std::string_view value);
+
+// 以 level 指定的压缩等级重新编码 terrain 中的一个值，见 data_chunk_compression_level
+static std::string recodeTerrainWith(const std::string_view key, const std::string_view value, const int level) {
+	// ChunkBatch 中的段以组内的其他区块为字典，不能单独重新编码，原样保留
+	if (ChunkBatch::isBatchKey(key)) {
+		return std::string{ value };
+	}
+	// key 后附有层号时值只是区块的一层，否则是旧版本储存在一起的整个区块
+	const bool is_layer = key.size() > ChunkKey::kSize;
+	const uint8_t layer = is_layer ? static_cast<uint8_t>(key[ChunkKey::kSize]) : 0;
+	std::istringstream iss(std::string{ value });
+	auto chunk = LoadedChunk::create(ChunkKey::fromBytes(key.data()).position());
+	if (is_layer) {
+		chunk->deserializeLayer(iss, layer);
+	} else {
+		iss >> *chunk;
+	}
+	// 清除调色板中的空位并收窄位宽
+	chunk->fit();
+
+	const int previous_level = data_chunk_compression_level;
+	data_chunk_compression_level = level;
+	std::ostringstream oss;
+	if (is_layer) {
+		chunk->serializeLayer(oss, layer);
+	} else {
+		oss << *chunk;
+	}
+	data_chunk_compression_level = previous_level;
+	return std::move(oss).str();
+}
+
+static std::string recodeTerrain(const std::string_view key, const std::string_view value) {
+	return recodeTerrainWith(key, value, LZ4HC_CLEVEL_MAX);
+}
+
+static std::string recodeMetadata(const std::string_view key, const std::string_view value) {
+	// 旧版本的 JSON 格式会被转换为二进制格式
+	const Dictionary metadata = WorldDB::decodeMetadata(reinterpret_cast<const uint8_t *>(value.data()), value.size());
+	const std::vector<uint8_t> encoded = WorldDB::encodeMetadata(metadata);
+	if (encoded.empty()) [[unlikely]] {
+		return std::string{ value };
+	}
+	return { reinterpret_cast<const char *>(encoded.data()), encoded.size() };
+}
+
+// 数据库占用的页的总大小（字节）
+static uint64_t tableBytes(LmdbEnvironment &env, const LmdbEnvironment::Table table) {
+	MDB_stat stat;
+	if (!env.stat(table, stat)) [[unlikely]] {
+		return 0;
+	}
+	return static_cast<uint64_t>(stat.ms_psize) * (stat.ms_branch_pages + stat.ms_leaf_pages + stat.ms_overflow_pages);
+}
+
+static Dictionary compactTable(LmdbEnvironment &source, LmdbEnvironment &target, const LmdbEnvironment::Table table, const Recoder recode) {
+	uint64_t entries = 0, source_value_bytes = 0, target_value_bytes = 0;
+	{
+		// 游标读到的 key 和值在遍历结束前一直有效，写入时无需复制 key
+		LmdbEnvironment::Cursor cursor(source, table);
+		std::vector<std::pair<std::string_view, std::string_view>> pending;
+		std::vector<std::string> recoded;
+		LmdbEnvironment::Batch batch;
+		while (cursor.valid()) {
+			pending.clear();
+			while (cursor.valid() && pending.size() < kCompactBatchSize) {
+				pending.emplace_back(cursor.key(), cursor.value());
+				cursor.next();
+			}
+
+			recoded.resize(pending.size());
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, pending.size()), [&](const tbb::blocked_range<size_t> &range) {
+				for (size_t i = range.begin(); i != range.end(); ++i) {
+					recoded[i] = recode(pending[i].first, pending[i].second);
+				}
+			});
+
+			batch.clear();
+			for (size_t i = 0; i < pending.size(); ++i) {
+				batch.emplace_back(pending[i].first, recoded[i]);
+				source_value_bytes += pending[i].second.size();
+				target_value_bytes += recoded[i].size();
+			}
+			// 源数据库按 key 的顺序遍历，可以直接追加
+			ERR_FAIL_COND_V_MSG(!target.putBatch(table, batch, true), Dictionary(), "Failed to write compacted data.");
+			entries += pending.size();
+		}
+		ERR_FAIL_COND_V_MSG(!cursor.ok(), Dictionary(), "Failed to read source database.");
+	}
+
+	Dictionary result;
+	result["entries"] = entries;
+	result["source_value_bytes"] = source_value_bytes;
+	result["target_value_bytes"] = target_value_bytes;
+	result["source_bytes"] = tableBytes(source, table);
+	result["target_bytes"] = tableBytes(target, table);
+	return result;
+}
+
+Dictionary VoxelWorldTool::compact(const String &source_path, const String &target_path) {
+	const std::string source_file = source_path.utf8().get_data();
+	const std::string target_file = target_path.utf8().get_data();
+	ERR_FAIL_COND_V_MSG(!std::filesystem::exists(source_file), Dictionary(), "The source database does not exist.");
+	ERR_FAIL_COND_V_MSG(std::filesystem::exists(target_file), Dictionary(), "The compaction target already exists.");
+
+	// map size 不能小于已有的文件，打开后以数据库中记录的为准
+	LmdbEnvironment source(source_file, std::filesystem::file_size(source_file));
+	LmdbEnvironment target(target_file, source.mapsize());
+
+	Dictionary result;
+	const std::pair<LmdbEnvironment::Table, Recoder> tables[] = {
+		{ LmdbEnvironment::kMetadataTable, &recodeMetadata },
+		{ LmdbEnvironment::kTerrainTable, &recodeTerrain },
+	};
+	for (const auto &[table, recode] : tables) {
+		const Dictionary report = compactTable(source, target, table, recode);
+		ERR_FAIL_COND_V_MSG(report.is_empty(), Dictionary(), "Failed to compact database.");
+		const String name = table == LmdbEnvironment::kMetadataTable ? "metadata" : "terrain";
+		print_line(String("{0}: {1} entries, {2} -> {3} bytes.").format(varray(name, report["entries"], report["source_bytes"], report["target_bytes"])));
+		result[name] = report;
+	}
+	ERR_FAIL_COND_V_MSG(!target.flush(), Dictionary(), "Failed to flush compacted database.");
+
+	result["source_file_bytes"] = static_cast<uint64_t>(std::filesystem::file_size(source_file));
+	result["target_file_bytes"] = static_cast<uint64_t>(std::filesystem::file_size(target_file));
+	return result;
+}
+
+static Dictionary packTable(LmdbEnvironment &source, PackedWorldBackend::Writer &writer, const StorageBackend::Table table, const Rect2i &hot_region) {
+	ERR_FAIL_COND_V(!writer.beginTable(table), Dictionary());
+	uint64_t entries = 0, hot_entries = 0, value_bytes = 0;
+	LmdbEnvironment::Cursor cursor(source, table);
+	std::vector<std::pair<std::string_view, std::string_view>> pending;
+	std::vector<std::string> recoded;
+	std::vector<uint8_t> hot;
+	while (cursor.valid()) {
+		pending.clear();
+		while (cursor.valid() && pending.size() < kCompactBatchSize) {
+			pending.emplace_back(cursor.key(), cursor.value());
+			cursor.next();
+		}
+
+		// 热区内的区块不压缩，读取时无需解压，其余的值原样复制
+		recoded.assign(pending.size(), std::string{});
+		hot.assign(pending.size(), false);
+		tbb::parallel_for(tbb::blocked_range<size_t>(0, pending.size()), [&](const tbb::blocked_range<size_t> &range) {
+			for (size_t i = range.begin(); i != range.end(); ++i) {
+				const Coord pos = ChunkKey::fromBytes(pending[i].first.data()).position();
+				if (table == StorageBackend::kTerrainTable && hot_region.has_point(Point2i(pos.x, pos.z))) {
+					recoded[i] = recodeTerrainWith(pending[i].first, pending[i].second, kDataChunkUncompressed);
+					hot[i] = true;
+				} else if (table == StorageBackend::kMetadataTable) {
+					recoded[i] = recodeMetadata(pending[i].first, pending[i].second);
+				}
+			}
+		});
+
+		// 源数据库按 key 的顺序遍历，打包后的文件也按 key 的顺序排列
+		for (size_t i = 0; i < pending.size(); ++i) {
+			const bool is_recoded = hot[i] || table == StorageBackend::kMetadataTable;
+			const std::string_view value = is_recoded ? std::string_view{ recoded[i] } : pending[i].second;
+			ERR_FAIL_COND_V_MSG(!writer.append(pending[i].first, value), Dictionary(), "Failed to write packed world.");
+			hot_entries += hot[i];
+			value_bytes += value.size();
+		}
+		entries += pending.size();
+	}
+	ERR_FAIL_COND_V_MSG(!cursor.ok(), Dictionary(), "Failed to read source database.");
+
+	Dictionary result;
+	result["entries"] = entries;
+	result["uncompressed_entries"] = hot_entries;
+	result["value_bytes"] = value_bytes;
+	return result;
+}
+
+Dictionary VoxelWorldTool::pack(const String &source_path, const String &target_path, const Rect2i &hot_region) {
+	const std::string source_file = source_path.utf8().get_data();
+	const std::string target_file = target_path.utf8().get_data();
+	ERR_FAIL_COND_V_MSG(!std::filesystem::exists(source_file), Dictionary(), "The source database does not exist.");
+	ERR_FAIL_COND_V_MSG(std::filesystem::exists(target_file), Dictionary(), "The pack target already exists.");
+
+	LmdbEnvironment source(source_file, std::filesystem::file_size(source_file));
+	Dictionary result;
+	{
+		PackedWorldBackend::Writer writer(target_file);
+		for (const auto table : { StorageBackend::kMetadataTable, StorageBackend::kTerrainTable }) {
+			const Dictionary report = packTable(source, writer, table, hot_region);
+			ERR_FAIL_COND_V_MSG(report.is_empty(), Dictionary(), "Failed to pack world.");
+			const String name = table == StorageBackend::kMetadataTable ? "metadata" : "terrain";
+			print_line(String("{0}: {1} entries, {2} bytes.").format(varray(name, report["entries"], report["value_bytes"])));
+			result[name] = report;
+		}
+		ERR_FAIL_COND_V_MSG(!writer.finish(), Dictionary(), "Failed to finish packed world.");
+	}
+
+	result["source_file_bytes"] = static_cast<uint64_t>(std::filesystem::file_size(source_file));
+	result["target_file_bytes"] = static_cast<uint64_t>(std::filesystem::file_size(target_file));
+	return result;
+}
+
+// 以不小于值的 2 的幂为区间的上界统计分布
+typedef std::map<uint64_t, uint64_t> Histogram;
+
+static Dictionary toDictionary(const Histogram &histogram) {
+	Dictionary result;
+	for (const auto &[bucket, count] : histogram) {
+		result[bucket] = count;
+	}
+	return result;
+}
+
+// terrain 中一个值解码得到的区块，以及其中被解码的层
+struct DecodedTerrain {
+	std::vector<std::unique_ptr<LoadedChunk>> chunks;
+	LoadedChunk::LayerMask layers{};
+};
+
+// 依据 key 的格式解码 terrain 中的一个值：ChunkBatch、区块的一层，或旧版本储存在一起的整个区块
+static DecodedTerrain decodeTerrain(const std::string_view key, const std::string_view value) {
+	DecodedTerrain result;
+	const Coord pos = ChunkKey::fromBytes(key.data()).position();
+	if (ChunkBatch::isBatchKey(key)) {
+		for (const Coord &member : ChunkBatch::positions(value, pos)) {
+			auto chunk = LoadedChunk::create(member);
+			if (ChunkBatch::decode(value, *chunk, LoadedChunk::kAllLayers)) {
+				result.chunks.push_back(std::move(chunk));
+			}
+		}
+		result.layers = LoadedChunk::kAllLayers;
+		return result;
+	}
+
+	std::istringstream iss(std::string{ value });
+	auto chunk = LoadedChunk::create(pos);
+	if (key.size() > ChunkKey::kSize) {
+		const uint8_t layer = static_cast<uint8_t>(key[ChunkKey::kSize]);
+		ERR_FAIL_COND_V(layer >= LoadedChunk::kDataChunkNums, result);
+		chunk->deserializeLayer(iss, layer);
+		result.layers = 1 << layer;
+	} else {
+		iss >> *chunk;
+		result.layers = LoadedChunk::kAllLayers;
+	}
+	result.chunks.push_back(std::move(chunk));
+	return result;
+}
+
+// 区块一层的统计信息
+struct LayerSample {
+	uint8_t layer;
+	uint32_t palette_size;
+	uint8_t bit_width;
+	// 整层都是 0
+	bool empty;
+	// 不压缩时序列化的大小
+	uint32_t raw_bytes;
+};
+
+static LayerSample sampleLayer(const LoadedChunk &chunk, const uint8_t layer) {
+	const auto &data_chunk = chunk.getDataChunk(layer);
+	LayerSample sample{ layer, static_cast<uint32_t>(data_chunk.paletteSize()), data_chunk.bitWidth() };
+	// 位宽为 0 时整层只有一种值
+	sample.empty = sample.bit_width == 0 && chunk.getVoxel({ 0, 0, 0 }, layer) == 0;
+
+	const int previous_level = data_chunk_compression_level;
+	data_chunk_compression_level = kDataChunkUncompressed;
+	std::ostringstream oss;
+	chunk.serializeLayer(oss, layer);
+	data_chunk_compression_level = previous_level;
+	// 不计开头记录大小的 4 字节
+	sample.raw_bytes = oss.view().size() - sizeof(uint32_t);
+	return sample;
+}
+
+static Dictionary tableStats(LmdbEnvironment &source, const StorageBackend::Table table) {
+	const bool is_terrain = table == StorageBackend::kTerrainTable;
+	uint64_t entries = 0, value_bytes = 0, raw_bytes = 0, chunks = 0, batch_entries = 0, legacy_entries = 0;
+	Histogram value_sizes;
+	std::array<uint64_t, LoadedChunk::kDataChunkNums> layer_entries{}, layer_empty{}, layer_raw_bytes{};
+	std::array<Histogram, LoadedChunk::kDataChunkNums> palette_sizes, bit_widths;
+
+	LmdbEnvironment::Cursor cursor(source, table);
+	std::vector<std::pair<std::string_view, std::string_view>> pending;
+	std::vector<std::vector<LayerSample>> samples;
+	std::vector<size_t> decoded_chunks;
+	// 按层储存时同一区块的各条数据相邻，key 的前缀改变时计为一个新区块
+	uint64_t last_chunk = UINT64_MAX;
+	while (cursor.valid()) {
+		pending.clear();
+		while (cursor.valid() && pending.size() < kCompactBatchSize) {
+			pending.emplace_back(cursor.key(), cursor.value());
+			cursor.next();
+		}
+
+		samples.assign(pending.size(), {});
+		decoded_chunks.assign(pending.size(), 0);
+		if (is_terrain) {
+			tbb::parallel_for(tbb::blocked_range<size_t>(0, pending.size()), [&](const tbb::blocked_range<size_t> &range) {
+				for (size_t i = range.begin(); i != range.end(); ++i) {
+					const DecodedTerrain decoded = decodeTerrain(pending[i].first, pending[i].second);
+					for (const auto &chunk : decoded.chunks) {
+						for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+							if (decoded.layers & (1 << layer)) {
+								samples[i].push_back(sampleLayer(*chunk, layer));
+							}
+						}
+					}
+					decoded_chunks[i] = decoded.chunks.size();
+				}
+			});
+		}
+
+		for (size_t i = 0; i < pending.size(); ++i) {
+			const auto &[key, value] = pending[i];
+			++entries;
+			value_bytes += value.size();
+			++value_sizes[std::bit_ceil(value.size())];
+			if (!is_terrain) {
+				continue;
+			}
+			if (ChunkBatch::isBatchKey(key)) {
+				++batch_entries;
+				chunks += decoded_chunks[i];
+			} else {
+				legacy_entries += key.size() == ChunkKey::kSize;
+				const uint64_t current = ChunkKey::fromBytes(key.data()).value();
+				chunks += current != last_chunk;
+				last_chunk = current;
+			}
+			for (const LayerSample &sample : samples[i]) {
+				++layer_entries[sample.layer];
+				layer_empty[sample.layer] += sample.empty;
+				layer_raw_bytes[sample.layer] += sample.raw_bytes;
+				raw_bytes += sample.raw_bytes;
+				++palette_sizes[sample.layer][std::bit_ceil(sample.palette_size)];
+				++bit_widths[sample.layer][sample.bit_width];
+			}
+		}
+	}
+	ERR_FAIL_COND_V_MSG(!cursor.ok(), Dictionary(), "Failed to read source database.");
+
+	Dictionary result;
+	result["entries"] = entries;
+	result["value_bytes"] = value_bytes;
+	result["page_bytes"] = tableBytes(source, table);
+	result["value_size_histogram"] = toDictionary(value_sizes);
+	if (!is_terrain) {
+		return result;
+	}
+	result["chunks"] = chunks;
+	result["batch_entries"] = batch_entries;
+	result["legacy_entries"] = legacy_entries;
+	result["raw_bytes"] = raw_bytes;
+	result["compression_ratio"] = value_bytes == 0 ? 0.0 : static_cast<double>(raw_bytes) / value_bytes;
+	Array layers;
+	for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+		Dictionary report;
+		report["stored"] = layer_entries[layer];
+		report["empty"] = layer_empty[layer];
+		report["raw_bytes"] = layer_raw_bytes[layer];
+		report["palette_size_histogram"] = toDictionary(palette_sizes[layer]);
+		report["bit_width_histogram"] = toDictionary(bit_widths[layer]);
+		layers.push_back(report);
+	}
+	result["layers"] = layers;
+	return result;
+}
+
+Dictionary VoxelWorldTool::inspect(const String &source_path, const Vector3i &position) {
+	const std::string source_file = source_path.utf8().get_data();
+	ERR_FAIL_COND_V_MSG(!std::filesystem::exists(source_file), Dictionary(), "The source database does not exist.");
+	LmdbEnvironment source(source_file, std::filesystem::file_size(source_file));
+
+	const Coord pos = toCoord(position);
+	const ChunkKey chunk_key(pos);
+	auto chunk = LoadedChunk::create(pos);
+	LoadedChunk::LayerMask layers = 0;
+	Array entries;
+	const auto describe = [&](const std::string_view key, const std::string_view value) {
+		Dictionary entry;
+		entry["key"] = String::hex_encode_buffer(reinterpret_cast<const uint8_t *>(key.data()), key.size());
+		entry["value_bytes"] = static_cast<uint64_t>(value.size());
+		if (ChunkBatch::isBatchKey(key)) {
+			entry["format"] = "batch";
+			entry["chunks"] = static_cast<uint64_t>(ChunkBatch::positions(value, ChunkBatch::corner(pos)).size());
+			if (ChunkBatch::decode(value, *chunk, LoadedChunk::kAllLayers)) {
+				layers = LoadedChunk::kAllLayers;
+			}
+		} else if (key.size() > ChunkKey::kSize) {
+			// 单独的一层以 DataChunk 序列化的结果储存，开头是未压缩时的大小
+			const uint8_t layer = static_cast<uint8_t>(key[ChunkKey::kSize]);
+			uint32_t header = 0;
+			std::memcpy(&header, value.data(), std::min(value.size(), sizeof(header)));
+			constexpr uint32_t kUncompressedFlag = DataChunk<kLoadedChunkWidth, kLoadedChunkHeight>::kUncompressedFlag;
+			entry["format"] = "layer";
+			entry["layer"] = layer;
+			entry["raw_bytes"] = header & ~kUncompressedFlag;
+			entry["compressed"] = !(header & kUncompressedFlag);
+			if (layer < LoadedChunk::kDataChunkNums) {
+				std::istringstream iss(std::string{ value });
+				chunk->deserializeLayer(iss, layer);
+				layers |= 1 << layer;
+			}
+		} else {
+			entry["format"] = "legacy";
+			std::istringstream iss(std::string{ value });
+			iss >> *chunk;
+			layers = LoadedChunk::kAllLayers;
+		}
+		entries.push_back(entry);
+	};
+
+	// 先读取旧格式和按层储存的数据，再读取所在组的 ChunkBatch
+	const auto visitor = [&](const std::string_view key, const std::string_view value, std::string &) {
+		if (!key.starts_with(chunk_key.bytes()) || ChunkBatch::isBatchKey(key)) {
+			return StorageBackend::ScanStep::kStop;
+		}
+		describe(key, value);
+		return StorageBackend::ScanStep::kNext;
+	};
+	source.scan(StorageBackend::kTerrainTable, chunk_key.bytes(), visitor, nullptr);
+	const std::string batch_key = ChunkBatch::key(pos);
+	source.get(StorageBackend::kTerrainTable, batch_key, [&](const std::string_view value) {
+		if (ChunkBatch::contains(value, pos)) {
+			describe(batch_key, value);
+		}
+	});
+	if (entries.is_empty()) {
+		print_line("The chunk does not exist.");
+		return Dictionary();
+	}
+
+	// 解码后各层的统计，以及各种值出现的次数
+	Array decoded;
+	for (uint8_t layer = 0; layer < LoadedChunk::kDataChunkNums; ++layer) {
+		if (!(layers & (1 << layer))) {
+			continue;
+		}
+		const LayerSample sample = sampleLayer(*chunk, layer);
+		Dictionary voxels;
+		for (CoordAxis x = 0; x < LoadedChunk::kWidth; ++x) {
+			for (CoordAxis z = 0; z < LoadedChunk::kWidth; ++z) {
+				for (const VoxelData data : chunk->getBar(x, z, 0, LoadedChunk::kHeight, layer)) {
+					voxels[data] = static_cast<uint64_t>(voxels.get(data, 0)) + 1;
+				}
+			}
+		}
+		Dictionary report;
+		report["layer"] = layer;
+		report["palette_size"] = sample.palette_size;
+		report["bit_width"] = sample.bit_width;
+		report["empty"] = sample.empty;
+		report["raw_bytes"] = sample.raw_bytes;
+		report["voxels"] = voxels;
+		decoded.push_back(report);
+	}
+
+	Dictionary result;
+	result["position"] = position;
+	result["entries"] = entries;
+	result["layers"] = decoded;
+	return result;
+}
+
+Dictionary VoxelWorldTool::stats(const String &source_path) {
+	const std::string source_file = source_path.utf8().get_data();
+	ERR_FAIL_COND_V_MSG(!std::filesystem::exists(source_file), Dictionary(), "The source database does not exist.");
+	LmdbEnvironment source(source_file, std::filesystem::file_size(source_file));
+
+	Dictionary result;
+	for (const auto table : { StorageBackend::kMetadataTable, StorageBackend::kTerrainTable }) {
+		const Dictionary report = tableStats(source, table);
+		ERR_FAIL_COND_V_MSG(report.is_empty(), Dictionary(), "Failed to collect statistics.");
+		const String name = table == StorageBackend::kMetadataTable ? "metadata" : "terrain";
+		print_line(String("{0}: {1} entries, {2} value bytes.").format(varray(name, report["entries"], report["value_bytes"])));
+		result[name] = report;
+	}
+	result["file_bytes"] = static_cast<uint64_t>(std::filesystem::file_size(source_file));
+	return result;
+}
+
+Dictionary VoxelWorldTool::benchmark(const String &source_path, const int reads) {
+	typedef std::chrono::steady_clock Clock;
+	const auto seconds = [](const Clock::time_point begin) { return std::chrono::duration<double>(Clock::now() - begin).count(); };
+	const std::string source_file = source_path.utf8().get_data();
+	ERR_FAIL_COND_V_MSG(!std::filesystem::exists(source_file), Dictionary(), "The source database does not exist.");
+	ERR_FAIL_COND_V_MSG(reads <= 0, Dictionary(), "The number of reads must be positive.");
+	LmdbEnvironment source(source_file, std::filesystem::file_size(source_file));
+
+	// 顺序遍历 terrain，逐字节累加以确保值确实被读入，同时记下所有 key 供随机读取使用
+	std::vector<std::string> keys;
+	uint64_t bytes = 0, checksum = 0;
+	Clock::time_point begin = Clock::now();
+	{
+		LmdbEnvironment::Cursor cursor(source, StorageBackend::kTerrainTable);
+		while (cursor.valid()) {
+			keys.emplace_back(cursor.key());
+			for (const char byte : cursor.value()) {
+				checksum += static_cast<uint8_t>(byte);
+			}
+			bytes += cursor.value().size();
+			cursor.next();
+		}
+		ERR_FAIL_COND_V_MSG(!cursor.ok(), Dictionary(), "Failed to read source database.");
+	}
+	const double sequential_seconds = seconds(begin);
+	ERR_FAIL_COND_V_MSG(keys.empty(), Dictionary(), "The terrain database is empty.");
+
+	Dictionary sequential;
+	sequential["entries"] = static_cast<uint64_t>(keys.size());
+	sequential["bytes"] = bytes;
+	sequential["seconds"] = sequential_seconds;
+	sequential["bytes_per_second"] = bytes / sequential_seconds;
+	sequential["checksum"] = checksum;
+
+	// 随机读取，decode 为 true 时还会解码读到的值。每次都是独立的读事务，与游戏中读取单个区块相同
+	std::mt19937_64 random(kBenchmarkSeed);
+	std::uniform_int_distribution<size_t> distribution(0, keys.size() - 1);
+	const auto randomReads = [&](const bool decode) {
+		uint64_t found = 0, decoded_chunks = 0;
+		const Clock::time_point begin = Clock::now();
+		for (int i = 0; i < reads; ++i) {
+			const std::string &key = keys[distribution(random)];
+			found += source.get(StorageBackend::kTerrainTable, key, [&](const std::string_view value) {
+				if (decode) {
+					decoded_chunks += decodeTerrain(key, value).chunks.size();
+				} else {
+					checksum += static_cast<uint8_t>(value.back());
+				}
+			});
+		}
+		const double elapsed = seconds(begin);
+		Dictionary report;
+		report["reads"] = reads;
+		report["found"] = found;
+		report["seconds"] = elapsed;
+		report["reads_per_second"] = reads / elapsed;
+		report["average_microseconds"] = elapsed * 1e6 / reads;
+		if (decode) {
+			report["decoded_chunks"] = decoded_chunks;
+		}
+		return report;
+	};
+
+	Dictionary result;
+	result["sequential"] = sequential;
+	result["random_read"] = randomReads(false);
+	result["random_read_decode"] = randomReads(true);
+	for (const String name : { "sequential", "random_read", "random_read_decode" }) {
+		const Dictionary report = result[name];
+		print_line(String("{0}: {1} s.").format(varray(name, report["seconds"])));
+	}
+	return result;
+}
+
+void VoxelWorldTool::_bind_methods() {
+	ClassDB::bind_static_method("VoxelWorldTool", D_METHOD("compact", "source", "target"), &VoxelWorldTool::compact);
+	ClassDB::bind_static_method("VoxelWorldTool", D_METHOD("pack", "source", "target", "hot_region"), &VoxelWorldTool::pack, DEFVAL(Rect2i()));
+	ClassDB::bind_static_method("VoxelWorldTool", D_METHOD("inspect", "source", "position"), &VoxelWorldTool::inspect);
+	ClassDB::bind_static_method("VoxelWorldTool", D_METHOD("stats", "source"), &VoxelWorldTool::stats);
+	ClassDB::bind_static_method("VoxelWorldTool", D_METHOD("benchmark", "source", "reads"), &VoxelWorldTool::benchmark, DEFVAL(kDefaultBenchmarkReads));
+}
+
+} //namespace pgvoxel